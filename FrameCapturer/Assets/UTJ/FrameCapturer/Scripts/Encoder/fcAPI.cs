@@ -53,6 +53,26 @@ namespace UTJ.FrameCapturer
             VBR,
         }
 
+        public enum fcColorMatrix
+        {
+            BT601,
+            BT709,
+            BT2020,
+        }
+
+        public enum fcColorRange
+        {
+            Limited,
+            Full,
+        }
+
+        public enum fcSubmitResult
+        {
+            Failed,
+            Succeeded,
+            Busy,
+        }
+
         public enum fcAudioBitsPerSample
         {
             _8Bits = 8,
@@ -64,6 +84,10 @@ namespace UTJ.FrameCapturer
 
         [DllImport ("fccore")] public static extern void         fcSetModulePath(string path);
         [DllImport ("fccore")] public static extern double       fcGetTime();
+        [DllImport ("fccore")] public static extern void         fcSetThreadPoolConfig(int numThreads, ulong coreMask);
+        [DllImport ("fccore")] public static extern int          fcGetThreadPoolSize();
+        [DllImport ("fccore")] public static extern void         fcSetMinConvertBandSize(int num_pixels);
+        [DllImport ("fccore")] public static extern int          fcGetMinConvertBandSize();
 
 
         public struct fcDeferredCall
@@ -79,10 +103,155 @@ namespace UTJ.FrameCapturer
             public void Release() { fcReleaseStream(this); ptr = IntPtr.Zero; }
             public static implicit operator bool(fcStream v) { return v.ptr != IntPtr.Zero; }
         }
+        public struct fcFileStreamConfig
+        {
+            public ulong expectedSize;
+            public Bool directIO;
+            public Bool asyncIO;
+            public int asyncQueueDepth;
+            public int asyncBlockSize;
+
+            public static fcFileStreamConfig default_value
+            {
+                get
+                {
+                    return new fcFileStreamConfig
+                    {
+                        expectedSize = 0,
+                        directIO = false,
+                        asyncIO = false,
+                        asyncQueueDepth = 8,
+                        asyncBlockSize = 1024 * 1024,
+                    };
+                }
+            }
+        };
+
         [DllImport ("fccore")] public static extern fcStream     fcCreateFileStream(string path);
+        [DllImport ("fccore")] public static extern fcStream     fcCreateFileStreamEx(string path, ref fcFileStreamConfig conf);
         [DllImport ("fccore")] public static extern fcStream     fcCreateMemoryStream();
         [DllImport ("fccore")] private static extern void        fcReleaseStream(fcStream s);
+        public struct fcBufferData
+        {
+            public IntPtr data;
+            public UIntPtr size;
+        }
+        [DllImport ("fccore")] public static extern fcBufferData fcStreamGetBufferData(fcStream s);
+        [DllImport ("fccore")] public static extern int          fcStreamGetNumChunks(fcStream s);
+        [DllImport ("fccore")] public static extern fcBufferData fcStreamGetChunk(fcStream s, int i);
         [DllImport ("fccore")] public static extern ulong        fcStreamGetWrittenSize(fcStream s);
+        [DllImport ("fccore")] public static extern void         fcSetStreamBufferSize(int size);
+        [DllImport ("fccore")] public static extern int          fcGetStreamBufferSize();
+        [DllImport ("fccore")] public static extern void         fcStreamFlush(fcStream s);
+
+        public struct fcStreamStats
+        {
+            public Bool ioUring;
+            public int queueDepth;
+            public int maxQueueDepth;
+            public ulong bytesInFlight;
+            public ulong bytesWritten;
+            public ulong numWrites;
+            public double totalLatency;
+            public double maxLatency;
+        }
+        [DllImport ("fccore")] public static extern Bool         fcStreamGetStats(fcStream s, ref fcStreamStats dst);
+
+        public enum fcSinkPolicy
+        {
+            Block,
+            Drop,
+            Spill,
+        }
+
+        public struct fcAsyncSinkConfig
+        {
+            public fcSinkPolicy policy;
+            public ulong maxQueuedBytes;
+            [MarshalAs(UnmanagedType.LPStr)] public string spillPath;
+
+            public static fcAsyncSinkConfig default_value
+            {
+                get
+                {
+                    return new fcAsyncSinkConfig
+                    {
+                        policy = fcSinkPolicy.Block,
+                        maxQueuedBytes = 64 * 1024 * 1024,
+                        spillPath = null,
+                    };
+                }
+            }
+        };
+
+        public struct fcAsyncSinkStats
+        {
+            public ulong queuedBytes;
+            public ulong maxQueuedBytes;
+            public ulong spillBytes;
+            public ulong totalSpilledBytes;
+            public ulong writtenBytes;
+            public double totalBlockTime;
+            public Bool dropped;
+        }
+        [DllImport ("fccore")] public static extern fcStream     fcCreateAsyncSink(fcStream s, ref fcAsyncSinkConfig conf);
+        [DllImport ("fccore")] public static extern Bool         fcAsyncSinkGetStats(fcStream s, ref fcAsyncSinkStats dst);
+        [DllImport ("fccore")] public static extern fcStream     fcCreateAsyncFanOut(fcStream[] sinks, int num_sinks);
+        public struct fcSharedMemoryStreamConfig
+        {
+            public ulong capacity;
+            public int stallTimeoutMs;
+            public Bool replaceExisting;
+
+            public static fcSharedMemoryStreamConfig default_value
+            {
+                get
+                {
+                    return new fcSharedMemoryStreamConfig
+                    {
+                        capacity = 64 * 1024 * 1024,
+                        stallTimeoutMs = 5000,
+                        replaceExisting = false,
+                    };
+                }
+            }
+        };
+
+        [DllImport ("fccore")] public static extern fcStream     fcCreateSharedMemoryStream(string name, ulong capacity);
+        [DllImport ("fccore")] public static extern fcStream     fcCreateSharedMemoryStreamEx(string name, ref fcSharedMemoryStreamConfig conf);
+
+        public struct fcSocketStreamConfig
+        {
+            public int sendBufferSize;
+            public Bool noDelay;
+            public ulong maxQueuedBytes;
+
+            public static fcSocketStreamConfig default_value
+            {
+                get
+                {
+                    return new fcSocketStreamConfig
+                    {
+                        sendBufferSize = 4 * 1024 * 1024,
+                        noDelay = true,
+                        maxQueuedBytes = 64 * 1024 * 1024,
+                    };
+                }
+            }
+        };
+        [DllImport ("fccore")] public static extern fcStream     fcCreateSocketStream(string host, int port, ref fcSocketStreamConfig conf);
+        [DllImport ("fccore")] public static extern fcStream     fcCreateUnixSocketStream(string path, ref fcSocketStreamConfig conf);
+        [DllImport ("fccore")] public static extern fcStream     fcCreateProcessStream(string command);
+
+        // writable frame buffer owned by a context. write pixels into it and submit it to avoid copying the frame.
+        public struct fcFrameBuffer
+        {
+            public IntPtr pixels;
+            public int pitch;
+            public fcPixelFormat format;
+            public IntPtr handle;
+            public static implicit operator bool(fcFrameBuffer v) { return v.handle != IntPtr.Zero; }
+        }
 
         [DllImport ("fccore")] public static extern void         fcGuardBegin();
         [DllImport ("fccore")] public static extern void         fcGuardEnd();
@@ -153,6 +322,59 @@ namespace UTJ.FrameCapturer
         [DllImport ("fccore")] public static extern void fcWaitAsyncDelete();
         [DllImport ("fccore")] public static extern void fcReleaseContext(IntPtr ctx);
 
+        public enum fcBufferPoolType
+        {
+            Video,
+            Audio,
+        }
+
+        public struct fcBufferPoolStats
+        {
+            public int capacity;
+            public int inUse;
+            public int highWaterMark;
+            public ulong numAcquires;
+            public ulong numExhaustions;
+            public ulong numTimeouts;
+            public double totalWaitTime;
+            public double maxWaitTime;
+        }
+        [DllImport ("fccore")] public static extern Bool fcGetBufferPoolStats(IntPtr ctx, fcBufferPoolType type, ref fcBufferPoolStats dst);
+
+
+        // -------------------------------------------------------------
+        // Image Sequence Output
+        // -------------------------------------------------------------
+
+        public enum fcStripeMode
+        {
+            RoundRobin,
+            Hash,
+        };
+
+        public struct fcPathPolicy
+        {
+            public IntPtr ptr;
+            public void Release() { fcReleasePathPolicy(this); ptr = IntPtr.Zero; }
+            public static implicit operator bool(fcPathPolicy v) { return v.ptr != IntPtr.Zero; }
+        }
+
+        [DllImport ("fccore")] public static extern fcPathPolicy fcCreateStripedPathPolicy(string[] directories, int num_directories, fcStripeMode mode, string manifest_path = null);
+        [DllImport ("fccore")] private static extern void        fcReleasePathPolicy(fcPathPolicy pp);
+
+        public struct fcImagePack
+        {
+            public IntPtr ptr;
+            public void Release() { fcReleaseImagePack(this); ptr = IntPtr.Zero; }
+            public static implicit operator bool(fcImagePack v) { return v.ptr != IntPtr.Zero; }
+        }
+
+        [DllImport ("fccore")] public static extern fcImagePack  fcCreateImagePack(fcStream stream, string index_path = null);
+        [DllImport ("fccore")] private static extern void        fcReleaseImagePack(fcImagePack pack);
+        [DllImport ("fccore")] public static extern int          fcImagePackGetNumEntries(fcImagePack pack);
+        [DllImport ("fccore")] public static extern int          fcExtractImagePack(string pack_path, string dst_dir);
+        [DllImport ("fccore")] public static extern Bool         fcExtractImagePackEntry(string pack_path, string index_path, int n, string dst_path);
+
 
         // -------------------------------------------------------------
         // PNG Exporter
@@ -165,11 +387,43 @@ namespace UTJ.FrameCapturer
             UInt16,
         };
 
+        public enum fcPngFilter
+        {
+            Adaptive,
+            None,
+            Sub,
+            Up,
+            Average,
+            Paeth,
+        };
+
+        public enum fcPngStrategy
+        {
+            Default,
+            Filtered,
+            HuffmanOnly,
+            RLE,
+            Fixed,
+        };
+
+        public enum fcPngPreset
+        {
+            Custom,
+            Fast,
+        };
+
         [Serializable]
         public struct fcPngConfig
         {
             public fcPngPixelFormat pixelFormat;
             [Range(1, 32)] public int maxTasks;
+            [HideInInspector] public fcPathPolicy pathPolicy;
+            [HideInInspector] public fcImagePack imagePack;
+            public fcPngPreset preset;
+            [Range(0, 9)] public int compressionLevel;
+            public fcPngFilter filter;
+            public fcPngStrategy strategy;
+            public Bool parallelDeflate;
             // C# ext
             [HideInInspector] public int width;
             [HideInInspector] public int height;
@@ -183,6 +437,11 @@ namespace UTJ.FrameCapturer
                     {
                         pixelFormat = fcPngPixelFormat.Auto,
                         maxTasks = 2,
+                        preset = fcPngPreset.Custom,
+                        compressionLevel = 6,
+                        filter = fcPngFilter.Adaptive,
+                        strategy = fcPngStrategy.Default,
+                        parallelDeflate = false,
                     };
                 }
             }
@@ -197,7 +456,14 @@ namespace UTJ.FrameCapturer
 
         [DllImport ("fccore")] public static extern Bool         fcPngIsSupported();
         [DllImport ("fccore")] public static extern fcPngContext fcPngCreateContext(ref fcPngConfig conf);
-        [DllImport ("fccore")] public static extern Bool         fcPngExportPixels(fcPngContext ctx, string path, byte[] pixels, int width, int height, fcPixelFormat fmt, int num_channels);
+        [DllImport ("fccore")] public static extern Bool         fcPngExportPixels(fcPngContext ctx, string path, byte[] pixels, int width, int height, fcPixelFormat fmt, int num_channels, int pitch = 0);
+        [DllImport ("fccore")] public static extern fcSubmitResult fcPngTryExportPixels(fcPngContext ctx, string path, byte[] pixels, int width, int height, fcPixelFormat fmt, int num_channels, int pitch = 0);
+        [DllImport ("fccore")] public static extern fcFrameBuffer fcPngAcquireFrame(fcPngContext ctx, int width, int height, fcPixelFormat fmt);
+        [DllImport ("fccore")] public static extern Bool         fcPngSubmitFrame(fcPngContext ctx, ref fcFrameBuffer frame, string path, int num_channels);
+        [DllImport ("fccore")] public static extern void         fcPngReleaseFrame(fcPngContext ctx, ref fcFrameBuffer frame);
+        [DllImport ("fccore")] public static extern Bool         fcPngExportPixelsToStream(fcPngContext ctx, fcStream stream, byte[] pixels, int width, int height, fcPixelFormat fmt, int num_channels, int pitch = 0);
+        // tex: Texture.GetNativeTexturePtr()
+        [DllImport ("fccore")] public static extern Bool         fcPngExportTextureToStream(fcPngContext ctx, fcStream stream, IntPtr tex, int width, int height, fcPixelFormat fmt, int num_channels);
 
 
         // -------------------------------------------------------------
@@ -227,6 +493,8 @@ namespace UTJ.FrameCapturer
             public fcExrPixelFormat pixelFormat;
             public fcExrCompression compression;
             [Range(1, 32)] public int maxTasks;
+            [HideInInspector] public fcPathPolicy pathPolicy;
+            [HideInInspector] public fcImagePack imagePack;
             // C# ext
             [HideInInspector] public int width;
             [HideInInspector] public int height;
@@ -256,7 +524,12 @@ namespace UTJ.FrameCapturer
         [DllImport ("fccore")] public static extern Bool         fcExrIsSupported();
         [DllImport ("fccore")] public static extern fcExrContext fcExrCreateContext(ref fcExrConfig conf);
         [DllImport ("fccore")] public static extern Bool         fcExrBeginImage(fcExrContext ctx, string path, int width, int height);
-        [DllImport ("fccore")] public static extern Bool         fcExrAddLayerPixels(fcExrContext ctx, byte[] pixels, fcPixelFormat fmt, int ch, string name);
+        [DllImport ("fccore")] public static extern Bool         fcExrBeginImageStream(fcExrContext ctx, fcStream stream, int width, int height);
+        [DllImport ("fccore")] public static extern fcSubmitResult fcExrTryBeginImage(fcExrContext ctx, string path, int width, int height);
+        [DllImport ("fccore")] public static extern Bool         fcExrAddLayerPixels(fcExrContext ctx, byte[] pixels, fcPixelFormat fmt, int ch, string name, int pitch = 0);
+        [DllImport ("fccore")] public static extern fcFrameBuffer fcExrAcquireLayer(fcExrContext ctx, fcPixelFormat fmt);
+        [DllImport ("fccore")] public static extern Bool         fcExrSubmitLayer(fcExrContext ctx, ref fcFrameBuffer frame, int ch, string name);
+        [DllImport ("fccore")] public static extern void         fcExrReleaseLayer(fcExrContext ctx, ref fcFrameBuffer frame);
         [DllImport ("fccore")] public static extern Bool         fcExrEndImage(fcExrContext ctx);
 
 
@@ -297,6 +570,51 @@ namespace UTJ.FrameCapturer
         [DllImport ("fccore")] public static extern fcGifContext fcGifCreateContext(ref fcGifConfig conf);
         [DllImport ("fccore")] public static extern void         fcGifAddOutputStream(fcGifContext ctx, fcStream stream);
         [DllImport ("fccore")] public static extern Bool         fcGifAddFramePixels(fcGifContext ctx, byte[] pixels, fcPixelFormat fmt, double timestamp = -1.0);
+        [DllImport ("fccore")] public static extern fcFrameBuffer fcGifAcquireFrame(fcGifContext ctx, fcPixelFormat fmt);
+        [DllImport ("fccore")] public static extern Bool         fcGifSubmitFrame(fcGifContext ctx, ref fcFrameBuffer frame, double timestamp = -1.0);
+        [DllImport ("fccore")] public static extern void         fcGifReleaseFrame(fcGifContext ctx, ref fcFrameBuffer frame);
+
+
+        // -------------------------------------------------------------
+        // Y4M Exporter
+        // -------------------------------------------------------------
+
+        [Serializable]
+        public struct fcY4MConfig
+        {
+            [HideInInspector] public int width;
+            [HideInInspector] public int height;
+            [HideInInspector] public int framerate;
+            public Bool linearToSrgb;
+            public fcColorMatrix colorMatrix;
+            public fcColorRange colorRange;
+
+            public static fcY4MConfig default_value
+            {
+                get
+                {
+                    return new fcY4MConfig
+                    {
+                        framerate = 60,
+                        colorMatrix = fcColorMatrix.BT601,
+                        colorRange = fcColorRange.Limited,
+                    };
+                }
+            }
+        };
+        public struct fcY4MContext
+        {
+            public IntPtr ptr;
+            public void Release() { fcReleaseContext(ptr); ptr = IntPtr.Zero; }
+            public static implicit operator bool(fcY4MContext v) { return v.ptr != IntPtr.Zero; }
+        }
+
+        [DllImport ("fccore")] public static extern Bool         fcY4MIsSupported();
+        [DllImport ("fccore")] public static extern fcY4MContext fcY4MCreateContext(ref fcY4MConfig conf);
+        [DllImport ("fccore")] public static extern void         fcY4MAddOutputStream(fcY4MContext ctx, fcStream stream);
+        [DllImport ("fccore")] public static extern Bool         fcY4MAddFramePixels(fcY4MContext ctx, byte[] pixels, fcPixelFormat fmt, int pitch = 0);
+        // tex: Texture.GetNativeTexturePtr()
+        [DllImport ("fccore")] public static extern Bool         fcY4MAddFrameTexture(fcY4MContext ctx, IntPtr tex, fcPixelFormat fmt);
 
 
         // -------------------------------------------------------------
@@ -331,6 +649,9 @@ namespace UTJ.FrameCapturer
             public int videoTargetBitrate;
             [HideInInspector] public int videoFlags;
             [Range(1, 32)] public int videoMaxTasks;
+            public Bool videoLinearToSRGB;
+            public fcColorMatrix videoColorMatrix;
+            public fcColorRange videoColorRange;
 
             [HideInInspector] public Bool audio;
             [HideInInspector] public int audioSampleRate;
@@ -352,6 +673,9 @@ namespace UTJ.FrameCapturer
                         videoTargetFramerate = 30,
                         videoFlags = (int)fcMP4VideoFlags.H264Mask,
                         videoMaxTasks = 4,
+                        videoLinearToSRGB = false,
+                        videoColorMatrix = fcColorMatrix.BT601,
+                        videoColorRange = fcColorRange.Limited,
 
                         audio = true,
                         audioSampleRate = 48000,
@@ -378,7 +702,11 @@ namespace UTJ.FrameCapturer
         [DllImport ("fccore")] public static extern void             fcMP4AddOutputStream(fcMP4Context ctx, fcStream s);
         [DllImport ("fccore")] private static extern IntPtr          fcMP4GetAudioEncoderInfo(fcMP4Context ctx);
         [DllImport ("fccore")] private static extern IntPtr          fcMP4GetVideoEncoderInfo(fcMP4Context ctx);
-        [DllImport ("fccore")] public static extern Bool             fcMP4AddVideoFramePixels(fcMP4Context ctx, byte[] pixels, fcPixelFormat fmt, double timestamp = -1.0);
+        [DllImport ("fccore")] public static extern Bool             fcMP4AddVideoFramePixels(fcMP4Context ctx, byte[] pixels, fcPixelFormat fmt, double timestamp = -1.0, int pitch = 0);
+        [DllImport ("fccore")] public static extern fcFrameBuffer    fcMP4AcquireVideoFrame(fcMP4Context ctx, fcPixelFormat fmt);
+        [DllImport ("fccore")] public static extern Bool             fcMP4SubmitVideoFrame(fcMP4Context ctx, ref fcFrameBuffer frame, double timestamp = -1.0);
+        [DllImport ("fccore")] public static extern void             fcMP4ReleaseVideoFrame(fcMP4Context ctx, ref fcFrameBuffer frame);
+        [DllImport ("fccore")] public static extern Bool             fcMP4AddVideoFramePixelsBorrowed(fcMP4Context ctx, IntPtr pixels, fcPixelFormat fmt, double timestamp, IntPtr release, IntPtr param, int pitch = 0);
         [DllImport ("fccore")] public static extern Bool             fcMP4AddAudioSamples(fcMP4Context ctx, float[] samples, int num_samples);
 
         public static string fcMP4GetAudioEncoderInfoS(fcMP4Context ctx)
@@ -426,6 +754,9 @@ namespace UTJ.FrameCapturer
             public fcBitrateMode videoBitrateMode;
             public int videoTargetBitrate;
             [Range(1, 32)] public int videoMaxTasks;
+            public Bool videoLinearToSRGB;
+            public fcColorMatrix videoColorMatrix;
+            public fcColorRange videoColorRange;
 
             [HideInInspector] public Bool audio;
             public fcWebMAudioEncoder audioEncoder;
@@ -447,6 +778,9 @@ namespace UTJ.FrameCapturer
                         videoBitrateMode = fcBitrateMode.VBR,
                         videoTargetBitrate = 1024 * 1000,
                         videoMaxTasks = 4,
+                        videoLinearToSRGB = false,
+                        videoColorMatrix = fcColorMatrix.BT601,
+                        videoColorRange = fcColorRange.Limited,
 
                         audio = true,
                         audioEncoder = fcWebMAudioEncoder.Vorbis,
@@ -464,7 +798,11 @@ namespace UTJ.FrameCapturer
         [DllImport ("fccore")] public static extern fcWebMContext fcWebMCreateContext(ref fcWebMConfig conf);
         [DllImport ("fccore")] public static extern void fcWebMAddOutputStream(fcWebMContext ctx, fcStream stream);
         // timestamp=-1 is treated as current time.
-        [DllImport ("fccore")] public static extern Bool fcWebMAddVideoFramePixels(fcWebMContext ctx, byte[] pixels, fcPixelFormat fmt, double timestamp = -1.0);
+        [DllImport ("fccore")] public static extern Bool fcWebMAddVideoFramePixels(fcWebMContext ctx, byte[] pixels, fcPixelFormat fmt, double timestamp = -1.0, int pitch = 0);
+        [DllImport ("fccore")] public static extern fcFrameBuffer fcWebMAcquireVideoFrame(fcWebMContext ctx, fcPixelFormat fmt);
+        [DllImport ("fccore")] public static extern Bool fcWebMSubmitVideoFrame(fcWebMContext ctx, ref fcFrameBuffer frame, double timestamp = -1.0);
+        [DllImport ("fccore")] public static extern void fcWebMReleaseVideoFrame(fcWebMContext ctx, ref fcFrameBuffer frame);
+        [DllImport ("fccore")] public static extern Bool fcWebMAddVideoFramePixelsBorrowed(fcWebMContext ctx, IntPtr pixels, fcPixelFormat fmt, double timestamp, IntPtr release, IntPtr param, int pitch = 0);
         // timestamp=-1 is treated as current time.
         [DllImport ("fccore")] public static extern Bool fcWebMAddAudioSamples(fcWebMContext ctx, float[] samples, int num_samples);
 
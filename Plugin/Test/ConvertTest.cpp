@@ -17,6 +17,44 @@ void ConvertTestImpl(fcIPngContext *ctx, RawVector<Src>& src)
     fcPngExportPixels(ctx, filename, data, Width, Height, GetPixelFormat<Dst>::value);
 }
 
+// banded (parallel) conversion must give the same result as single pass
+template<class Src, class Dst>
+void ConvertBandTestImpl(int width, int height)
+{
+    RawVector<Src> src(width * height);
+    CreateVideoData(&src[0], width, height, 0);
+
+    RawVector<Dst> dst1(width * height), dst2(width * height);
+    int band_size = fcGetMinConvertBandSize();
+    fcSetMinConvertBandSize(0);
+    fcConvertPixelFormat(&dst1[0], GetPixelFormat<Dst>::value, &src[0], GetPixelFormat<Src>::value, src.size());
+    fcSetMinConvertBandSize(1024);
+    fcConvertPixelFormat(&dst2[0], GetPixelFormat<Dst>::value, &src[0], GetPixelFormat<Src>::value, src.size());
+    fcSetMinConvertBandSize(band_size);
+
+    bool ok = memcmp(&dst1[0], &dst2[0], dst1.size() * sizeof(Dst)) == 0;
+    printf("  %s -> %s (%dx%d) banded: %s\n", GetPixelFormat<Src>::getName(), GetPixelFormat<Dst>::getName(), width, height, ok ? "ok" : "mismatch");
+}
+
+// converting a bottom-up image with negative pitch must give the same result as flip + convert
+template<class Src, class Dst>
+void ConvertFlipTestImpl(int width, int height)
+{
+    RawVector<Src> src(width * height);
+    CreateVideoData(&src[0], width, height, 0);
+
+    RawVector<Src> flipped = src;
+    fcImageFlipY(&flipped[0], width, height, GetPixelFormat<Src>::value);
+
+    RawVector<Dst> dst1(width * height), dst2(width * height);
+    fcConvertPixelFormat(&dst1[0], GetPixelFormat<Dst>::value, &src[0], GetPixelFormat<Src>::value, src.size());
+    fcConvertPixelFormat2D(&dst2[0], GetPixelFormat<Dst>::value, 0,
+        &flipped[0], GetPixelFormat<Src>::value, -width * (int)sizeof(Src), width, height);
+
+    bool ok = memcmp(&dst1[0], &dst2[0], dst1.size() * sizeof(Dst)) == 0;
+    printf("  %s -> %s (%dx%d) flipped: %s\n", GetPixelFormat<Src>::getName(), GetPixelFormat<Dst>::getName(), width, height, ok ? "ok" : "mismatch");
+}
+
 void ConvertTest()
 {
     printf("ConvertTest begin\n");
@@ -57,6 +95,11 @@ void ConvertTest()
 
     fcReleaseContext(ctx);
 
+    ConvertBandTestImpl<RGBAf16, RGBAu8>(1920, 1080);
+    ConvertBandTestImpl<RGBAu8, RGBf32>(1023, 511);
+    ConvertFlipTestImpl<RGBAf16, RGBAu8>(1920, 1080);
+    ConvertFlipTestImpl<RGBAu8, RGBAu8>(321, 241);
+
     printf("ConvertTest end\n");
 
 }
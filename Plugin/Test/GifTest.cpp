@@ -27,6 +27,39 @@ void GifTestImpl(const char *filename)
     fcReleaseStream(fstream);
 }
 
+static void GifAcquireReleaseTest()
+{
+    const int Width = 64;
+    const int Height = 64;
+
+    fcGifConfig conf;
+    conf.width = Width;
+    conf.height = Height;
+    conf.max_tasks = 2;
+    fcIGifContext *ctx = fcGifCreateContext(&conf);
+    fcIGifContext *ctx2 = fcGifCreateContext(&conf);
+
+    // would block forever if released frames kept their buffers
+    bool ok = true;
+    for (int i = 0; i < conf.max_tasks * 2; ++i) {
+        fcFrameBuffer frame = fcGifAcquireFrame(ctx, fcPixelFormat_RGBAu8);
+        ok = ok && frame.pixels != nullptr;
+        fcGifReleaseFrame(ctx, &frame);
+        ok = ok && frame.handle == nullptr;
+    }
+
+    fcFrameBuffer frame = fcGifAcquireFrame(ctx, fcPixelFormat_RGBAu8);
+    CreateVideoData((RGBAu8*)frame.pixels, Width, Height, 0);
+    fcFrameBuffer copy = frame;
+    ok = ok && !fcGifSubmitFrame(ctx2, &frame);
+    ok = ok && fcGifSubmitFrame(ctx, &frame);
+    ok = ok && !fcGifSubmitFrame(ctx, &copy);
+
+    fcReleaseContext(ctx2);
+    fcReleaseContext(ctx);
+    printf("GifAcquireReleaseTest: %s\n", ok ? "succeeded" : "failed");
+}
+
 void GifTest()
 {
     if (!fcGifIsSupported()) {
@@ -46,6 +79,8 @@ void GifTest()
 
     for (auto& task : tasks) { task.get(); }
 
+    GifAcquireReleaseTest();
+
     printf("GifTest end\n");
 }
 
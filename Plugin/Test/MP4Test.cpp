@@ -6,6 +6,15 @@
 static size_t tellp(void *f) { return ftell((FILE*)f); }
 static void   seekp(void *f, size_t pos) { fseek((FILE*)f, (long)pos, SEEK_SET); }
 static size_t write(void *f, const void *data, size_t len) { return fwrite(data, 1, len, (FILE*)f); }
+static size_t writev(void *f, const fcWriteSpan *spans, int num_spans)
+{
+    size_t ret = 0;
+    for (int i = 0; i < num_spans; ++i) {
+        ret += fwrite(spans[i].data, 1, spans[i].size, (FILE*)f);
+    }
+    return ret;
+}
+static void flush(void *f) { fflush((FILE*)f); }
 
 
 const int DurationInSeconds = 10;
@@ -63,19 +72,65 @@ void MP4Test(int video_encoder, int audio_encoder, const char *filename)
 
     printf("MP4Test (%s) begin\n", filename);
 
+    char filename_v[256];
+    sprintf(filename_v, "custom_stream_v %s", filename);
+
     fcStream* fstream = fcCreateFileStream(filename);
+    FILE *ofile = fopen(filename_v, "wb");
+    fcStream* vstream = fcCreateCustomStreamV(ofile, &tellp, &seekp, &writev, &flush);
     fcIMP4Context *ctx = fcMP4CreateContext(&conf);
     if (!ctx) {
         printf("  Failed to create context. Possibly H264 or AAC encoder is not available.\n");
     }
     fcMP4AddOutputStream(ctx, fstream);
+    fcMP4AddOutputStream(ctx, vstream);
     WriteMovieData(ctx);
     fcReleaseContext(ctx);
     fcReleaseStream(fstream);
+    fcReleaseStream(vstream);
+    fclose(ofile);
 
     printf("MP4Test (%s) end\n", filename);
 }
 
+static void MP4AcquireReleaseTest()
+{
+    fcMP4Config conf;
+    conf.video_width = Width;
+    conf.video_height = Height;
+    conf.video_flags = fcMP4_H264OpenH264;
+    conf.video_max_tasks = 2;
+    conf.audio = false;
+    fcIMP4Context *ctx = fcMP4CreateContext(&conf);
+    fcIMP4Context *ctx2 = fcMP4CreateContext(&conf);
+    if (!ctx || !ctx2) {
+        printf("MP4AcquireReleaseTest: skipped. OpenH264 is not available.\n");
+        fcReleaseContext(ctx2);
+        fcReleaseContext(ctx);
+        return;
+    }
+
+    // would block forever if released frames kept their buffers
+    bool ok = true;
+    for (int i = 0; i < conf.video_max_tasks * 2; ++i) {
+        fcFrameBuffer frame = fcMP4AcquireVideoFrame(ctx, fcPixelFormat_RGBAu8);
+        ok = ok && frame.pixels != nullptr;
+        fcMP4ReleaseVideoFrame(ctx, &frame);
+        ok = ok && frame.handle == nullptr;
+    }
+
+    fcFrameBuffer frame = fcMP4AcquireVideoFrame(ctx, fcPixelFormat_RGBAu8);
+    CreateVideoData((RGBAu8*)frame.pixels, Width, Height, 0);
+    fcFrameBuffer copy = frame;
+    ok = ok && !fcMP4SubmitVideoFrame(ctx2, &frame);
+    ok = ok && fcMP4SubmitVideoFrame(ctx, &frame);
+    ok = ok && !fcMP4SubmitVideoFrame(ctx, &copy);
+
+    fcReleaseContext(ctx2);
+    fcReleaseContext(ctx);
+    printf("MP4AcquireReleaseTest: %s\n", ok ? "succeeded" : "failed");
+}
+
 void MP4TestOSProvidedEncoder(const char *filename)
 {
     fcMP4Config conf;
@@ -115,5 +170,6 @@ void MP4Test()
         MP4Test(fcMP4_H264IntelHW, 0, "IntelHW.mp4");
         MP4Test(fcMP4_H264IntelSW, 0, "IntelSW.mp4");
         MP4Test(fcMP4_H264OpenH264, fcMP4_AACFAAC, "OpenH264.mp4");
+        MP4AcquireReleaseTest();
     }
 }
@@ -1,5 +1,139 @@
 #include "pch.h"
 #include "TestCommon.h"
+#include <zlib.h>
+
+#ifdef _MSC_VER
+    #pragma comment(lib, "zlibstatic.lib")
+#endif
+
+static uint32_t GetU32BE(const uint8_t *p)
+{
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+static int PaethPredictor(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) { return a; }
+    return pb <= pc ? b : c;
+}
+
+// decode 8 bit RGBA png in memory. return false if it is broken.
+static bool DecodePngRGBAu8(const uint8_t *png, size_t size, int& width, int& height, std::vector<uint8_t>& dst)
+{
+    std::vector<uint8_t> idat;
+    for (size_t pos = 8; pos + 12 <= size; ) {
+        uint32_t len = GetU32BE(png + pos);
+        const uint8_t *type = png + pos + 4;
+        const uint8_t *data = png + pos + 8;
+        if (pos + 12 + len > size || GetU32BE(data + len) != (uint32_t)crc32(0, type, len + 4)) { return false; }
+        if (memcmp(type, "IHDR", 4) == 0) {
+            width = (int)GetU32BE(data);
+            height = (int)GetU32BE(data + 4);
+            if (data[8] != 8 || data[9] != 6) { return false; }
+        }
+        else if (memcmp(type, "IDAT", 4) == 0) {
+            idat.insert(idat.end(), data, data + len);
+        }
+        pos += 12 + len;
+    }
+
+    size_t row_size = (size_t)width * 4;
+    std::vector<uint8_t> filtered((row_size + 1) * height);
+    uLongf filtered_size = (uLongf)filtered.size();
+    if (uncompress(filtered.data(), &filtered_size, idat.data(), (uLong)idat.size()) != Z_OK || filtered_size != filtered.size()) {
+        return false;
+    }
+
+    dst.assign(row_size * height, 0);
+    std::vector<uint8_t> zero_row(row_size);
+    for (int y = 0; y < height; ++y) {
+        const uint8_t *line = &filtered[(row_size + 1) * y];
+        uint8_t *cur = &dst[row_size * y];
+        const uint8_t *prev = y > 0 ? cur - row_size : zero_row.data();
+        for (size_t i = 0; i < row_size; ++i) {
+            int a = i >= 4 ? cur[i - 4] : 0;
+            int b = prev[i];
+            int c = i >= 4 ? prev[i - 4] : 0;
+            int pred = 0;
+            switch (line[0]) {
+            case 0: pred = 0; break;
+            case 1: pred = a; break;
+            case 2: pred = b; break;
+            case 3: pred = (a + b) >> 1; break;
+            case 4: pred = PaethPredictor(a, b, c); break;
+            default: return false;
+            }
+            cur[i] = (uint8_t)(line[1 + i] + pred);
+        }
+    }
+    return true;
+}
+
+// wide and short image with parallel deflate. rows don't divide evenly into bands.
+static void PngParallelDeflateTest()
+{
+    const int Width = 60000;
+    const int Height = 9;
+
+    int num_threads = fcGetThreadPoolSize();
+    fcSetThreadPoolConfig(8, 0);
+
+    RawVector<RGBAu8> video_frame(Width * Height);
+    CreateVideoData(&video_frame[0], Width, Height, 0);
+
+    fcPngConfig conf;
+    conf.parallel_deflate = true;
+    fcIPngContext *ctx = fcPngCreateContext(&conf);
+    fcStream *stream = fcCreateMemoryStream();
+    fcPngExportPixelsToStream(ctx, stream, &video_frame[0], Width, Height, fcPixelFormat_RGBAu8, 4);
+    fcReleaseContext(ctx);
+    fcWaitAsyncDelete(); // the stream is complete when the context is gone
+
+    int width = 0, height = 0;
+    std::vector<uint8_t> decoded;
+    fcBufferData png = fcStreamGetBufferData(stream);
+    bool ok = DecodePngRGBAu8((const uint8_t*)png.data, png.size, width, height, decoded) &&
+        width == Width && height == Height &&
+        memcmp(decoded.data(), &video_frame[0], decoded.size()) == 0;
+    printf("PngParallelDeflateTest: %s\n", ok ? "succeeded" : "failed");
+    fcReleaseStream(stream);
+
+    fcSetThreadPoolConfig(num_threads, 0);
+}
+
+// frames that are not submitted are given back by fcPngReleaseFrame(). handles of other contexts are rejected.
+static void PngAcquireReleaseTest()
+{
+    const int Width = 64;
+    const int Height = 64;
+
+    fcPngConfig conf;
+    conf.max_tasks = 2;
+    fcIPngContext *ctx = fcPngCreateContext(&conf);
+    fcIPngContext *ctx2 = fcPngCreateContext(&conf);
+
+    // would block forever if released frames kept their task slots
+    bool ok = true;
+    for (int i = 0; i < conf.max_tasks * 2; ++i) {
+        fcFrameBuffer frame = fcPngAcquireFrame(ctx, Width, Height, fcPixelFormat_RGBAu8);
+        ok = ok && frame.pixels != nullptr;
+        fcPngReleaseFrame(ctx, &frame);
+        ok = ok && frame.handle == nullptr;
+    }
+
+    fcFrameBuffer frame = fcPngAcquireFrame(ctx, Width, Height, fcPixelFormat_RGBAu8);
+    CreateVideoData((RGBAu8*)frame.pixels, Width, Height, 0);
+    fcFrameBuffer copy = frame;
+    ok = ok && !fcPngSubmitFrame(ctx2, &frame, "AcquireRelease.png", 4);
+    ok = ok && fcPngSubmitFrame(ctx, &frame, "AcquireRelease.png", 4);
+    ok = ok && !fcPngSubmitFrame(ctx, &copy, "AcquireRelease.png", 4);
+
+    fcReleaseContext(ctx2);
+    fcReleaseContext(ctx);
+    printf("PngAcquireReleaseTest: %s\n", ok ? "succeeded" : "failed");
+}
 
 template<class T>
 void PngTestImpl(fcIPngContext *ctx, const char *filename, bool flipY=false)
@@ -34,5 +168,24 @@ void PngTest()
 
     fcReleaseContext(ctx);
 
+    // pack frames into one archive instead of a file per frame
+    {
+        fcStream *fstream = fcCreateFileStream("PngPack.tar");
+        fcPngConfig pconf;
+        pconf.image_pack = fcCreateImagePack(fstream, "PngPack.idx");
+        fcReleaseStream(fstream);
+        fcIPngContext *pctx = fcPngCreateContext(&pconf);
+        fcReleaseImagePack(pconf.image_pack);
+
+        PngTestImpl<RGBAu8>(pctx, "Packed0.png");
+        PngTestImpl<RGBAf16>(pctx, "Packed1.png");
+        fcReleaseContext(pctx);
+        fcWaitAsyncDelete(); // the pack is closed when the context is gone
+        fcExtractImagePackEntry("PngPack.tar", "PngPack.idx", 1, "Packed1_Extracted.png");
+    }
+
+    PngParallelDeflateTest();
+    PngAcquireReleaseTest();
+
     printf("PngTest end\n");
 }
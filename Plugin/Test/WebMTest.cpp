@@ -47,9 +47,12 @@ WebMTestContext::WebMTestContext(const fcWebMConfig& conf)
 WebMTestContext::~WebMTestContext()
 {
     {
-        fcBufferData bd = fcStreamGetBufferData(mstream);
         std::fstream of(filename_m, std::ios::binary | std::ios::out);
-        of.write((char*)bd.data, bd.size);
+        int n = fcStreamGetNumChunks(mstream);
+        for (int i = 0; i < n; ++i) {
+            fcBufferData bd = fcStreamGetChunk(mstream, i);
+            of.write((char*)bd.data, bd.size);
+        }
     }
     fcReleaseStream(fstream);
     fcReleaseStream(mstream);
@@ -30,10 +30,11 @@ class fcFlacContext : public fcIFlacContext
 {
 public:
     using AudioBuffer = RawVector<float>;
-    using AudioBuffers = SharedResources<AudioBuffer>;
+    using AudioBuffers = ResourcePool<AudioBuffer>;
 
     fcFlacContext(const fcFlacConfig& c);
     ~fcFlacContext() override;
+    bool getBufferPoolStats(fcBufferPoolType type, fcBufferPoolStats& dst) override;
 
     void addOutputStream(fcStream *s) override;
     bool addSamples(const float *samples, int num_samples) override;
@@ -154,6 +155,13 @@ fcFlacContext::~fcFlacContext()
     m_writers.clear();
 }
 
+bool fcFlacContext::getBufferPoolStats(fcBufferPoolType type, fcBufferPoolStats& dst)
+{
+    if (type != fcBufferPoolType::Audio) { return false; }
+    m_buffers.getStats(dst);
+    return true;
+}
+
 void fcFlacContext::addOutputStream(fcStream *s)
 {
     if (s) {
@@ -15,10 +15,11 @@ class fcOggContext : public fcIOggContext
 {
 public:
     using AudioBuffer = RawVector<float>;
-    using AudioBuffers = SharedResources<AudioBuffer>;
+    using AudioBuffers = ResourcePool<AudioBuffer>;
 
     fcOggContext(const fcOggConfig& conf);
     virtual ~fcOggContext() override;
+    bool getBufferPoolStats(fcBufferPoolType type, fcBufferPoolStats& dst) override;
 
     virtual void addOutputStream(fcStream *s) override;
     virtual bool addSamples(const float *samples, int num_samples) override;
@@ -105,6 +106,13 @@ fcOggContext::~fcOggContext()
     vorbis_info_clear(&m_vo_info);
 }
 
+bool fcOggContext::getBufferPoolStats(fcBufferPoolType type, fcBufferPoolStats& dst)
+{
+    if (type != fcBufferPoolType::Audio) { return false; }
+    m_buffers.getStats(dst);
+    return true;
+}
+
 void fcOggContext::addOutputStream(fcStream *s)
 {
     if (!s) { return; }
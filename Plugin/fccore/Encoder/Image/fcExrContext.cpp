@@ -12,6 +12,7 @@
 #include <OpenEXR/ImfStringAttribute.h>
 #include <OpenEXR/ImfMatrixAttribute.h>
 #include <OpenEXR/ImfArray.h>
+#include <OpenEXR/ImfIO.h>
 
 #if defined(fcWindows)
     #pragma comment(lib, "Half.lib")
@@ -23,18 +24,52 @@
 #endif
 
 
+// Imf::OStream that writes into a Buffer.
+// OutputFile seeks back to write the line offset table, so images for streams are built in memory first.
+class fcExrBufferOStream : public Imf::OStream
+{
+public:
+    fcExrBufferOStream(Buffer& dst) : Imf::OStream("fcStream"), m_buf(dst) { m_buf.resize(0); }
+
+    void write(const char c[], int n) override
+    {
+        size_t end = m_pos + n;
+        if (end > m_buf.size()) { m_buf.resize(end); }
+        memcpy(m_buf.data() + m_pos, c, n);
+        m_pos = end;
+    }
+    Imf::Int64 tellp() override { return m_pos; }
+    void seekp(Imf::Int64 pos) override { m_pos = (size_t)pos; }
+
+private:
+    Buffer& m_buf;
+    size_t m_pos = 0;
+};
+
+// pooled. layer buffers and the encoded image keep their capacity across frames, so steady-state recording doesn't allocate.
 struct fcExrTaskData
 {
     std::string path;
+    fcStream *stream = nullptr; // written into stream instead of path if not null
+    bool packed = false;        // appended to fcExrConfig::image_pack with the file name of path
+    uint64_t seq = 0;           // order of writes to streams and packs
+    Buffer encoded;             // image for stream / pack
     int width = 0;
     int height = 0;
-    std::list<Buffer> pixels;
     Imf::Header header;
     Imf::FrameBuffer frame_buffer;
 
-    fcExrTaskData(const char *p, int w, int h, fcExrCompression compression)
-        : path(p), width(w), height(h), header(w, h)
+    void reset(int w, int h, fcExrCompression compression)
     {
+        path.clear();
+        stream = nullptr;
+        packed = false;
+        seq = 0;
+        width = w;
+        height = h;
+        num_layers = 0;
+        frame_buffer = Imf::FrameBuffer();
+        header = Imf::Header(w, h);
         switch (compression) {
         case fcExrCompression::None:    header.compression() = Imf::NO_COMPRESSION; break;
         case fcExrCompression::RLE:     header.compression() = Imf::RLE_COMPRESSION; break;
@@ -43,6 +78,43 @@ struct fcExrTaskData
         case fcExrCompression::PIZ:     header.compression() = Imf::PIZ_COMPRESSION; break;
         }
     }
+
+    // returned buffer stays valid until the next reset()
+    Buffer* allocLayer(size_t size)
+    {
+        if (num_layers == layers.size()) {
+            layers.emplace_back(new Buffer());
+        }
+        auto *ret = layers[num_layers++].get();
+        ret->resize(size);
+        return ret;
+    }
+    void popLayer() { --num_layers; }
+
+    bool hasLayer(const Buffer *buf) const
+    {
+        for (size_t i = 0; i < num_layers; ++i) {
+            if (layers[i].get() == buf) { return true; }
+        }
+        return false;
+    }
+    bool isLastLayer(const Buffer *buf) const { return num_layers > 0 && layers[num_layers - 1].get() == buf; }
+
+    // true if a slice of frame_buffer points into buf
+    bool isLayerUsed(const Buffer *buf) const
+    {
+        auto *begin = buf->data();
+        auto *end = begin + buf->size();
+        for (auto i = frame_buffer.begin(); i != frame_buffer.end(); ++i) {
+            auto *base = i.slice().base;
+            if (base >= begin && base < end) { return true; }
+        }
+        return false;
+    }
+
+private:
+    std::vector<std::unique_ptr<Buffer>> layers;
+    size_t num_layers = 0;
 };
 
 class fcExrContext : public fcIExrContext
@@ -52,20 +124,36 @@ public:
     ~fcExrContext();
 
     bool beginFrame(const char *path, int width, int height) override;
+    fcSubmitResult tryBeginFrame(const char *path, int width, int height) override;
+    bool beginFrameStream(fcStream *stream, int width, int height) override;
     bool addLayerTexture(void *tex, fcPixelFormat fmt, int channel, const char *name) override;
-    bool addLayerPixels(const void *pixels, fcPixelFormat fmt, int channel, const char *name) override;
+    bool addLayerPixels(const void *pixels, fcPixelFormat fmt, int channel, const char *name, int pitch) override;
+    fcFrameBuffer acquireLayer(fcPixelFormat fmt) override;
+    bool submitLayer(fcFrameBuffer& frame, int channel, const char *name) override;
+    void releaseLayer(fcFrameBuffer& frame) override;
     bool endFrame() override;
+    bool getBufferPoolStats(fcBufferPoolType type, fcBufferPoolStats& dst) override;
 
 private:
+    using TaskDataPool = ResourcePool<fcExrTaskData>;
+    using TaskData = TaskDataPool::ResourceHolder;
+
+    fcPixelFormat getLayerFormat(fcPixelFormat src_fmt) const;
+    // owned: layer buffer of m_task that holds pixels. used as is if no conversion is needed.
+    bool addLayerPixelsImpl(const void *pixels, fcPixelFormat fmt, int pitch, int channel, const char *name, Buffer *owned);
     bool addLayerImpl(char *pixels, fcPixelFormat fmt, int channel, const char *name);
-    void endFrameTask(fcExrTaskData *exr);
+    void endFrameTask(TaskData exr);
+    // assume a task slot is already acquired. output goes to stream if it is not null, otherwise to path.
+    void createTask(const char *path, fcStream *stream, int width, int height);
 
 private:
     fcExrConfig m_conf;
     fcIGraphicsDevice *m_dev = nullptr;
-    fcExrTaskData *m_task = nullptr;
+    TaskDataPool m_task_data;
+    TaskData m_task;
     TaskGroup m_tasks;
-    std::atomic_int m_active_task_count = { 0 };
+    Semaphore m_task_slots;
+    OrderedTaskQueue m_stream_writes;
 
     const void *m_frame_prev = nullptr;
     Buffer *m_src_prev = nullptr;
@@ -81,32 +169,103 @@ fcExrContext::fcExrContext(const fcExrConfig& conf, fcIGraphicsDevice *dev)
     if (m_conf.max_tasks <= 0) {
         m_conf.max_tasks = std::thread::hardware_concurrency();
     }
+    m_tasks.setMaxTasks(m_conf.max_tasks);
+    m_task_slots.reset(m_conf.max_tasks);
+    for (int i = 0; i < m_conf.max_tasks; ++i) {
+        m_task_data.emplace();
+    }
+    if (m_conf.path_policy) {
+        m_conf.path_policy->addRef();
+    }
+    if (m_conf.image_pack) {
+        m_conf.image_pack->addRef();
+    }
 }
 
 fcExrContext::~fcExrContext()
 {
+    if (m_task) {
+        // beginFrame() without endFrame(). its place in the write order must be filled, otherwise the wait below never ends.
+        if (m_task->stream || m_task->packed) {
+            if (m_task->stream) { m_task->stream->release(); }
+            m_stream_writes.run(m_task->seq, []() {});
+        }
+        m_task.reset();
+        m_task_slots.release();
+    }
     m_tasks.wait();
+    m_stream_writes.wait();
+    if (m_conf.path_policy) {
+        m_conf.path_policy->release();
+    }
+    if (m_conf.image_pack) {
+        m_conf.image_pack->release();
+    }
+}
+
+void fcExrContext::createTask(const char *path, fcStream *stream, int width, int height)
+{
+    // a task slot is held, so this never waits
+    m_task = m_task_data.acquire();
+    m_task->reset(width, height, m_conf.compression);
+    if (stream) {
+        stream->addRef();
+        m_task->stream = stream;
+        m_task->seq = m_stream_writes.issue();
+    }
+    else if (m_conf.image_pack) {
+        m_task->path = path;
+        m_task->packed = true;
+        m_task->seq = m_stream_writes.issue();
+    }
+    else {
+        m_task->path = m_conf.path_policy ? m_conf.path_policy->resolve(path) : std::string(path);
+    }
+}
+
+bool fcExrContext::getBufferPoolStats(fcBufferPoolType type, fcBufferPoolStats& dst)
+{
+    if (type != fcBufferPoolType::Video) { return false; }
+    m_task_data.getStats(dst);
+    return true;
 }
 
 
 bool fcExrContext::beginFrame(const char *path, int width, int height)
 {
-    if (m_task != nullptr) {
+    if (m_task) {
         fcDebugLog("fcExrContext::beginFrame(): beginFrame() is already called. maybe you forgot to call endFrame().");
         return false;
     }
 
-    // 実行中のタスクの数が上限に達している場合適当に待つ
-    if (m_active_task_count >= m_conf.max_tasks)
-    {
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
-        if (m_active_task_count >= m_conf.max_tasks)
-        {
-            m_tasks.wait();
-        }
+    // 実行中のタスクの数が上限に達している場合空きが出るまで待つ
+    m_task_slots.acquire();
+    createTask(path, nullptr, width, height);
+    return true;
+}
+
+fcSubmitResult fcExrContext::tryBeginFrame(const char *path, int width, int height)
+{
+    if (m_task) {
+        fcDebugLog("fcExrContext::tryBeginFrame(): beginFrame() is already called. maybe you forgot to call endFrame().");
+        return fcSubmitResult::Failed;
     }
 
-    m_task = new fcExrTaskData(path, width, height, m_conf.compression);
+    if (!m_task_slots.tryAcquire()) { return fcSubmitResult::Busy; }
+    createTask(path, nullptr, width, height);
+    return fcSubmitResult::Succeeded;
+}
+
+bool fcExrContext::beginFrameStream(fcStream *stream, int width, int height)
+{
+    if (m_task) {
+        fcDebugLog("fcExrContext::beginFrameStream(): beginFrame() is already called. maybe you forgot to call endFrame().");
+        return false;
+    }
+    if (!stream) { return false; }
+
+    m_task_slots.acquire();
+    createTask(nullptr, stream, width, height);
     return true;
 }
 
@@ -116,7 +275,7 @@ bool fcExrContext::addLayerTexture(void *tex, fcPixelFormat fmt, int channel, co
         fcDebugLog("fcExrContext::addLayerTexture(): gfx device is null.");
         return false;
     }
-    if (m_task == nullptr) {
+    if (!m_task) {
         fcDebugLog("fcExrContext::addLayerTexture(): maybe beginFrame() is not called.");
         return false;
     }
@@ -132,27 +291,22 @@ bool fcExrContext::addLayerTexture(void *tex, fcPixelFormat fmt, int channel, co
     {
         m_frame_prev = tex;
 
-        m_task->pixels.push_back(Buffer());
-        raw_frame = &m_task->pixels.back();
-        raw_frame->resize(m_task->width * m_task->height * fcGetPixelSize(fmt));
+        raw_frame = m_task->allocLayer(m_task->width * m_task->height * fcGetPixelSize(fmt));
 
         // get frame buffer
         if (!m_dev->readTexture(&(*raw_frame)[0], raw_frame->size(), tex, m_task->width, m_task->height, fmt))
         {
-            m_task->pixels.pop_back();
+            m_task->popLayer();
             return false;
         }
         m_src_prev = raw_frame;
 
         // convert pixel format if it is not supported by exr
         if ((fmt & fcPixelFormat_TypeMask) == fcPixelFormat_Type_u8) {
-            m_task->pixels.emplace_back(Buffer());
-            auto *buf = &m_task->pixels.back();
-
             int channels = fmt & fcPixelFormat_ChannelMask;
             auto src_fmt = fmt;
             fmt = fcPixelFormat(fcPixelFormat_Type_f16 | channels);
-            buf->resize(m_task->width * m_task->height * fcGetPixelSize(fmt));
+            auto *buf = m_task->allocLayer(m_task->width * m_task->height * fcGetPixelSize(fmt));
             fcConvertPixelFormat(&(*buf)[0], fmt, &(*raw_frame)[0], src_fmt, m_task->width * m_task->height);
 
             m_src_prev = raw_frame = buf;
@@ -164,13 +318,88 @@ bool fcExrContext::addLayerTexture(void *tex, fcPixelFormat fmt, int channel, co
     return addLayerImpl(&(*raw_frame)[0], fmt, channel, name);
 }
 
-bool fcExrContext::addLayerPixels(const void *pixels, fcPixelFormat fmt, int channel, const char *name)
+bool fcExrContext::addLayerPixels(const void *pixels, fcPixelFormat fmt, int channel, const char *name, int pitch)
 {
-    if (m_task == nullptr) {
+    if (!m_task) {
         fcDebugLog("fcExrContext::addLayerPixels(): maybe beginFrame() is not called.");
         return false;
     }
+    return addLayerPixelsImpl(pixels, fmt, pitch, channel, name, nullptr);
+}
+
+fcFrameBuffer fcExrContext::acquireLayer(fcPixelFormat fmt)
+{
+    fcFrameBuffer ret;
+    if (!m_task) {
+        fcDebugLog("fcExrContext::acquireLayer(): maybe beginFrame() is not called.");
+        return ret;
+    }
+
+    // layer buffers live in the task data. they are valid until endFrame().
+    auto *buf = m_task->allocLayer(m_task->width * m_task->height * fcGetPixelSize(fmt));
+
+    ret.pixels = buf->data();
+    ret.pitch = int(m_task->width * fcGetPixelSize(fmt));
+    ret.format = fmt;
+    ret.handle = buf;
+    return ret;
+}
+
+bool fcExrContext::submitLayer(fcFrameBuffer& frame, int channel, const char *name)
+{
+    if (!m_task) {
+        fcDebugLog("fcExrContext::submitLayer(): maybe beginFrame() is not called.");
+        return false;
+    }
+    if (!frame.handle) { return false; }
+    if (!m_task->hasLayer((Buffer*)frame.handle)) {
+        fcDebugLog("fcExrContext::submitLayer(): layer is not acquired in current frame.\n");
+        return false;
+    }
+
+    // unlike other contexts frame is not invalidated. the same layer can be submitted for each channel.
+    return addLayerPixelsImpl(frame.pixels, frame.format, frame.pitch, channel, name, (Buffer*)frame.handle);
+}
+
+void fcExrContext::releaseLayer(fcFrameBuffer& frame)
+{
+    if (!m_task || !frame.handle) { return; }
+
+    auto *buf = (Buffer*)frame.handle;
+    if (!m_task->hasLayer(buf)) {
+        fcDebugLog("fcExrContext::releaseLayer(): layer is not acquired in current frame.\n");
+        return;
+    }
+    frame = fcFrameBuffer();
+
+    // only the last layer can be given back right now. others are reclaimed by endFrame().
+    if (m_task->isLastLayer(buf) && !m_task->isLayerUsed(buf)) {
+        if (m_src_prev == buf) {
+            m_frame_prev = nullptr;
+            m_src_prev = nullptr;
+        }
+        m_task->popLayer();
+    }
+}
 
+fcPixelFormat fcExrContext::getLayerFormat(fcPixelFormat src_fmt) const
+{
+    int channels = src_fmt & fcPixelFormat_ChannelMask;
+    switch (m_conf.pixel_format) {
+    case fcExrPixelFormat::Half:  return fcPixelFormat(fcPixelFormat_Type_f16 | channels);
+    case fcExrPixelFormat::Float: return fcPixelFormat(fcPixelFormat_Type_f32 | channels);
+    case fcExrPixelFormat::Int:   return fcPixelFormat(fcPixelFormat_Type_i32 | channels);
+    default: // adaptive
+        // convert pixel format if it is not supported by exr
+        if ((src_fmt & fcPixelFormat_TypeMask) == fcPixelFormat_Type_u8) {
+            return fcPixelFormat(fcPixelFormat_Type_f16 | channels);
+        }
+        return src_fmt;
+    }
+}
+
+bool fcExrContext::addLayerPixelsImpl(const void *pixels, fcPixelFormat fmt, int pitch, int channel, const char *name, Buffer *owned)
+{
     Buffer *raw_frame = nullptr;
 
     if (pixels == m_frame_prev)
@@ -182,60 +411,15 @@ bool fcExrContext::addLayerPixels(const void *pixels, fcPixelFormat fmt, int cha
     {
         m_frame_prev = pixels;
 
-        m_task->pixels.emplace_back(Buffer());
-        raw_frame = &m_task->pixels.back();
-
-        if (m_conf.pixel_format == fcExrPixelFormat::Half) {
-            auto src_fmt = fmt;
-            int channels = fmt & fcPixelFormat_ChannelMask;
-            fmt = fcPixelFormat(fcPixelFormat_Type_f16 | channels);
-            raw_frame->resize(m_task->width * m_task->height * fcGetPixelSize(fmt));
-            if (src_fmt != fmt) {
-                fcConvertPixelFormat(raw_frame->data(), fmt, pixels, src_fmt, m_task->width * m_task->height);
-            }
-            else {
-                memcpy(raw_frame->data(), pixels, raw_frame->size());
-            }
-        }
-        else if (m_conf.pixel_format == fcExrPixelFormat::Float) {
-            auto src_fmt = fmt;
-            int channels = fmt & fcPixelFormat_ChannelMask;
-            fmt = fcPixelFormat(fcPixelFormat_Type_f32 | channels);
-            raw_frame->resize(m_task->width * m_task->height * fcGetPixelSize(fmt));
-            if (src_fmt != fmt) {
-                fcConvertPixelFormat(raw_frame->data(), fmt, pixels, src_fmt, m_task->width * m_task->height);
-            }
-            else {
-                memcpy(raw_frame->data(), pixels, raw_frame->size());
-            }
-
-        }
-        else if (m_conf.pixel_format == fcExrPixelFormat::Int) {
-            auto src_fmt = fmt;
-            int channels = fmt & fcPixelFormat_ChannelMask;
-            fmt = fcPixelFormat(fcPixelFormat_Type_i32 | channels);
-            raw_frame->resize(m_task->width * m_task->height * fcGetPixelSize(fmt));
-            if (src_fmt != fmt) {
-                fcConvertPixelFormat(raw_frame->data(), fmt, pixels, src_fmt, m_task->width * m_task->height);
-            }
-            else {
-                memcpy(raw_frame->data(), pixels, raw_frame->size());
-            }
-
+        auto src_fmt = fmt;
+        fmt = getLayerFormat(src_fmt);
+        if (owned && src_fmt == fmt && fcGetPitch(pitch, m_task->width, fmt) == m_task->width * fcGetPixelSize(fmt)) {
+            raw_frame = owned;
         }
-        else { // adaptive
-            // convert pixel format if it is not supported by exr
-            if ((fmt & fcPixelFormat_TypeMask) == fcPixelFormat_Type_u8) {
-                auto src_fmt = fmt;
-                int channels = fmt & fcPixelFormat_ChannelMask;
-                fmt = fcPixelFormat(fcPixelFormat_Type_f16 | channels);
-                raw_frame->resize(m_task->width * m_task->height * fcGetPixelSize(fmt));
-                fcConvertPixelFormat(raw_frame->data(), fmt, pixels, src_fmt, m_task->width * m_task->height);
-            }
-            else {
-                raw_frame->resize(m_task->width * m_task->height * fcGetPixelSize(fmt));
-                memcpy(raw_frame->data(), pixels, raw_frame->size());
-            }
+        else {
+            // conversion, copy and flip are done in one pass
+            raw_frame = m_task->allocLayer(m_task->width * m_task->height * fcGetPixelSize(fmt));
+            fcConvertPixelFormat2D(raw_frame->data(), fmt, 0, pixels, src_fmt, pitch, m_task->width, m_task->height);
         }
 
         m_src_prev = raw_frame;
@@ -278,34 +462,75 @@ bool fcExrContext::addLayerImpl(char *pixels, fcPixelFormat fmt, int channel, co
 
 bool fcExrContext::endFrame()
 {
-    if (m_task == nullptr) {
+    if (!m_task) {
         fcDebugLog("fcExrContext::endFrame(): maybe beginFrame() is not called.");
         return false;
     }
 
     m_frame_prev = nullptr;
 
-    fcExrTaskData *exr = m_task;
-    m_task = nullptr;
-    ++m_active_task_count;
-    m_tasks.run([this, exr](){
-        endFrameTask(exr);
-        --m_active_task_count;
+    // handed over as a handle so that only one holder owns the task data at a time
+    void *handle = m_task.detach();
+    m_tasks.run([this, handle](){
+        endFrameTask(m_task_data.attach(handle));
     });
     return true;
 }
 
-void fcExrContext::endFrameTask(fcExrTaskData *exr)
+void fcExrContext::endFrameTask(TaskData exr)
 {
+    bool ok = false;
     try {
-        Imf::OutputFile fout(exr->path.c_str(), exr->header);
-        fout.setFrameBuffer(exr->frame_buffer);
-        fout.writePixels(exr->height);
-        delete exr;
+        if (exr->stream || exr->packed) {
+            // the image is complete when OutputFile is destroyed
+            fcExrBufferOStream os(exr->encoded);
+            Imf::OutputFile fout(os, exr->header);
+            fout.setFrameBuffer(exr->frame_buffer);
+            fout.writePixels(exr->height);
+        }
+        else {
+            Imf::OutputFile fout(exr->path.c_str(), exr->header);
+            fout.setFrameBuffer(exr->frame_buffer);
+            fout.writePixels(exr->height);
+        }
+        ok = true;
+    }
+    catch (std::exception &e) {
+        // OpenEXR throws Iex::BaseExc, which is a std::exception
+        fcDebugLog("fcExrContext::endFrameTask(): %s\n", e.what());
     }
     catch (std::string &e) {
         fcDebugLog(e.c_str());
     }
+    catch (...) {
+        fcDebugLog("fcExrContext::endFrameTask(): unknown exception\n");
+    }
+
+    if (exr->stream || exr->packed) {
+        // encoded in parallel, written in order. the task data and the slot are held until the image is written.
+        auto seq = exr->seq;
+        void *handle = exr.detach();
+        m_stream_writes.run(seq, [this, handle, ok]() {
+            auto exr = m_task_data.attach(handle);
+            if (exr->packed) {
+                if (ok && !m_conf.image_pack->add(exr->path.c_str(), exr->encoded.data(), exr->encoded.size())) {
+                    fcDebugLog("fcExrContext: failed to add %s to the image pack\n", exr->path.c_str());
+                }
+            }
+            else {
+                if (ok) {
+                    exr->stream->write(exr->encoded.data(), exr->encoded.size());
+                }
+                exr->stream->release();
+            }
+            // back to the pool before the slot is released, otherwise the next frame would wait for it
+            exr.reset();
+            m_task_slots.release();
+        });
+        return;
+    }
+    exr.reset();
+    m_task_slots.release();
 }
 
 
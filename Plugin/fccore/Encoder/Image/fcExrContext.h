@@ -4,8 +4,18 @@ class fcIExrContext : public fcContextBase
 {
 public:
     virtual bool beginFrame(const char *path, int width, int height) = 0;
+    // non-blocking variant. return fcSubmitResult::Busy if max_tasks tasks are in flight.
+    virtual fcSubmitResult tryBeginFrame(const char *path, int width, int height) = 0;
+    // write the image into stream instead of a file. images are written in the order of the calls.
+    virtual bool beginFrameStream(fcStream *stream, int width, int height) = 0;
     virtual bool addLayerTexture(void *tex, fcPixelFormat fmt, int channel, const char *name) = 0;
-    virtual bool addLayerPixels(const void *pixels, fcPixelFormat fmt, int channel, const char *name) = 0;
+    // pitch: see fcGetPitch(). bottom-up images are flipped while pixels are converted / copied.
+    virtual bool addLayerPixels(const void *pixels, fcPixelFormat fmt, int channel, const char *name, int pitch = 0) = 0;
+    // zero-copy path: acquire a layer buffer in current frame, fill it and submit it for each channel.
+    // layer buffers are reclaimed by endFrame(). releaseLayer() gives back a layer that is not submitted before that.
+    virtual fcFrameBuffer acquireLayer(fcPixelFormat fmt) = 0;
+    virtual bool submitLayer(fcFrameBuffer& frame, int channel, const char *name) = 0;
+    virtual void releaseLayer(fcFrameBuffer& frame) = 0;
     virtual bool endFrame() = 0;
 };
 fcIExrContext* fcExrCreateContextImpl(const fcExrConfig *conf, fcIGraphicsDevice *dev);
@@ -29,6 +29,9 @@ public:
     void addOutputStream(fcStream *s) override;
     bool addFrameTexture(void *tex, fcPixelFormat fmt, fcTime timestamp) override;
     bool addFramePixels(const void *pixels, fcPixelFormat fmt, fcTime timestamp) override;
+    fcFrameBuffer acquireFrame(fcPixelFormat fmt) override;
+    bool submitFrame(fcFrameBuffer& frame, fcTime timestamp) override;
+    void releaseFrame(fcFrameBuffer& frame) override;
     void forceKeyframe() override;
 
 private:
@@ -45,10 +48,12 @@ private:
     std::vector<fcStream*> m_streams;
     std::vector<fcGifTaskData> m_buffers;
     std::vector<fcGifTaskData*> m_buffers_unused;
+    AcquiredHandles m_acquired_frames;
     std::list<fcGifFrame> m_gif_frames;
     jo_gif_t m_gif;
     TaskGroup m_tasks;
     std::mutex m_mutex;
+    std::condition_variable m_buffer_returned;
     int m_frame = 0;
     bool m_force_keyframe = false;
 };
@@ -90,21 +95,12 @@ void fcGifContext::addOutputStream(fcStream *os)
 
 fcGifTaskData& fcGifContext::getTempraryVideoFrame()
 {
-    fcGifTaskData *ret = nullptr;
-
     // wait if all temporaries are in use
-    for (;;) {
-        {
-            std::unique_lock<std::mutex> lock(m_mutex);
-            if (!m_buffers_unused.empty()) {
-                ret = m_buffers_unused.back();
-                m_buffers_unused.pop_back();
-                break;
-            }
-        }
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
-    }
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_buffer_returned.wait(lock, [this]() { return !m_buffers_unused.empty(); });
 
+    fcGifTaskData *ret = m_buffers_unused.back();
+    m_buffers_unused.pop_back();
     return *ret;
 }
 
@@ -112,6 +108,7 @@ void fcGifContext::returnTempraryVideoFrame(fcGifTaskData& v)
 {
     std::unique_lock<std::mutex> lock(m_mutex);
     m_buffers_unused.push_back(&v);
+    m_buffer_returned.notify_one();
 }
 
 void fcGifContext::addGifFrame(fcGifTaskData& data)
@@ -168,6 +165,7 @@ bool fcGifContext::addFrameTexture(void *tex, fcPixelFormat fmt, fcTime timestam
     data.raw_pixel_format = fmt;
     if (!m_dev->readTexture(&data.raw_pixels[0], data.raw_pixels.size(), tex, m_conf.width, m_conf.height, fmt))
     {
+        returnTempraryVideoFrame(data);
         return false;
     }
 
@@ -186,6 +184,49 @@ bool fcGifContext::addFramePixels(const void *pixels, fcPixelFormat fmt, fcTime
     return true;
 }
 
+fcFrameBuffer fcGifContext::acquireFrame(fcPixelFormat fmt)
+{
+    fcGifTaskData& data = getTempraryVideoFrame();
+    data.raw_pixel_format = fmt;
+    data.raw_pixels.resize(m_conf.width * m_conf.height * fcGetPixelSize(fmt));
+
+    fcFrameBuffer ret;
+    ret.pixels = data.raw_pixels.data();
+    ret.pitch = int(m_conf.width * fcGetPixelSize(fmt));
+    ret.format = fmt;
+    ret.handle = &data;
+    m_acquired_frames.add(ret.handle);
+    return ret;
+}
+
+bool fcGifContext::submitFrame(fcFrameBuffer& frame, fcTime timestamp)
+{
+    if (!frame.handle) { return false; }
+    if (!m_acquired_frames.take(frame.handle)) {
+        fcDebugLog("fcGifContext::submitFrame(): frame is not acquired from this context or already submitted.\n");
+        return false;
+    }
+
+    fcGifTaskData& data = *(fcGifTaskData*)frame.handle;
+    frame = fcFrameBuffer();
+    data.timestamp = timestamp >= 0.0 ? timestamp : GetCurrentTimeInSeconds();
+
+    kickTask(data);
+    return true;
+}
+
+void fcGifContext::releaseFrame(fcFrameBuffer& frame)
+{
+    if (!frame.handle) { return; }
+    if (!m_acquired_frames.take(frame.handle)) {
+        fcDebugLog("fcGifContext::releaseFrame(): frame is not acquired from this context or already submitted.\n");
+        return;
+    }
+
+    returnTempraryVideoFrame(*(fcGifTaskData*)frame.handle);
+    frame = fcFrameBuffer();
+}
+
 void fcGifContext::forceKeyframe()
 {
     m_force_keyframe = true;
@@ -6,6 +6,11 @@ public:
     virtual void addOutputStream(fcStream *s) = 0;
     virtual bool addFrameTexture(void *tex, fcPixelFormat fmt, fcTime timestamp = -1) = 0;
     virtual bool addFramePixels(const void *pixels, fcPixelFormat fmt, fcTime timestamp = -1) = 0;
+    // zero-copy path: acquire a frame, fill it and submit it.
+    // zero-copy path. a frame that is not submitted must be released by releaseFrame().
+    virtual fcFrameBuffer acquireFrame(fcPixelFormat fmt) = 0;
+    virtual bool submitFrame(fcFrameBuffer& frame, fcTime timestamp = -1) = 0;
+    virtual void releaseFrame(fcFrameBuffer& frame) = 0;
     virtual void forceKeyframe() = 0;
 };
 
@@ -3,25 +3,35 @@
 #include "Foundation/fcFoundation.h"
 #include "GraphicsDevice/fcGraphicsDevice.h"
 #include "fcPngContext.h"
+#include "fcPngEncoder.h"
 
-#include <png.h>
 #ifdef fcWindows
-    #pragma comment(lib, "libpng16_static.lib")
     #pragma comment(lib, "zlibstatic.lib")
 #endif
 
 
+// pooled. buffers keep their capacity across frames, so steady-state recording doesn't allocate.
 struct fcPngTaskData
 {
     std::string path;
+    fcStream *stream = nullptr; // written into stream instead of path if not null
+    bool packed = false;        // appended to fcPngConfig::image_pack with the file name of path
+    uint64_t seq = 0;           // order of writes to streams and packs
     Buffer pixels;
-    Buffer buf; // buffer for conversion
     int width = 0;
     int height = 0;
     fcPixelFormat format = fcPixelFormat_Unknown;
     int num_channels = 4;
 };
 
+// encoder state and buffers of a task. kept across frames so that deflate state and buffers are reused.
+struct fcPngWorker
+{
+    fcPngEncoder encoder;
+    Buffer converted;
+    Buffer encoded;
+};
+
 class fcPngContext : public fcIPngContext
 {
 public:
@@ -29,17 +39,40 @@ public:
     ~fcPngContext() override;
 
     bool exportTexture(const char *path, void *tex, int width, int height, fcPixelFormat fmt, int num_channels) override;
-    bool exportPixels(const char *path, const void *pixels, int width, int height, fcPixelFormat fmt, int num_channels) override;
+    bool exportPixels(const char *path, const void *pixels, int width, int height, fcPixelFormat fmt, int num_channels, int pitch) override;
+    fcSubmitResult tryExportTexture(const char *path, void *tex, int width, int height, fcPixelFormat fmt, int num_channels) override;
+    fcSubmitResult tryExportPixels(const char *path, const void *pixels, int width, int height, fcPixelFormat fmt, int num_channels, int pitch) override;
+    fcFrameBuffer acquireFrame(int width, int height, fcPixelFormat fmt) override;
+    bool submitFrame(fcFrameBuffer& frame, const char *path, int num_channels) override;
+    void releaseFrame(fcFrameBuffer& frame) override;
+    bool exportTextureToStream(fcStream *stream, void *tex, int width, int height, fcPixelFormat fmt, int num_channels) override;
+    bool exportPixelsToStream(fcStream *stream, const void *pixels, int width, int height, fcPixelFormat fmt, int num_channels, int pitch) override;
+    bool getBufferPoolStats(fcBufferPoolType type, fcBufferPoolStats& dst) override;
 
 private:
-    void waitSome();
-    bool exportTask(fcPngTaskData& data);
+    using TaskDataPool = ResourcePool<fcPngTaskData>;
+    using TaskData = TaskDataPool::ResourceHolder;
+    using Workers = ResourcePool<fcPngWorker>;
+
+    // these assume a task slot is already acquired. output goes to stream if it is not null, otherwise to path.
+    bool exportTextureImpl(const char *path, fcStream *stream, void *tex, int width, int height, fcPixelFormat fmt, int num_channels);
+    bool exportPixelsImpl(const char *path, fcStream *stream, const void *pixels, int width, int height, fcPixelFormat fmt, int num_channels, int pitch);
+    TaskData acquireTaskData(int width, int height, fcPixelFormat fmt, int num_channels);
+    void setOutput(fcPngTaskData& data, const char *path, fcStream *stream);
+    void kickTask(TaskData data);
+    // remove handle from the frames given out by acquireFrame(). false if it is not one of them.
+    bool exportTask(fcPngTaskData& data, fcPngWorker& worker);
 
 private:
     fcPngConfig m_conf;
+    fcPngEncoderConfig m_encoder_conf;
     fcIGraphicsDevice *m_dev = nullptr;
+    TaskDataPool m_task_data;
+    Workers m_workers;
     TaskGroup m_tasks;
-    std::atomic_int m_active_task_count = { 0 };
+    Semaphore m_task_slots;
+    OrderedTaskQueue m_stream_writes;
+    AcquiredHandles m_acquired_frames;
 };
 
 fcPngContext::fcPngContext(const fcPngConfig& conf, fcIGraphicsDevice *dev)
@@ -49,219 +82,296 @@ fcPngContext::fcPngContext(const fcPngConfig& conf, fcIGraphicsDevice *dev)
     if (m_conf.max_tasks <= 0) {
         m_conf.max_tasks = std::thread::hardware_concurrency();
     }
+    m_tasks.setMaxTasks(m_conf.max_tasks);
+    m_task_slots.reset(m_conf.max_tasks);
+    for (int i = 0; i < m_conf.max_tasks; ++i) {
+        m_task_data.emplace();
+        m_workers.emplace();
+    }
+    if (m_conf.path_policy) {
+        m_conf.path_policy->addRef();
+    }
+    if (m_conf.image_pack) {
+        m_conf.image_pack->addRef();
+    }
+
+    if (m_conf.preset == fcPngPreset::Fast) {
+        m_encoder_conf.level = 1;
+        m_encoder_conf.filter = fcPngFilter::Up;
+        m_encoder_conf.strategy = fcPngStrategy::Default;
+    }
+    else {
+        m_encoder_conf.level = m_conf.compression_level;
+        m_encoder_conf.filter = m_conf.filter;
+        m_encoder_conf.strategy = m_conf.strategy;
+    }
+    m_encoder_conf.parallel = m_conf.parallel_deflate;
 }
 
 fcPngContext::~fcPngContext()
 {
     m_tasks.wait();
+    m_stream_writes.wait();
+    if (m_conf.path_policy) {
+        m_conf.path_policy->release();
+    }
+    if (m_conf.image_pack) {
+        m_conf.image_pack->release();
+    }
+}
+
+bool fcPngContext::exportTexture(const char *path, void *tex, int width, int height, fcPixelFormat fmt, int num_channels)
+{
+    m_task_slots.acquire();
+    return exportTextureImpl(path, nullptr, tex, width, height, fmt, num_channels);
 }
 
-bool fcPngContext::exportTexture(const char *path_, void *tex, int width, int height, fcPixelFormat fmt, int num_channels)
+bool fcPngContext::exportPixels(const char *path, const void *pixels, int width, int height, fcPixelFormat fmt, int num_channels, int pitch)
+{
+    m_task_slots.acquire();
+    return exportPixelsImpl(path, nullptr, pixels, width, height, fmt, num_channels, pitch);
+}
+
+fcSubmitResult fcPngContext::tryExportTexture(const char *path, void *tex, int width, int height, fcPixelFormat fmt, int num_channels)
+{
+    if (!m_task_slots.tryAcquire()) { return fcSubmitResult::Busy; }
+    return exportTextureImpl(path, nullptr, tex, width, height, fmt, num_channels) ? fcSubmitResult::Succeeded : fcSubmitResult::Failed;
+}
+
+fcSubmitResult fcPngContext::tryExportPixels(const char *path, const void *pixels, int width, int height, fcPixelFormat fmt, int num_channels, int pitch)
+{
+    if (!m_task_slots.tryAcquire()) { return fcSubmitResult::Busy; }
+    return exportPixelsImpl(path, nullptr, pixels, width, height, fmt, num_channels, pitch) ? fcSubmitResult::Succeeded : fcSubmitResult::Failed;
+}
+
+bool fcPngContext::exportTextureToStream(fcStream *stream, void *tex, int width, int height, fcPixelFormat fmt, int num_channels)
+{
+    if (!stream) { return false; }
+    m_task_slots.acquire();
+    return exportTextureImpl(nullptr, stream, tex, width, height, fmt, num_channels);
+}
+
+bool fcPngContext::exportPixelsToStream(fcStream *stream, const void *pixels, int width, int height, fcPixelFormat fmt, int num_channels, int pitch)
+{
+    if (!stream) { return false; }
+    m_task_slots.acquire();
+    return exportPixelsImpl(nullptr, stream, pixels, width, height, fmt, num_channels, pitch);
+}
+
+bool fcPngContext::exportTextureImpl(const char *path_, fcStream *stream, void *tex, int width, int height, fcPixelFormat fmt, int num_channels)
 {
     if (m_dev == nullptr) {
         fcDebugLog("fcPngContext::exportTexture(): gfx device is null.");
+        m_task_slots.release();
         return false;
     }
-    waitSome();
 
-    auto data = new fcPngTaskData();
-    data->path = path_;
-    data->width = width;
-    data->height = height;
-    data->format = fmt;
-    data->num_channels = num_channels;
+    auto data = acquireTaskData(width, height, fmt, num_channels);
 
     // get surface data
-    data->pixels.resize(width * height * fcGetPixelSize(fmt));
     if (!m_dev->readTexture(&data->pixels[0], data->pixels.size(), tex, width, height, fmt)) {
-        delete data;
+        data.reset();
+        m_task_slots.release();
         return false;
     }
+    setOutput(*data, path_, stream);
 
-    // kick export task
-    ++m_active_task_count;
-    m_tasks.run([this, data]() {
-        exportTask(*data);
-        delete data;
-        --m_active_task_count;
-    });
+    kickTask(data);
+    return true;
+}
+
+bool fcPngContext::exportPixelsImpl(const char *path_, fcStream *stream, const void *pixels_, int width, int height, fcPixelFormat fmt, int num_channels, int pitch)
+{
+    auto data = acquireTaskData(width, height, fmt, num_channels);
+    setOutput(*data, path_, stream);
+    fcConvertPixelFormat2D(data->pixels.data(), fmt, 0, pixels_, fmt, pitch, width, height);
+
+    kickTask(data);
+    return true;
+}
 
-    return false;
+fcFrameBuffer fcPngContext::acquireFrame(int width, int height, fcPixelFormat fmt)
+{
+    // the slot is held until the submitted frame is written
+    m_task_slots.acquire();
+
+    auto data = acquireTaskData(width, height, fmt, 4);
+
+    fcFrameBuffer ret;
+    ret.pixels = data->pixels.data();
+    ret.pitch = int(width * fcGetPixelSize(fmt));
+    ret.format = fmt;
+    ret.handle = data.detach();
+    m_acquired_frames.add(ret.handle);
+    return ret;
 }
 
-bool fcPngContext::exportPixels(const char *path_, const void *pixels_, int width, int height, fcPixelFormat fmt, int num_channels)
+bool fcPngContext::submitFrame(fcFrameBuffer& frame, const char *path, int num_channels)
 {
-    waitSome();
+    if (!frame.handle) { return false; }
+    if (!m_acquired_frames.take(frame.handle)) {
+        fcDebugLog("fcPngContext::submitFrame(): frame is not acquired from this context or already submitted.\n");
+        return false;
+    }
+
+    auto data = m_task_data.attach(frame.handle);
+    frame = fcFrameBuffer();
+    setOutput(*data, path, nullptr);
+    data->num_channels = num_channels;
+
+    kickTask(data);
+    return true;
+}
+
+void fcPngContext::releaseFrame(fcFrameBuffer& frame)
+{
+    if (!frame.handle) { return; }
+    if (!m_acquired_frames.take(frame.handle)) {
+        fcDebugLog("fcPngContext::releaseFrame(): frame is not acquired from this context or already submitted.\n");
+        return;
+    }
 
-    auto data = new fcPngTaskData();
-    data->path = path_;
+    auto data = m_task_data.attach(frame.handle);
+    frame = fcFrameBuffer();
+    // back to the pool before the slot is released, otherwise the next frame would wait for it
+    data.reset();
+    m_task_slots.release();
+}
+
+bool fcPngContext::getBufferPoolStats(fcBufferPoolType type, fcBufferPoolStats& dst)
+{
+    if (type != fcBufferPoolType::Video) { return false; }
+    m_task_data.getStats(dst);
+    return true;
+}
+
+fcPngContext::TaskData fcPngContext::acquireTaskData(int width, int height, fcPixelFormat fmt, int num_channels)
+{
+    // a task slot is held, so this never waits
+    auto data = m_task_data.acquire();
+    data->path.clear();
+    data->stream = nullptr;
+    data->packed = false;
+    data->seq = 0;
     data->width = width;
     data->height = height;
     data->format = fmt;
     data->num_channels = num_channels;
-    data->pixels.assign((char*)pixels_, width * height * fcGetPixelSize(fmt));
-
-    // kick export task
-    ++m_active_task_count;
-    m_tasks.run([this, data]() {
-        exportTask(*data);
-        delete data;
-        --m_active_task_count;
-    });
-    return true;
+    data->pixels.resize(width * height * fcGetPixelSize(fmt));
+    return data;
 }
 
-void fcPngContext::waitSome()
+void fcPngContext::setOutput(fcPngTaskData& data, const char *path, fcStream *stream)
 {
-    if (m_active_task_count >= m_conf.max_tasks) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
-        if (m_active_task_count >= m_conf.max_tasks) {
-            m_tasks.wait();
-        }
+    if (stream) {
+        stream->addRef();
+        data.stream = stream;
+        data.seq = m_stream_writes.issue();
+    }
+    else if (m_conf.image_pack) {
+        data.path = path;
+        data.packed = true;
+        data.seq = m_stream_writes.issue();
+    }
+    else {
+        data.path = m_conf.path_policy ? m_conf.path_policy->resolve(path) : std::string(path);
     }
 }
 
-bool fcPngContext::exportTask(fcPngTaskData& data)
+void fcPngContext::kickTask(TaskData data)
 {
-    png_bytep pixels = (png_bytep)&data.pixels[0];
-
-    int npixels = data.width * data.height;
-    int bit_depth = 0;
-    int num_channels = 0;
-    int color_type = 0;
+    // pooled resources are handed over as handles so that only one holder owns them at a time.
+    // they must be back in the pools before the slot is released, otherwise the next task would wait for them.
+    void *handle = data.detach();
+    m_tasks.run([this, handle]() {
+        auto data = m_task_data.attach(handle);
+        // a task slot is held, so a worker is always available here
+        auto worker = m_workers.acquire();
+        bool ok = exportTask(*data, *worker);
+
+        if (data->stream || data->packed) {
+            // encoded in parallel, written in order. the worker and the slot are held until the image is written.
+            auto seq = data->seq;
+            void *data_handle = data.detach();
+            void *worker_handle = worker.detach();
+            m_stream_writes.run(seq, [this, data_handle, worker_handle, ok]() {
+                auto data = m_task_data.attach(data_handle);
+                auto worker = m_workers.attach(worker_handle);
+                if (data->packed) {
+                    if (ok && !m_conf.image_pack->add(data->path.c_str(), worker->encoded.data(), worker->encoded.size())) {
+                        fcDebugLog("fcPngContext: failed to add %s to the image pack\n", data->path.c_str());
+                    }
+                }
+                else {
+                    if (ok) {
+                        data->stream->write(worker->encoded.data(), worker->encoded.size());
+                    }
+                    data->stream->release();
+                }
+                data.reset();
+                worker.reset();
+                m_task_slots.release();
+            });
+            return;
+        }
+        data.reset();
+        worker.reset();
+        m_task_slots.release();
+    });
+}
 
+bool fcPngContext::exportTask(fcPngTaskData& data, fcPngWorker& worker)
+{
+    size_t npixels = (size_t)data.width * data.height;
     auto src_fmt = data.format;
-    auto dst_fmt = src_fmt;
-    {
-        // determine dst format
-        auto dst_ch = src_fmt & fcPixelFormat_ChannelMask;
-        if (data.num_channels > 0) { dst_ch = std::min<int>(dst_ch, data.num_channels); }
-        if (dst_ch == 2) { dst_ch = 3; } // force to be 3ch as png doesn't support 2ch image
 
-        if (m_conf.pixel_format == fcPngPixelFormat::UInt8) {
-            dst_fmt = fcPixelFormat(fcPixelFormat_Type_u8 | dst_ch);
-        }
-        else if (m_conf.pixel_format == fcPngPixelFormat::UInt16) {
-            dst_fmt = fcPixelFormat(fcPixelFormat_Type_i16 | dst_ch);
-        }
-        else { // adaptive
-            if ((src_fmt & fcPixelFormat_TypeMask) == fcPixelFormat_Type_u8) {
-                dst_fmt = fcPixelFormat(fcPixelFormat_Type_u8 | dst_ch);
-            }
-            else {
-                dst_fmt = fcPixelFormat(fcPixelFormat_Type_i16 | dst_ch);
-            }
-        }
+    // determine dst format
+    int num_channels = src_fmt & fcPixelFormat_ChannelMask;
+    if (data.num_channels > 0) { num_channels = std::min<int>(num_channels, data.num_channels); }
+    if (num_channels == 2) { num_channels = 3; } // force to be 3ch as 2ch png is gray + alpha
+
+    int bit_depth = 8;
+    if (m_conf.pixel_format == fcPngPixelFormat::UInt16 ||
+        (m_conf.pixel_format == fcPngPixelFormat::Auto && (src_fmt & fcPixelFormat_TypeMask) != fcPixelFormat_Type_u8))
+    {
+        bit_depth = 16;
     }
 
     // convert pixels (if needed)
-    switch (dst_fmt) {
-    case fcPixelFormat_RGBAu8:
-        if (dst_fmt != src_fmt) {
-            data.buf.resize(npixels * 4);
-            fcConvertPixelFormat(data.buf.data(), dst_fmt, pixels, src_fmt, npixels);
-            pixels = (png_bytep)data.buf.data();
+    const void *pixels = data.pixels.data();
+    if (bit_depth == 16) {
+        // png wants big-endian samples. the kernel stores them swapped so no extra pass is needed.
+        worker.converted.resize(npixels * num_channels * 2);
+        if (!fcConvertToU16BE((uint16_t*)worker.converted.data(), num_channels, pixels, src_fmt, npixels)) {
+            fcDebugLog("fcPngContext::exportTask(): unsupported pixel format");
+            return false;
         }
-        bit_depth = 8;
-        num_channels = 4;
-        color_type = PNG_COLOR_TYPE_RGB_ALPHA;
-        break;
-    case fcPixelFormat_RGBu8:
-        if (dst_fmt != src_fmt) {
-            data.buf.resize(npixels * 3);
-            fcConvertPixelFormat(data.buf.data(), dst_fmt, pixels, src_fmt, npixels);
-            pixels = (png_bytep)data.buf.data();
-        }
-        bit_depth = 8;
-        num_channels = 3;
-        color_type = PNG_COLOR_TYPE_RGB;
-        break;
-    case fcPixelFormat_Ru8:
-        if (dst_fmt != src_fmt) {
-            data.buf.resize(npixels * 1);
-            fcConvertPixelFormat(data.buf.data(), dst_fmt, pixels, src_fmt, npixels);
-            pixels = (png_bytep)data.buf.data();
-        }
-        bit_depth = 8;
-        num_channels = 1;
-        color_type = PNG_COLOR_TYPE_GRAY;
-        break;
-
-    case fcPixelFormat_RGBAi16:
-        if (dst_fmt != src_fmt) {
-            data.buf.resize(npixels * 8);
-            fcConvertPixelFormat(data.buf.data(), dst_fmt, pixels, src_fmt, npixels);
-            pixels = (png_bytep)data.buf.data();
-        }
-        bit_depth = 16;
-        num_channels = 4;
-        color_type = PNG_COLOR_TYPE_RGB_ALPHA;
-        break;
-    case fcPixelFormat_RGBi16:
-        if (dst_fmt != src_fmt) {
-            data.buf.resize(npixels * 6);
-            fcConvertPixelFormat(data.buf.data(), dst_fmt, pixels, src_fmt, npixels);
-            pixels = (png_bytep)data.buf.data();
-        }
-        bit_depth = 16;
-        num_channels = 3;
-        color_type = PNG_COLOR_TYPE_RGB;
-        break;
-    case fcPixelFormat_Ri16:
+        pixels = worker.converted.data();
+    }
+    else {
+        auto dst_fmt = fcPixelFormat(fcPixelFormat_Type_u8 | num_channels);
         if (dst_fmt != src_fmt) {
-            data.buf.resize(npixels * 2);
-            fcConvertPixelFormat(data.buf.data(), dst_fmt, pixels, src_fmt, npixels);
-            pixels = (png_bytep)data.buf.data();
+            worker.converted.resize(npixels * num_channels);
+            fcConvertPixelFormat(worker.converted.data(), dst_fmt, pixels, src_fmt, npixels);
+            pixels = worker.converted.data();
         }
-        bit_depth = 16;
-        num_channels = 1;
-        color_type = PNG_COLOR_TYPE_GRAY;
-        break;
-
-    default:
-        fcDebugLog("fcPngContext::exportPixelsBody(): unsupported pixel format");
-        return false;
     }
 
-    // export
-
-    png_structp png_ptr = ::png_create_write_struct(PNG_LIBPNG_VER_STRING, 0, 0, 0);
-    if (png_ptr == nullptr) {
-        fcDebugLog("fcPngContext::exportPixelsBody(): png_create_write_struct() returned nullptr");
-        return false;
-    }
-
-    png_infop info_ptr = ::png_create_info_struct(png_ptr);
-    if (info_ptr == nullptr) {
-        fcDebugLog("fcPngContext::exportPixelsBody(): png_create_info_struct() returned nullptr");
-        ::png_destroy_write_struct(&png_ptr, nullptr);
+    // encode & export
+    if (!worker.encoder.encode(worker.encoded, pixels, data.width, data.height, num_channels, bit_depth, m_encoder_conf)) {
+        fcDebugLog("fcPngContext::exportTask(): encode failed");
         return false;
     }
+    if (data.stream || data.packed) { return true; } // written by kickTask()
 
     FILE *ofile = ::fopen(data.path.c_str(), "wb");
     if (ofile == nullptr) {
-        fcDebugLog("fcPngContext::exportPixelsBody(): file open failed");
-        ::png_destroy_write_struct(&png_ptr, &info_ptr);
+        fcDebugLog("fcPngContext::exportTask(): file open failed");
         return false;
     }
-
-    ::png_init_io(png_ptr, ofile);
-    ::png_set_IHDR(png_ptr, info_ptr, data.width, data.height, bit_depth, color_type, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
-    ::png_write_info(png_ptr, info_ptr);
-
-    int pitch = data.width * (bit_depth / 8) * num_channels;
-    std::vector<png_bytep> row_pointers(data.height);
-    for (int yi = 0; yi <data.height; ++yi) {
-        row_pointers[yi] = &pixels[pitch * yi];
-    }
-
-    ::png_write_image(png_ptr, &row_pointers[0]);
-    ::png_write_end(png_ptr, info_ptr);
-
+    bool ret = ::fwrite(worker.encoded.data(), 1, worker.encoded.size(), ofile) == worker.encoded.size();
     ::fclose(ofile);
-    ::png_destroy_write_struct(&png_ptr, &info_ptr);
-
-    return true;
+    return ret;
 }
 
 fcIPngContext* fcPngCreateContextImpl(const fcPngConfig *conf, fcIGraphicsDevice *dev)
@@ -4,7 +4,18 @@ class fcIPngContext : public fcContextBase
 {
 public:
     virtual bool exportTexture(const char *path, void *tex, int width, int height, fcPixelFormat fmt, int num_channels) = 0;
-    virtual bool exportPixels(const char *path, const void *pixels, int width, int height, fcPixelFormat fmt, int num_channels) = 0;
+    // pitch: see fcGetPitch(). bottom-up images are flipped while pixels are copied.
+    virtual bool exportPixels(const char *path, const void *pixels, int width, int height, fcPixelFormat fmt, int num_channels, int pitch = 0) = 0;
+    // non-blocking variants. return fcSubmitResult::Busy if max_tasks tasks are in flight.
+    virtual fcSubmitResult tryExportTexture(const char *path, void *tex, int width, int height, fcPixelFormat fmt, int num_channels) = 0;
+    virtual fcSubmitResult tryExportPixels(const char *path, const void *pixels, int width, int height, fcPixelFormat fmt, int num_channels, int pitch = 0) = 0;
+    // zero-copy path: acquire a frame, fill it and submit it. a frame that is not submitted must be released by releaseFrame().
+    virtual fcFrameBuffer acquireFrame(int width, int height, fcPixelFormat fmt) = 0;
+    virtual bool submitFrame(fcFrameBuffer& frame, const char *path, int num_channels) = 0;
+    virtual void releaseFrame(fcFrameBuffer& frame) = 0;
+    // write the PNG into stream instead of a file. images are written in the order of the calls.
+    virtual bool exportTextureToStream(fcStream *stream, void *tex, int width, int height, fcPixelFormat fmt, int num_channels) = 0;
+    virtual bool exportPixelsToStream(fcStream *stream, const void *pixels, int width, int height, fcPixelFormat fmt, int num_channels, int pitch = 0) = 0;
 };
 
 fcIPngContext* fcPngCreateContextImpl(const fcPngConfig *conf, fcIGraphicsDevice *dev);
\ No newline at end of file
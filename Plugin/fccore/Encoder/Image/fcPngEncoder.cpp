@@ -0,0 +1,408 @@
+#include "pch.h"
+#include "fcInternal.h"
+#include "Foundation/fcFoundation.h"
+#include "fcPngEncoder.h"
+
+#ifdef fcSupportPNG
+#include <zlib.h>
+
+namespace {
+
+enum PngFilterType
+{
+    PngFilterType_None = 0,
+    PngFilterType_Sub = 1,
+    PngFilterType_Up = 2,
+    PngFilterType_Average = 3,
+    PngFilterType_Paeth = 4,
+    PngFilterType_Count = 5,
+};
+
+const uint8_t g_png_signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+// zlib takes 32 bit sizes. large buffers are processed piece by piece.
+const size_t g_max_zlib_chunk = 0x40000000;
+
+// bands smaller than this don't pay off the task overhead and the lost compression ratio
+const size_t g_min_band_size = 256 * 1024;
+
+// rows are filtered into a buffer of about this size and fed to deflate
+const size_t g_filter_chunk_size = 64 * 1024;
+
+// initial size of the compressed output of a band. it grows as needed
+const size_t g_min_out_size = 64 * 1024;
+
+inline void PutU32BE(uint8_t *dst, uint32_t v)
+{
+    dst[0] = (uint8_t)(v >> 24);
+    dst[1] = (uint8_t)(v >> 16);
+    dst[2] = (uint8_t)(v >> 8);
+    dst[3] = (uint8_t)(v);
+}
+
+uint32_t CRC32(uint32_t crc, const uint8_t *data, size_t size)
+{
+    for (size_t pos = 0; pos < size; ) {
+        uInt n = (uInt)std::min<size_t>(size - pos, g_max_zlib_chunk);
+        crc = (uint32_t)crc32(crc, data + pos, n);
+        pos += n;
+    }
+    return crc;
+}
+
+uint32_t Adler32(uint32_t adler, const uint8_t *data, size_t size)
+{
+    for (size_t pos = 0; pos < size; ) {
+        uInt n = (uInt)std::min<size_t>(size - pos, g_max_zlib_chunk);
+        adler = (uint32_t)adler32(adler, data + pos, n);
+        pos += n;
+    }
+    return adler;
+}
+
+// dst points to the chunk head. data of size bytes must be already at dst + 8. return the size of the chunk.
+size_t CloseChunk(uint8_t *dst, const char *type, size_t size)
+{
+    PutU32BE(dst, (uint32_t)size);
+    memcpy(dst + 4, type, 4);
+    PutU32BE(dst + 8 + size, CRC32(0, dst + 4, size + 4));
+    return size + 12;
+}
+
+inline uint8_t Paeth(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = std::abs(p - a);
+    int pb = std::abs(p - b);
+    int pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) { return (uint8_t)a; }
+    if (pb <= pc) { return (uint8_t)b; }
+    return (uint8_t)c;
+}
+
+void FilterRow(uint8_t *dst, const uint8_t *cur, const uint8_t *prev, size_t n, int bpp, int type)
+{
+    size_t i = 0;
+    switch (type) {
+    case PngFilterType_None:
+        memcpy(dst, cur, n);
+        break;
+    case PngFilterType_Sub:
+        for (; i < (size_t)bpp; ++i) { dst[i] = cur[i]; }
+        for (; i < n; ++i) { dst[i] = (uint8_t)(cur[i] - cur[i - bpp]); }
+        break;
+    case PngFilterType_Up:
+        for (; i < n; ++i) { dst[i] = (uint8_t)(cur[i] - prev[i]); }
+        break;
+    case PngFilterType_Average:
+        for (; i < (size_t)bpp; ++i) { dst[i] = (uint8_t)(cur[i] - (prev[i] >> 1)); }
+        for (; i < n; ++i) { dst[i] = (uint8_t)(cur[i] - ((cur[i - bpp] + prev[i]) >> 1)); }
+        break;
+    case PngFilterType_Paeth:
+        for (; i < (size_t)bpp; ++i) { dst[i] = (uint8_t)(cur[i] - prev[i]); }
+        for (; i < n; ++i) { dst[i] = (uint8_t)(cur[i] - Paeth(cur[i - bpp], prev[i], prev[i - bpp])); }
+        break;
+    }
+}
+
+// minimum sum of absolute differences heuristic. same as libpng's adaptive filtering.
+uint64_t FilterCost(const uint8_t *row, size_t n)
+{
+    uint64_t ret = 0;
+    for (size_t i = 0; i < n; ++i) {
+        ret += (uint64_t)std::abs((int)(int8_t)row[i]);
+    }
+    return ret;
+}
+
+// filter row y into line (filter type byte + filtered row). candidates: scratch of row_size * PngFilterType_Count for Adaptive.
+void FilterLine(uint8_t *line, const uint8_t *pixels, const uint8_t *zero_row, int y, size_t row_size, int bpp, fcPngFilter filter, uint8_t *candidates)
+{
+    const uint8_t *cur = pixels + row_size * y;
+    const uint8_t *prev = y > 0 ? cur - row_size : zero_row;
+
+    int type = PngFilterType_None;
+    switch (filter) {
+    case fcPngFilter::None: type = PngFilterType_None; break;
+    case fcPngFilter::Sub: type = PngFilterType_Sub; break;
+    case fcPngFilter::Up: type = PngFilterType_Up; break;
+    case fcPngFilter::Average: type = PngFilterType_Average; break;
+    case fcPngFilter::Paeth: type = PngFilterType_Paeth; break;
+    case fcPngFilter::Adaptive:
+    {
+        uint64_t best_cost = ~0ULL;
+        for (int t = 0; t < PngFilterType_Count; ++t) {
+            uint8_t *c = candidates + row_size * t;
+            FilterRow(c, cur, prev, row_size, bpp, t);
+            uint64_t cost = FilterCost(c, row_size);
+            if (cost < best_cost) {
+                best_cost = cost;
+                type = t;
+            }
+        }
+        line[0] = (uint8_t)type;
+        memcpy(line + 1, candidates + row_size * type, row_size);
+        return;
+    }
+    }
+    line[0] = (uint8_t)type;
+    FilterRow(line + 1, cur, prev, row_size, bpp, type);
+}
+
+// feed src to deflate and append the output to out from out_pos. out grows if it gets full.
+bool Deflate(z_stream *zs, Buffer& out, size_t& out_pos, const uint8_t *src, size_t src_size, int flush)
+{
+    for (;;) {
+        if (out_pos == out.size()) {
+            out.resize(out.size() * 2);
+        }
+        uInt in = (uInt)std::min<size_t>(src_size, g_max_zlib_chunk);
+        uInt avail_out = (uInt)std::min<size_t>(out.size() - out_pos, g_max_zlib_chunk);
+        zs->next_in = (Bytef*)src;
+        zs->avail_in = in;
+        zs->next_out = (Bytef*)out.data() + out_pos;
+        zs->avail_out = avail_out;
+        int ret = deflate(zs, in == src_size ? flush : Z_NO_FLUSH);
+        if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) { return false; }
+
+        size_t consumed = in - zs->avail_in;
+        src += consumed;
+        src_size -= consumed;
+        out_pos += avail_out - zs->avail_out;
+        if (ret == Z_STREAM_END) { return true; }
+        // no flush and sync flush are done when all input is consumed and output space is left
+        if (flush != Z_FINISH && src_size == 0 && zs->avail_out != 0) { return true; }
+    }
+}
+
+int GetZStrategy(fcPngStrategy v)
+{
+    switch (v) {
+    case fcPngStrategy::Filtered: return Z_FILTERED;
+    case fcPngStrategy::HuffmanOnly: return Z_HUFFMAN_ONLY;
+    case fcPngStrategy::RLE: return Z_RLE;
+    case fcPngStrategy::Fixed: return Z_FIXED;
+    default: return Z_DEFAULT_STRATEGY;
+    }
+}
+
+// Z_DEFAULT_COMPRESSION (-1) is level 6, same as zlib
+inline int ClampZLevel(int level)
+{
+    if (level == Z_DEFAULT_COMPRESSION) { return 6; }
+    return std::min<int>(std::max<int>(level, 0), 9);
+}
+
+// zlib stream header. same as what deflate() writes for the given level and strategy (see deflate.c).
+void PutZlibHeader(uint8_t *dst, int level, fcPngStrategy strategy)
+{
+    level = ClampZLevel(level);
+    int flevel = 0;
+    if (level < 2 || GetZStrategy(strategy) >= Z_HUFFMAN_ONLY) { flevel = 0; }
+    else if (level < 6) { flevel = 1; }
+    else if (level == 6) { flevel = 2; }
+    else { flevel = 3; }
+
+    int cmf = 0x78; // deflate, 32K window
+    int flg = flevel << 6;
+    flg += 31 - ((cmf << 8) + flg) % 31;
+    dst[0] = (uint8_t)cmf;
+    dst[1] = (uint8_t)flg;
+}
+
+} // namespace
+
+
+fcPngEncoder::fcPngEncoder()
+{
+}
+
+fcPngEncoder::~fcPngEncoder()
+{
+    for (auto& band : m_bands) {
+        if (band->zs) {
+            deflateEnd(band->zs);
+            delete band->zs;
+        }
+    }
+}
+
+int fcPngEncoder::getNumBands(size_t image_size, int height, const fcPngEncoderConfig& conf) const
+{
+    if (!conf.parallel) { return 1; }
+    size_t n = std::min<size_t>(image_size / g_min_band_size, (size_t)ThreadPool::getInstance().getNumThreads());
+    return (int)std::max<size_t>(std::min<size_t>(n, (size_t)height), 1);
+}
+
+bool fcPngEncoder::encodeBand(Band& band, const uint8_t *pixels, size_t row_size, int bpp, bool last, const fcPngEncoderConfig& conf)
+{
+    band.ok = false;
+    int begin = band.begin;
+    int end = band.begin + band.rows;
+
+    size_t line_size = row_size + 1;
+    auto *zero_row = (const uint8_t*)m_zero_row.data();
+    if (conf.filter == fcPngFilter::Adaptive) {
+        band.candidates.resize(row_size * PngFilterType_Count);
+    }
+    auto *candidates = (uint8_t*)band.candidates.data();
+
+    // the previous band may be still being filtered by another task. filter its last rows again for the dictionary.
+    size_t dict_size = 0;
+    if (begin > 0) {
+        int dict_rows = std::min<int>(begin, int((32768 + line_size - 1) / line_size));
+        band.dict.resize(line_size * dict_rows);
+        auto *dict = (uint8_t*)band.dict.data();
+        for (int i = 0; i < dict_rows; ++i) {
+            FilterLine(dict + line_size * i, pixels, zero_row, begin - dict_rows + i, row_size, bpp, conf.filter, candidates);
+        }
+        dict_size = std::min<size_t>(band.dict.size(), 32768);
+    }
+
+    // setup deflate. keep the allocated state and only rewind it if this band was used before.
+    int level = ClampZLevel(conf.level);
+    if (!band.zs) {
+        band.zs = new z_stream();
+        if (deflateInit2(band.zs, level, Z_DEFLATED, -15, 8, GetZStrategy(conf.strategy)) != Z_OK) {
+            delete band.zs;
+            band.zs = nullptr;
+            return false;
+        }
+        band.level = level;
+        band.strategy = conf.strategy;
+    }
+    else {
+        deflateReset(band.zs);
+        if (level != band.level || conf.strategy != band.strategy) {
+            if (deflateParams(band.zs, level, GetZStrategy(conf.strategy)) != Z_OK) { return false; }
+            band.level = level;
+            band.strategy = conf.strategy;
+        }
+    }
+    z_stream *zs = band.zs;
+    if (dict_size > 0) {
+        deflateSetDictionary(zs, (const Bytef*)band.dict.data() + band.dict.size() - dict_size, (uInt)dict_size);
+    }
+
+    // filter a chunk of rows and deflate it, until the end of the band
+    int chunk_rows = (int)std::max<size_t>(g_filter_chunk_size / line_size, 1);
+    band.filtered.resize(line_size * std::min<int>(chunk_rows, band.rows));
+    auto *filtered = (uint8_t*)band.filtered.data();
+    band.out.resize(std::max<size_t>(band.out.size(), g_min_out_size));
+    band.adler = 1;
+    size_t out_pos = 0;
+    for (int y = begin; y < end; ) {
+        int n = std::min<int>(chunk_rows, end - y);
+        for (int i = 0; i < n; ++i) {
+            FilterLine(filtered + line_size * i, pixels, zero_row, y + i, row_size, bpp, conf.filter, candidates);
+        }
+        y += n;
+
+        size_t src_size = line_size * n;
+        band.adler = Adler32(band.adler, filtered, src_size);
+        int flush = y < end ? Z_NO_FLUSH : (last ? Z_FINISH : Z_SYNC_FLUSH);
+        if (!Deflate(zs, band.out, out_pos, filtered, src_size, flush)) { return false; }
+    }
+    band.out.resize(out_pos);
+    band.crc = CRC32(0, (const uint8_t*)band.out.data(), band.out.size());
+    band.ok = true;
+    return true;
+}
+
+bool fcPngEncoder::encode(Buffer& dst, const void *pixels, int width, int height, int num_channels, int bit_depth, const fcPngEncoderConfig& conf)
+{
+    static const uint8_t color_types[] = { 0, 0, 4, 2, 6 };
+    if (width <= 0 || height <= 0 || num_channels < 1 || num_channels > 4 || (bit_depth != 8 && bit_depth != 16)) {
+        return false;
+    }
+
+    int bpp = num_channels * bit_depth / 8;
+    size_t row_size = (size_t)width * bpp;
+    m_zero_row.resize(row_size);
+    memset(m_zero_row.data(), 0, row_size);
+
+    int num_bands = getNumBands(row_size * height, height, conf);
+    while ((int)m_bands.size() < num_bands) {
+        m_bands.emplace_back(new Band());
+    }
+
+    // split rows evenly. num_bands <= height, so every band has at least one row.
+    for (int i = 0; i < num_bands; ++i) {
+        auto& band = *m_bands[i];
+        band.begin = int((int64_t)height * i / num_bands);
+        band.rows = int((int64_t)height * (i + 1) / num_bands) - band.begin;
+    }
+
+    // filter and deflate bands. filters only read source rows, so bands don't depend on each other.
+    auto *src = (const uint8_t*)pixels;
+    if (num_bands == 1) {
+        encodeBand(*m_bands[0], src, row_size, bpp, true, conf);
+    }
+    else {
+        ParallelFor(num_bands, 1, [&](int bi, int be) {
+            for (int i = bi; i < be; ++i) {
+                encodeBand(*m_bands[i], src, row_size, bpp, i == num_bands - 1, conf);
+            }
+        });
+    }
+
+    // concatenate. zlib header + bands + adler32 of the whole filtered data.
+    size_t idat_size = 2 + 4;
+    uint32_t adler = 1;
+    size_t line_size = row_size + 1;
+    for (int i = 0; i < num_bands; ++i) {
+        auto& band = *m_bands[i];
+        if (!band.ok) {
+            fcDebugLog("fcPngEncoder: deflate failed\n");
+            return false;
+        }
+        adler = (uint32_t)adler32_combine(adler, band.adler, (z_off_t)(line_size * band.rows));
+        idat_size += band.out.size();
+    }
+    if (idat_size > 0x7fffffff) {
+        fcDebugLog("fcPngEncoder: image is too large\n");
+        return false;
+    }
+
+    // signature + IHDR + IDAT + IEND
+    const size_t idat_pos = 8 + 25;
+    dst.resize(idat_pos + idat_size + 12 + 12);
+    auto *out = (uint8_t*)dst.data();
+
+    memcpy(out, g_png_signature, 8);
+    uint8_t *ihdr = out + 8;
+    PutU32BE(ihdr + 8, (uint32_t)width);
+    PutU32BE(ihdr + 12, (uint32_t)height);
+    ihdr[16] = (uint8_t)bit_depth;
+    ihdr[17] = color_types[num_channels];
+    ihdr[18] = 0; // compression: deflate
+    ihdr[19] = 0; // filter method 0
+    ihdr[20] = 0; // no interlace
+    CloseChunk(ihdr, "IHDR", 13);
+
+    // crc of IDAT is combined from the crc of each band instead of another pass over the compressed data
+    uint8_t *idat = out + idat_pos;
+    PutU32BE(idat, (uint32_t)idat_size);
+    memcpy(idat + 4, "IDAT", 4);
+    uint8_t *p = idat + 8;
+    PutZlibHeader(p, conf.level, conf.strategy);
+    uint32_t crc = CRC32(0, idat + 4, 6);
+    p += 2;
+    for (int i = 0; i < num_bands; ++i) {
+        auto& band = *m_bands[i];
+        memcpy(p, band.out.data(), band.out.size());
+        p += band.out.size();
+        crc = (uint32_t)crc32_combine(crc, band.crc, (z_off_t)band.out.size());
+    }
+    PutU32BE(p, adler);
+    crc = CRC32(crc, p, 4);
+    p += 4;
+    PutU32BE(p, crc);
+    p += 4;
+
+    p += CloseChunk(p, "IEND", 0);
+    dst.resize(p - out);
+    return true;
+}
+
+#endif // fcSupportPNG
@@ -0,0 +1,56 @@
+#pragma once
+
+struct z_stream_s;
+
+struct fcPngEncoderConfig
+{
+    int level = 6;              // zlib compression level. 0 - 9, or -1 for the default (6)
+    fcPngStrategy strategy = fcPngStrategy::Default;
+    fcPngFilter filter = fcPngFilter::Adaptive;
+    bool parallel = false;      // split large images into row bands and compress them on the thread pool
+};
+
+// writes PNG images into memory with zlib directly.
+// an encoder keeps its deflate state and row buffers, so reusing it across frames doesn't allocate once they are grown.
+// rows are filtered and deflated a chunk at a time. besides the compressed output, memory doesn't scale with the image.
+// not thread safe. use one encoder per worker.
+class fcPngEncoder
+{
+public:
+    fcPngEncoder();
+    ~fcPngEncoder();
+    fcPngEncoder(const fcPngEncoder&) = delete;
+    fcPngEncoder& operator=(const fcPngEncoder&) = delete;
+
+    // pixels: top row first, tightly packed. 16 bit samples must be big-endian (see fcConvertToU16BE()).
+    // num_channels: 1 (gray), 2 (gray + alpha), 3 (RGB) or 4 (RGBA). bit_depth: 8 or 16.
+    // dst is resized to the size of the PNG file.
+    bool encode(Buffer& dst, const void *pixels, int width, int height, int num_channels, int bit_depth, const fcPngEncoderConfig& conf);
+
+private:
+    // a range of rows filtered and deflated independently.
+    // bands are raw deflate streams that end with a sync flush (the last one with finish), so concatenating them
+    // forms one valid zlib stream (same as pigz). each band is primed with the tail of the previous band as dictionary.
+    struct Band
+    {
+        z_stream_s *zs = nullptr;
+        int level = -1;
+        fcPngStrategy strategy = fcPngStrategy::Default;
+        int begin = 0;          // first row
+        int rows = 0;           // number of rows. at least 1
+        Buffer candidates;      // rows filtered by each filter type for fcPngFilter::Adaptive
+        Buffer dict;            // filtered last rows of the previous band
+        Buffer filtered;        // filter type byte + filtered row, for a chunk of rows. this is the input of deflate.
+        Buffer out;             // grows on demand
+        uint32_t adler = 1;     // of the filtered rows
+        uint32_t crc = 0;       // of out
+        bool ok = false;
+    };
+    using BandPtr = std::unique_ptr<Band>;
+
+    int getNumBands(size_t image_size, int height, const fcPngEncoderConfig& conf) const;
+    bool encodeBand(Band& band, const uint8_t *pixels, size_t row_size, int bpp, bool last, const fcPngEncoderConfig& conf);
+
+    std::vector<BandPtr> m_bands;
+    Buffer m_zero_row;          // 'previous row' of the first row
+};
@@ -95,6 +95,8 @@ class fcIH264Encoder
 public:
     virtual ~fcIH264Encoder() {}
     virtual const char* getEncoderInfo() = 0;
+    // fcPixelFormat_I420 or fcPixelFormat_NV12. frames in this format are passed to encoder without conversion.
+    virtual fcPixelFormat getInputFormat() const = 0;
     virtual bool encode(fcH264Frame& dst, const void *image, fcPixelFormat fmt, fcTime timestamp, bool force_keyframe = false) = 0;
     virtual bool flush(fcH264Frame& dst) = 0;
 };
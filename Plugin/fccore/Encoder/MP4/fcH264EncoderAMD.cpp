@@ -16,6 +16,7 @@ public:
     fcH264EncoderAMD(const fcH264EncoderConfig& conf, void *device, fcHWEncoderDeviceType type);
     ~fcH264EncoderAMD() override;
     const char* getEncoderInfo() override;
+    fcPixelFormat getInputFormat() const override;
     bool encode(fcH264Frame& dst, const void *image, fcPixelFormat fmt, fcTime timestamp, bool force_keyframe) override;
     bool flush(fcH264Frame& dst) override;
 
@@ -94,6 +95,7 @@ fcH264EncoderAMD::~fcH264EncoderAMD()
 }
 
 const char* fcH264EncoderAMD::getEncoderInfo() { return "AMD H264 Encoder"; }
+fcPixelFormat fcH264EncoderAMD::getInputFormat() const { return fcPixelFormat_I420; }
 
 
 bool fcH264EncoderAMD::encode(fcH264Frame& dst, const void *image, fcPixelFormat fmt, fcTime timestamp, bool force_keyframe)
@@ -104,8 +106,8 @@ bool fcH264EncoderAMD::encode(fcH264Frame& dst, const void *image, fcPixelFormat
     I420Data i420 = m_i420_image.data();
 
     memcpy(m_surface->GetPlane(amf::AMF_PLANE_Y)->GetNative(), i420.y, i420.pitch_y * i420.height);
-    memcpy(m_surface->GetPlane(amf::AMF_PLANE_U)->GetNative(), i420.u, i420.pitch_u * i420.height);
-    memcpy(m_surface->GetPlane(amf::AMF_PLANE_V)->GetNative(), i420.v, i420.pitch_v * i420.height);
+    memcpy(m_surface->GetPlane(amf::AMF_PLANE_U)->GetNative(), i420.u, i420.pitch_u * ((i420.height + 1) / 2));
+    memcpy(m_surface->GetPlane(amf::AMF_PLANE_V)->GetNative(), i420.v, i420.pitch_v * ((i420.height + 1) / 2));
 
     m_encoder->SubmitInput(m_surface);
 
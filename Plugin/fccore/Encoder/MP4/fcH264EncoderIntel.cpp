@@ -21,6 +21,7 @@ public:
         mfxVersion *ver = nullptr, void *device = nullptr, fcHWEncoderDeviceType type = fcHWEncoderDeviceType::Unknown);
     ~fcH264EncoderIntel() override;
     const char* getEncoderInfo() override;
+    fcPixelFormat getInputFormat() const override;
     bool encode(fcH264Frame& dst, const void *image, fcPixelFormat fmt, fcTime timestamp, bool force_keyframe) override;
     bool flush(fcH264Frame& dst) override;
 
@@ -160,6 +161,7 @@ fcH264EncoderIntel::~fcH264EncoderIntel()
 }
 
 const char* fcH264EncoderIntel::getEncoderInfo() { return m_encoder_name; }
+fcPixelFormat fcH264EncoderIntel::getInputFormat() const { return fcPixelFormat_NV12; }
 
 #define MSDK_DEC_WAIT_INTERVAL 300000
 #define MSDK_ENC_WAIT_INTERVAL 300000
@@ -177,6 +179,13 @@ bool fcH264EncoderIntel::encode(fcH264Frame& dst, const void *image, fcPixelForm
     // convert image to NV12
     AnyToNV12(tu.image_nv12, tu.image_rgba, image, fmt, m_conf.width, m_conf.height);
     NV12Data data = tu.image_nv12.data();
+    if (fmt == fcPixelFormat_NV12) {
+        // image_nv12 just refers the input. the surface has its own memory.
+        tu.image_nv12.resize(m_conf.width, m_conf.height);
+        auto& sdata = tu.image_nv12.data();
+        memcpy(sdata.y, data.y, tu.image_nv12.size());
+        data = sdata;
+    }
 
 
     dst.timestamp = timestamp;
@@ -24,6 +24,7 @@ public:
     fcH264EncoderNVIDIA(const fcH264EncoderConfig& conf, void *device, fcHWEncoderDeviceType type);
     ~fcH264EncoderNVIDIA() override;
     const char* getEncoderInfo() override;
+    fcPixelFormat getInputFormat() const override;
     bool encode(fcH264Frame& dst, const void *image, fcPixelFormat fmt, fcTime timestamp, bool force_keyframe) override;
     bool flush(fcH264Frame& dst) override;
 
@@ -177,6 +178,7 @@ bool fcH264EncoderNVIDIA::isValid() const
 }
 
 const char* fcH264EncoderNVIDIA::getEncoderInfo() { return "NVIDIA H264 Encoder"; }
+fcPixelFormat fcH264EncoderNVIDIA::getInputFormat() const { return fcPixelFormat_NV12; }
 
 bool fcH264EncoderNVIDIA::encode(fcH264Frame& dst, const void *image, fcPixelFormat fmt, fcTime timestamp, bool force_keyframe)
 {
@@ -196,7 +198,11 @@ bool fcH264EncoderNVIDIA::encode(fcH264Frame& dst, const void *image, fcPixelFor
         lock_params.version = NV_ENC_LOCK_INPUT_BUFFER_VER;
         lock_params.inputBuffer = m_input.inputBuffer;
         stat = nvenc.nvEncLockInputBuffer(m_encoder, &lock_params);
-        memcpy(lock_params.bufferDataPtr, data.y, m_nv12_image.size());
+        // m_nv12_image may just refer the input (NV12 frames), so copy each plane at its real size.
+        size_t y_size = (size_t)m_conf.width * m_conf.height;
+        size_t uv_size = (size_t)data.pitch_uv * ((m_conf.height + 1) / 2);
+        memcpy(lock_params.bufferDataPtr, data.y, y_size);
+        memcpy((uint8_t*)lock_params.bufferDataPtr + y_size, data.uv, uv_size);
         stat = nvenc.nvEncUnlockInputBuffer(m_encoder, m_input.inputBuffer);
     }
 
@@ -30,6 +30,7 @@ public:
     fcH264EncoderOpenH264(const fcH264EncoderConfig& conf);
     ~fcH264EncoderOpenH264() override;
     const char* getEncoderInfo() override;
+    fcPixelFormat getInputFormat() const override;
     bool encode(fcH264Frame& dst, const void *image, fcPixelFormat fmt, fcTime timestamp, bool force_keyframe) override;
     bool flush(fcH264Frame& dst) override;
 
@@ -112,6 +113,11 @@ const char* fcH264EncoderOpenH264::getEncoderInfo()
     return "OpenH264 Video Codec provided by Cisco Systems, Inc.";
 }
 
+fcPixelFormat fcH264EncoderOpenH264::getInputFormat() const
+{
+    return fcPixelFormat_I420;
+}
+
 bool fcH264EncoderOpenH264::encode(fcH264Frame& dst, const void *image, fcPixelFormat fmt, fcTime timestamp, bool /*force_keyframe*/)
 {
     if (!m_encoder) { return false; }
@@ -129,9 +135,9 @@ bool fcH264EncoderOpenH264::encode(fcH264Frame& dst, const void *image, fcPixelF
     src.pData[0] = (unsigned char*)i420.y;
     src.pData[1] = (unsigned char*)i420.u;
     src.pData[2] = (unsigned char*)i420.v;
-    src.iStride[0] = m_conf.width;
-    src.iStride[1] = m_conf.width >> 1;
-    src.iStride[2] = m_conf.width >> 1;
+    src.iStride[0] = i420.pitch_y;
+    src.iStride[1] = i420.pitch_u;
+    src.iStride[2] = i420.pitch_v;
     src.uiTimeStamp = to_msec(dst.timestamp);
 
     SFrameBSInfo frame;
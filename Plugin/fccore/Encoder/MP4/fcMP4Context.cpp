@@ -20,23 +20,41 @@ public:
     using WriterPtrs        = std::vector<WriterPtr>;
 
     using VideoBuffer       = Buffer;
-    using VideoBuffers      = SharedResources<VideoBuffer>;
+    using VideoBuffers      = ResourcePool<VideoBuffer>;
+
+    // a frame moving through convert -> encode -> mux
+    struct VideoFrame
+    {
+        YUVImage image;
+        fcH264Frame encoded;
+        fcTime timestamp = 0.0;
+    };
+    using VideoFrames       = ResourcePool<VideoFrame>;
+    using VideoFramePtr     = VideoFrames::ResourceHolder;
 
     using AudioBuffer       = RawVector<float>;
-    using AudioBuffers      = SharedResources<AudioBuffer>;
+    using AudioBuffers      = ResourcePool<AudioBuffer>;
 
 
     fcMP4Context(fcMP4Config &conf, fcIGraphicsDevice *dev);
     ~fcMP4Context();
     bool isValid() const override;
+    bool getBufferPoolStats(fcBufferPoolType type, fcBufferPoolStats& dst) override;
 
     const char* getVideoEncoderInfo() override;
     const char* getAudioEncoderInfo() override;
 
     void addOutputStream(fcStream *s) override;
     bool addVideoFrameTexture(void *tex, fcPixelFormat fmt, fcTime timestamp) override;
-    bool addVideoFramePixels(const void *pixels, fcPixelFormat fmt, fcTime timestamps) override;
-    bool addVideoFramePixelsImpl(const void *pixels, fcPixelFormat fmt, fcTime timestamps);
+    fcFrameBuffer acquireVideoFrame(fcPixelFormat fmt) override;
+    bool submitVideoFrame(fcFrameBuffer& frame, fcTime timestamp) override;
+    void releaseVideoFrame(fcFrameBuffer& frame) override;
+    bool addVideoFramePixels(const void *pixels, fcPixelFormat fmt, fcTime timestamp, int pitch) override;
+    bool addVideoFramePixelsBorrowed(const void *pixels, fcPixelFormat fmt, fcTime timestamp, const std::function<void()>& release, int pitch) override;
+    // release is called when pixels are no longer needed
+    void kickVideoFrame(const void *pixels, fcPixelFormat fmt, int pitch, fcTime timestamp, const std::function<void()>& release);
+    void encodeVideoFrame(VideoFramePtr& frame);
+    void muxVideoFrame(VideoFramePtr& frame);
     void flushVideo();
 
     bool addAudioSamples(const float *samples, int num_samples) override;
@@ -57,10 +75,14 @@ private:
 
     WriterPtrs          m_writers;
 
-    TaskQueue           m_video_tasks;
+    TaskGroup           m_convert_tasks;
+    OrderedTaskQueue    m_video_tasks;
+    TaskQueue           m_mux_tasks;
     VideoEncoderPtr     m_video_encoder;
     VideoBuffers        m_video_buffers;
-    fcH264Frame         m_video_frame;
+    VideoFrames         m_video_frames;
+    AcquiredHandles     m_acquired_frames;
+    YUVConvertOptions   m_yuv_options;
 
     TaskQueue           m_audio_tasks;
     AudioEncoderPtr     m_audio_encoder;
@@ -142,9 +164,21 @@ fcMP4Context::fcMP4Context(fcMP4Config &conf, fcIGraphicsDevice *dev)
 
         if (enc) {
             m_video_encoder.reset(enc);
+
+            // pre-allocate for RGBA8 frames. buffers grow once if wider pixel formats come.
+            size_t frame_size = m_conf.video_width * m_conf.video_height * fcGetPixelSize(fcPixelFormat_RGBAu8);
             for (int i = 0; i < m_conf.video_max_tasks; ++i) {
-                m_video_buffers.emplace();
+                m_video_buffers.emplace(frame_size);
             }
+
+            // video_max_tasks frames can be converted in parallel while one is encoded and one is muxed
+            m_convert_tasks.setMaxTasks(m_conf.video_max_tasks);
+            for (int i = 0; i < m_conf.video_max_tasks + 2; ++i) {
+                m_video_frames.emplace();
+            }
+            m_yuv_options.linear_to_srgb = m_conf.video_linear_to_srgb;
+            m_yuv_options.matrix = m_conf.video_color_matrix;
+            m_yuv_options.range = m_conf.video_color_range;
         }
     }
 
@@ -178,7 +212,9 @@ fcMP4Context::~fcMP4Context()
 {
     flushVideo();
     flushAudio();
+    m_convert_tasks.wait();
     m_video_tasks.wait();
+    m_mux_tasks.wait();
     m_audio_tasks.wait();
 
     std::this_thread::sleep_for(std::chrono::milliseconds(100));
@@ -199,6 +235,15 @@ bool fcMP4Context::isValid() const
     return m_video_encoder || m_audio_encoder;
 }
 
+bool fcMP4Context::getBufferPoolStats(fcBufferPoolType type, fcBufferPoolStats& dst)
+{
+    switch (type) {
+    case fcBufferPoolType::Video: m_video_buffers.getStats(dst); return m_video_buffers.getCapacity() > 0;
+    case fcBufferPoolType::Audio: m_audio_buffers.getStats(dst); return m_audio_buffers.getCapacity() > 0;
+    }
+    return false;
+}
+
 const char* fcMP4Context::getAudioEncoderInfo()
 {
     if (!m_audio_encoder) { return ""; }
@@ -229,9 +274,7 @@ bool fcMP4Context::addVideoFrameTexture(void *tex, fcPixelFormat fmt, fcTime tim
     size_t size = m_conf.video_width * m_conf.video_height * psize;
     buf->resize(size);
     if (m_dev->readTexture(buf->data(), buf->size(), tex, m_conf.video_width, m_conf.video_height, fmt)) {
-        m_video_tasks.run([this, buf, fmt, timestamp]() {
-            addVideoFramePixelsImpl(buf->data(), fmt, timestamp);
-        });
+        kickVideoFrame(buf->data(), fmt, 0, timestamp, [buf]() mutable { buf.reset(); });
     }
     else {
         return false;
@@ -239,7 +282,53 @@ bool fcMP4Context::addVideoFrameTexture(void *tex, fcPixelFormat fmt, fcTime tim
     return true;
 }
 
-bool fcMP4Context::addVideoFramePixels(const void *pixels, fcPixelFormat fmt, fcTime timestamp)
+fcFrameBuffer fcMP4Context::acquireVideoFrame(fcPixelFormat fmt)
+{
+    fcFrameBuffer ret;
+    if (!m_video_encoder) { return ret; }
+
+    auto buf = m_video_buffers.acquire();
+    size_t psize = fcGetPixelSize(fmt);
+    buf->resize(m_conf.video_width * m_conf.video_height * psize);
+
+    ret.pixels = buf->data();
+    ret.pitch = int(m_conf.video_width * psize);
+    ret.format = fmt;
+    ret.handle = buf.detach();
+    m_acquired_frames.add(ret.handle);
+    return ret;
+}
+
+bool fcMP4Context::submitVideoFrame(fcFrameBuffer& frame, fcTime timestamp)
+{
+    if (!frame.handle || !m_video_encoder) { return false; }
+    if (!m_acquired_frames.take(frame.handle)) {
+        fcDebugLog("fcMP4Context::submitVideoFrame(): frame is not acquired from this context or already submitted.\n");
+        return false;
+    }
+
+    auto buf = m_video_buffers.attach(frame.handle);
+    auto fmt = frame.format;
+    frame = fcFrameBuffer();
+
+    kickVideoFrame(buf->data(), fmt, 0, timestamp, [buf]() mutable { buf.reset(); });
+    return true;
+}
+
+void fcMP4Context::releaseVideoFrame(fcFrameBuffer& frame)
+{
+    if (!frame.handle) { return; }
+    if (!m_acquired_frames.take(frame.handle)) {
+        fcDebugLog("fcMP4Context::releaseVideoFrame(): frame is not acquired from this context or already submitted.\n");
+        return;
+    }
+
+    // back to the pool when the holder is gone
+    m_video_buffers.attach(frame.handle);
+    frame = fcFrameBuffer();
+}
+
+bool fcMP4Context::addVideoFramePixels(const void *pixels, fcPixelFormat fmt, fcTime timestamp, int pitch)
 {
     if (!pixels || !m_video_encoder) { return false; }
 
@@ -247,39 +336,79 @@ bool fcMP4Context::addVideoFramePixels(const void *pixels, fcPixelFormat fmt, fc
     size_t psize = fcGetPixelSize(fmt);
     size_t size = m_conf.video_width * m_conf.video_height * psize;
     buf->resize(size);
-    memcpy(buf->data(), pixels, size);
+    // bottom-up images are flipped here while copying
+    fcConvertPixelFormat2D(buf->data(), fmt, 0, pixels, fmt, pitch, m_conf.video_width, m_conf.video_height);
+
+    kickVideoFrame(buf->data(), fmt, 0, timestamp, [buf]() mutable { buf.reset(); });
+    return true;
 
-    m_video_tasks.run([this, buf, fmt, timestamp]() {
-        addVideoFramePixelsImpl(buf->data(), fmt, timestamp);
+}
+
+bool fcMP4Context::addVideoFramePixelsBorrowed(const void *pixels, fcPixelFormat fmt, fcTime timestamp, const std::function<void()>& release, int pitch)
+{
+    if (!pixels || !m_video_encoder) { return false; }
+
+    // borrowed frames count against the same video_max_tasks budget as copied ones. the buffer itself is not used.
+    auto slot = m_video_buffers.acquire();
+    // converter is the last consumer of raw pixels. encoder and writers only get converted / encoded data.
+    kickVideoFrame(pixels, fmt, pitch, timestamp, [slot, release]() mutable {
+        if (release) { release(); }
+        slot.reset();
     });
     return true;
+}
 
+void fcMP4Context::kickVideoFrame(const void *pixels, fcPixelFormat fmt, int pitch, fcTime timestamp, const std::function<void()>& release)
+{
+    // convert -> encode -> mux.
+    // frames are converted in parallel, encoded in submission order and muxed on another strand.
+    // so conversion of a frame overlaps encoding of the previous one and muxing of the one before that.
+    // number of frames in the pipeline is bounded by m_video_frames.
+    auto frame = m_video_frames.acquire();
+    auto seq = m_video_tasks.issue();
+    m_convert_tasks.run([this, frame, pixels, fmt, pitch, timestamp, release, seq]() mutable {
+        frame->timestamp = timestamp;
+        frame->image.convert(pixels, fmt, m_video_encoder->getInputFormat(), m_conf.video_width, m_conf.video_height, pitch, m_yuv_options);
+        if (release) { release(); }
+
+        m_video_tasks.run(seq, [this, frame]() mutable {
+            encodeVideoFrame(frame);
+        });
+    });
 }
 
-bool fcMP4Context::addVideoFramePixelsImpl(const void *pixels, fcPixelFormat fmt, fcTime timestamp)
+void fcMP4Context::encodeVideoFrame(VideoFramePtr& frame)
 {
-    // encode!
-    if (m_video_encoder->encode(m_video_frame, pixels, fmt, timestamp)) {
-        eachStreams([this](fcMP4Writer& s) { s.addVideoFrame(m_video_frame); });
+    frame->encoded.clear();
+    if (!frame->image.data()) { return; }
+
+    if (m_video_encoder->encode(frame->encoded, frame->image.data(), frame->image.format(), frame->timestamp)) {
+        m_mux_tasks.run([this, frame]() mutable {
+            muxVideoFrame(frame);
+        });
+    }
+}
+
+void fcMP4Context::muxVideoFrame(VideoFramePtr& frame)
+{
+    eachStreams([&](fcMP4Writer& s) { s.addVideoFrame(frame->encoded); });
 #ifndef fcMaster
-        m_dbg_h264_out->write(m_video_frame.data.data(), m_video_frame.data.size());
+    m_dbg_h264_out->write(frame->encoded.data.data(), frame->encoded.data.size());
 #endif // fcMaster
-        m_video_frame.clear();
-        return true;
-    }
-    return false;
+    frame->encoded.clear();
 }
 
 void fcMP4Context::flushVideo()
 {
     if (!m_video_encoder) { return; }
 
-    m_video_tasks.run([this]() {
-        if (m_video_encoder->flush(m_video_frame)) {
-            eachStreams([&](fcMP4Writer& writer) {
-                writer.addVideoFrame(m_video_frame);
+    auto frame = m_video_frames.acquire();
+    m_video_tasks.run(m_video_tasks.issue(), [this, frame]() mutable {
+        frame->encoded.clear();
+        if (m_video_encoder->flush(frame->encoded)) {
+            m_mux_tasks.run([this, frame]() mutable {
+                muxVideoFrame(frame);
             });
-            m_video_frame.clear();
         }
     });
 }
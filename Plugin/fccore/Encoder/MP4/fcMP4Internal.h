@@ -6,6 +6,7 @@ struct fcMP4FrameInfo
     size_t size = 0;
     uint64_t file_offset = 0;
     uint64_t timestamp = 0;
+    bool keyframe = false;
 };
 
 struct fcMP4OffsetValue
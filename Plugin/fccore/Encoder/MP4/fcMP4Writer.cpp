@@ -42,6 +42,16 @@ time_t fcGetMacTime()
     return time(0) + 2082844800;
 }
 
+// usec -> time scale units (rounded)
+u64 fcToTimeScale(u64 usec, u32 scale)
+{
+    return (usec * scale + 500000) / 1000000;
+}
+
+const u32 fcMP4TimeScale = 1000000; // usec
+const u32 fcAACFrameSize = 1024;    // samples per AAC packet
+const u64 fcMaxAudioOnlyFragment = 1000000; // in usec
+
 } // namespace
 
 
@@ -50,12 +60,17 @@ fcMP4Writer::fcMP4Writer(BinaryStream *stream, const fcMP4Config &conf)
     , m_conf(conf)
 {
     m_stream->addRef();
+    // sockets and pipes can't be back-patched. write fragmented mp4 instead.
+    m_fragmented = !m_stream->isSeekable();
+    m_last_video_duration = fcMP4TimeScale / std::max<int>(m_conf.video_target_framerate, 1);
+    m_last_audio_duration = fcAACFrameSize;
     mp4Begin();
 }
 
 fcMP4Writer::~fcMP4Writer()
 {
     mp4End();
+    m_stream->flush();
     m_stream->release();
 }
 
@@ -71,6 +86,7 @@ void fcMP4Writer::mp4Begin()
         << u32_be(0x8)
         << u32_be('free');
 
+    if (m_fragmented) { return; }
     m_mdat_begin = os.tellp();
 
     os  << u32_be(0x1) // 32bit mdat length
@@ -90,11 +106,27 @@ void fcMP4Writer::addVideoFrame(const fcH264Frame& frame)
     fcMP4FrameInfo info;
     info.file_offset = os.tellp();
     info.timestamp = to_usec(frame.timestamp);
+    info.keyframe = (frame.type & fcH264FrameType_I) != 0;
 
-    if ((frame.type & fcH264FrameType_I) != 0) {
+    if (m_fragmented) {
+        // each fragment starts with a key frame
+        if (info.keyframe && !m_video_frame_info.empty()) {
+            flushFragment(info.timestamp);
+        }
+        if (!m_has_video_base) {
+            m_video_base_time = info.timestamp;
+            m_has_video_base = true;
+        }
+        info.file_offset = m_fragment_video.size();
+    }
+    else if (info.keyframe) {
         m_iframe_ids.push_back((uint32_t)m_video_frame_info.size() + 1);
     }
 
+    // gather length prefixes and NALs and hand them to the stream at once.
+    // resize(0) keeps the capacity for the next frame. RawVector::clear() frees it.
+    m_nal_lengths.resize(0);
+    m_spans.resize(0);
     frame.eachNALs([&](const char *data, int size) {
         const int offset = 4; // 0x00000001
         size -= offset;
@@ -107,12 +139,28 @@ void fcMP4Writer::addVideoFrame(const fcH264Frame& frame)
             m_pps.assign(&data[offset], &data[offset] + size);
         }
         else {
-            os << u32_be(size);
-            os.write(&data[offset], size);
+            m_nal_lengths.push_back(u32_be(size));
+            fcWriteSpan span;
+            span.data = &data[offset];
+            span.size = size;
+            m_spans.push_back(span); // prefix is filled below. m_nal_lengths may be reallocated until then.
+            m_spans.push_back(span);
             info.size += size + 4;
         }
 
     });
+    for (size_t i = 0; i < m_nal_lengths.size(); ++i) {
+        m_spans[i * 2].data = &m_nal_lengths[i];
+        m_spans[i * 2].size = 4;
+    }
+    if (m_fragmented) {
+        for (auto& span : m_spans) {
+            m_fragment_video.append((const char*)span.data, span.size);
+        }
+    }
+    else if (!m_spans.empty()) {
+        os.writev(m_spans.data(), (int)m_spans.size());
+    }
 
     m_video_frame_info.push_back(info);
 }
@@ -123,18 +171,43 @@ void fcMP4Writer::AddAudioSamples(const fcAACFrame& frame)
     std::unique_lock<std::mutex> lock(m_mutex);
 
     BinaryStream& os = *m_stream;
+    size_t pos = m_fragmented ? m_fragment_audio.size() : os.tellp();
+    m_spans.resize(0);
     frame.eachPackets([&](const char *data, const fcAACFrame::PacketInfo& pinfo) {
         fcMP4FrameInfo info;
-        info.file_offset = os.tellp();
+        info.file_offset = pos;
         info.timestamp = to_usec(pinfo.timestamp);
 
         const int offset = 7;
         int size = pinfo.size - offset;
-        os.write(data + offset, size);
+        fcWriteSpan span;
+        span.data = data + offset;
+        span.size = size;
+        m_spans.push_back(span);
         info.size += size;
+        pos += size;
 
         m_audio_frame_info.push_back(info);
     });
+
+    if (m_fragmented) {
+        if (!m_has_audio_base && !m_audio_frame_info.empty()) {
+            m_audio_base_time = m_audio_frame_info.front().timestamp;
+            m_has_audio_base = true;
+        }
+        for (auto& span : m_spans) {
+            m_fragment_audio.append((const char*)span.data, span.size);
+        }
+        // without video, fragments are cut by duration
+        if (!m_conf.video && !m_audio_frame_info.empty() &&
+            m_audio_frame_info.back().timestamp - m_audio_frame_info.front().timestamp >= fcMaxAudioOnlyFragment)
+        {
+            flushFragment(0);
+        }
+    }
+    else if (!m_spans.empty()) {
+        os.writev(m_spans.data(), (int)m_spans.size());
+    }
 }
 
 void fcMP4Writer::setAACEncoderInfo(const Buffer& aacheader)
@@ -143,7 +216,148 @@ void fcMP4Writer::setAACEncoderInfo(const Buffer& aacheader)
     m_audio_encoder_info.assign(ptr, ptr + aacheader.size());
 }
 
+void fcMP4Writer::flushFragment(uint64_t next_video_timestamp)
+{
+    if (m_video_frame_info.empty() && m_audio_frame_info.empty()) { return; }
+
+    BinaryStream& os = *m_stream;
+    if (!m_moov_written) {
+        // sps / pps are known once the first key frame arrived
+        Buffer moov;
+        BufferStream ms(moov);
+        writeMoov(ms, true);
+        os.write(moov.data(), moov.size());
+        m_moov_written = true;
+    }
+
+    Buffer moof;
+    BufferStream bs(moof);
+    Box box = Box(bs);
+    size_t video_data_offset_pos = 0;
+    size_t audio_data_offset_pos = 0;
+
+    auto write_traf = [&](u32 track_id, const RawVector<fcMP4FrameInfo>& frames, u64 base_time, u32 time_scale,
+        u64 next_timestamp, u64& decode_time, u32& last_duration, bool video, size_t& data_offset_pos)
+    {
+        box(u32_be('traf'), [&]() {
+            box(u32_be('tfhd'), [&]() {
+                bs << u32_be(0x00020000);   // version (0) and flags (default-base-is-moof)
+                bs << u32_be(track_id);
+            }); // tfhd
+            box(u32_be('tfdt'), [&]() {
+                bs << u32_be(0x01000000);   // version (1) and flags (none)
+                bs << u64_be(decode_time);  // base media decode time. sum of durations of preceding fragments.
+            }); // tfdt
+            box(u32_be('trun'), [&]() {
+                // data-offset, sample-duration, sample-size and sample-flags (video only) present
+                bs << u32_be(video ? 0x00000701 : 0x00000301);
+                bs << u32_be(frames.size());
+                data_offset_pos = bs.tellp();
+                bs << u32(0); // data offset. filled later
+                for (size_t i = 0; i < frames.size(); ++i) {
+                    // durations come from the difference of timestamps. the last one uses the next fragment's if known.
+                    u64 t0 = fcToTimeScale(frames[i].timestamp - base_time, time_scale);
+                    u64 t1 = 0;
+                    if (i + 1 < frames.size()) {
+                        t1 = fcToTimeScale(frames[i + 1].timestamp - base_time, time_scale);
+                    }
+                    else if (next_timestamp > frames[i].timestamp) {
+                        t1 = fcToTimeScale(next_timestamp - base_time, time_scale);
+                    }
+                    else {
+                        t1 = t0 + last_duration;
+                    }
+                    u32 duration = t1 > t0 ? u32(t1 - t0) : 0;
+                    last_duration = duration;
+                    decode_time += duration;
+
+                    bs << u32_be(duration);
+                    bs << u32_be(frames[i].size);
+                    if (video) {
+                        // key frame: depends on no others. otherwise: depends on others and is not a sync sample
+                        bs << u32_be(frames[i].keyframe ? 0x02000000 : 0x01010000);
+                    }
+                }
+            }); // trun
+        }); // traf
+    };
+
+    bool has_video = m_video_track_id != 0 && !m_video_frame_info.empty();
+    bool has_audio = m_audio_track_id != 0 && !m_audio_frame_info.empty();
+    box(u32_be('moof'), [&]() {
+        box(u32_be('mfhd'), [&]() {
+            bs << u32(0);                       // version and flags (none)
+            bs << u32_be(++m_fragment_seq);     // sequence number
+        }); // mfhd
+        if (has_video) {
+            write_traf(m_video_track_id, m_video_frame_info, m_video_base_time, fcMP4TimeScale,
+                next_video_timestamp, m_video_decode_time, m_last_video_duration, true, video_data_offset_pos);
+        }
+        if (has_audio) {
+            write_traf(m_audio_track_id, m_audio_frame_info, m_audio_base_time, m_conf.audio_sample_rate,
+                0, m_audio_decode_time, m_last_audio_duration, false, audio_data_offset_pos);
+        }
+    }); // moof
+
+    // offsets from the beginning of moof. mdat holds video samples followed by audio samples.
+    const size_t mdat_header_size = 8;
+    size_t video_size = has_video ? m_fragment_video.size() : 0;
+    size_t audio_size = has_audio ? m_fragment_audio.size() : 0;
+    if (has_video) {
+        u32 offset = u32_be(moof.size() + mdat_header_size);
+        memcpy(&moof[video_data_offset_pos], &offset, 4);
+    }
+    if (has_audio) {
+        u32 offset = u32_be(moof.size() + mdat_header_size + video_size);
+        memcpy(&moof[audio_data_offset_pos], &offset, 4);
+    }
+    u32 mdat_header[2] = { u32_be(mdat_header_size + video_size + audio_size), u32_be('mdat') };
+
+    fcWriteSpan spans[4];
+    spans[0].data = moof.data();                spans[0].size = moof.size();
+    spans[1].data = mdat_header;                spans[1].size = sizeof(mdat_header);
+    spans[2].data = m_fragment_video.data();    spans[2].size = video_size;
+    spans[3].data = m_fragment_audio.data();    spans[3].size = audio_size;
+    os.writev(spans, 4);
+
+    m_video_frame_info.resize(0);
+    m_audio_frame_info.resize(0);
+    m_fragment_video.resize(0);
+    m_fragment_audio.resize(0);
+}
+
 void fcMP4Writer::mp4End()
+{
+    if (m_fragmented) {
+        flushFragment(0);
+        fcDebugLog("fcMP4StreamWriter::mp4End() done.\n");
+        return;
+    }
+
+    BinaryStream& bs = *m_stream;
+    m_mdat_end = bs.tellp();
+    writeMoov(bs, false);
+
+    {
+        size_t pos = bs.tellp();
+#ifdef fcMP464BitLength
+        // 64bit mdat length
+        u64 mdat_size = u64_be(m_mdat_end - m_mdat_begin);
+        bs.seekp(m_mdat_begin + 8);
+        bs.write(&mdat_size, sizeof(mdat_size));
+#else
+        // 32bit mdat length
+        u32 mdat_size = u32_be(m_mdat_end - m_mdat_begin);
+        bs.seekp(m_mdat_begin);
+        bs.write(&mdat_size, sizeof(mdat_size));
+#endif
+        bs.seekp(pos);
+    }
+
+    fcDebugLog("fcMP4StreamWriter::mp4End() done.\n");
+}
+
+void fcMP4Writer::writeMoov(BinaryStream& bs, bool fragmented)
 {
     const char audio_track_name[] = "UTJ Sound Media Handler";
     const char video_track_name[] = "UTJ Video Media Handler";
@@ -163,8 +377,15 @@ void fcMP4Writer::mp4End()
     RawVector<u64> video_chunks;
     RawVector<u64> audio_chunks;
 
+    // in fragmented mode samples are described by moof boxes and the sample tables are left empty
+    RawVector<fcMP4FrameInfo> no_frames;
+    auto& video_frame_info = fragmented ? no_frames : m_video_frame_info;
+    auto& audio_frame_info = fragmented ? no_frames : m_audio_frame_info;
+    bool has_video = fragmented ? c.video && !m_sps.empty() : !m_video_frame_info.empty();
+    bool has_audio = fragmented ? c.audio && !m_audio_encoder_info.empty() : !m_audio_frame_info.empty();
+
     // there must be at least 1 I-frame
-    if (m_iframe_ids.empty()) {
+    if (!fragmented && m_iframe_ids.empty()) {
         m_iframe_ids.push_back(1);
     }
 
@@ -192,8 +413,8 @@ void fcMP4Writer::mp4End()
         }
         return total_duration;
     };
-    video_duration = compute_decode_times(m_video_frame_info, video_decode_times);
-    audio_duration = compute_decode_times(m_audio_frame_info, audio_decode_times);
+    video_duration = compute_decode_times(video_frame_info, video_decode_times);
+    audio_duration = compute_decode_times(audio_frame_info, audio_decode_times);
     duration = std::max<u64>(video_duration, audio_duration);
 
     // compute chunk data
@@ -221,18 +442,15 @@ void fcMP4Writer::mp4End()
             }
         }
     };
-    compute_chunk_data(m_video_frame_info, video_chunks, video_samples_to_chunk);
-    compute_chunk_data(m_audio_frame_info, audio_chunks, audio_samples_to_chunk);
+    compute_chunk_data(video_frame_info, video_chunks, video_samples_to_chunk);
+    compute_chunk_data(audio_frame_info, audio_chunks, audio_samples_to_chunk);
 
 
     //------------------------------------------------------
     // moov section
     //------------------------------------------------------
 
-    BinaryStream& bs = *m_stream;
     Box box = Box(bs);
-    m_mdat_end = bs.tellp();
-
     u32 track_index = 0;
 
     box(u32_be('moov'), [&]() {
@@ -259,14 +477,15 @@ void fcMP4Writer::mp4End()
             bs << u32(0);   // selection(?) start time (time base units)
             bs << u32(0);   // selection(?) duration (time base units)
             bs << u32(0);   // current time (0, time base units)
-            bs << u32_be(!m_audio_frame_info.empty() ? 3 : 2);// next free track id (1-based rather than 0-based)
+            bs << u32_be(has_audio ? 3 : 2);// next free track id (1-based rather than 0-based)
         });
 
         //------------------------------------------------------
         // audio track
         //------------------------------------------------------
-        if (!m_audio_frame_info.empty()) {
+        if (has_audio) {
             ++track_index;
+            m_audio_track_id = track_index;
 
             if (m_audio_encoder_info.empty()) {
                 fcDebugLog("fcMP4StreamWriter::mp4End(): m_audio_encoder_info is not set!\n");
@@ -322,7 +541,7 @@ void fcMP4Writer::mp4End()
                         bs << u32_be(ctime);                // creation time
                         bs << u32_be(ctime);                // modified time
                         bs << u32_be(c.audio_sample_rate);  // time scale
-                        bs << u32_be(unit_duration);
+                        bs << u32_be(fragmented ? 0 : unit_duration);
                         bs << u32_be(0x55C40000);
                     }); // mdhd
                     box(u32_be('hdlr'), [&]() {
@@ -392,8 +611,8 @@ void fcMP4Writer::mp4End()
                             box(u32_be('stsz'), [&]() {
                                 bs << u32(0);   // version and flags (none)
                                 bs << u32(0);   // block size for all (0 if differing sizes)
-                                bs << u32_be(m_audio_frame_info.size());
-                                for (auto& v : m_audio_frame_info) {
+                                bs << u32_be(audio_frame_info.size());
+                                for (auto& v : audio_frame_info) {
                                     bs << u32_be(v.size);
                                 }
                             });
@@ -427,8 +646,9 @@ void fcMP4Writer::mp4End()
         //------------------------------------------------------
         // video track
         //------------------------------------------------------
-        if (!m_video_frame_info.empty()) {
+        if (has_video) {
             ++track_index;
+            m_video_track_id = track_index;
             box(u32_be('trak'), [&]() {
                 box(u32_be('tkhd'), [&]() {
                     bs << u32_be(0x00000006);       // version (0) and flags (0x6)
@@ -521,6 +741,14 @@ void fcMP4Writer::mp4End()
                                         bs << u16_be(m_pps.size()); // pps size
                                         bs.write(&m_pps[0], m_pps.size()); // pps data
                                     }); // 
+                                    box(u32_be('colr'), [&]() {
+                                        auto cd = GetYUVColorDescription(c.video_color_matrix, c.video_color_range);
+                                        bs << u32_be('nclx');   // colour type
+                                        bs << u16_be(cd.primaries);
+                                        bs << u16_be(cd.transfer);
+                                        bs << u16_be(cd.matrix);
+                                        bs << u8(cd.full_range ? 0x80 : 0); // full range flag (1 bit) + reserved (7 bits)
+                                    }); // colr
                                 }); // avc1
                             }); // stsd
 
@@ -534,7 +762,7 @@ void fcMP4Writer::mp4End()
                                 }
                             }); // stts
 
-                            if (m_iframe_ids.size())
+                            if (!fragmented && m_iframe_ids.size())
                             {
                                 box(u32_be('stss'), [&]() {
                                     bs << u32(0); // version and flags (none)
@@ -559,8 +787,8 @@ void fcMP4Writer::mp4End()
                             box(u32_be('stsz'), [&]() {
                                 bs << u32(0); // version and flags (none)
                                 bs << u32(0); // block size for all (0 if differing sizes)
-                                bs << u32_be(m_video_frame_info.size());
-                                for (auto& v : m_video_frame_info) {
+                                bs << u32_be(video_frame_info.size());
+                                for (auto& v : video_frame_info) {
                                     bs << u32_be(v.size);
                                 }
                             }); // stsz
@@ -588,23 +816,23 @@ void fcMP4Writer::mp4End()
                 }); // mdia
             }); // trak
         }
-    }); // moov
 
-    {
-        size_t pos = bs.tellp();
-#ifdef fcMP464BitLength
-        // 64bit mdat length
-        u64 mdat_size = u64_be(m_mdat_end - m_mdat_begin);
-        bs.seekp(m_mdat_begin + 8);
-        bs.write(&mdat_size, sizeof(mdat_size));
-#else
-        // 32bit mdat length
-        u32 mdat_size = u32_be(m_mdat_end - m_mdat_begin);
-        bs.seekp(m_mdat_begin);
-        bs.write(&mdat_size, sizeof(mdat_size));
-#endif
-        bs.seekp(pos);
-    }
-
-    fcDebugLog("fcMP4StreamWriter::mp4End() done.\n");
+        //------------------------------------------------------
+        // defaults for track fragments
+        //------------------------------------------------------
+        if (fragmented) {
+            box(u32_be('mvex'), [&]() {
+                for (u32 id = 1; id <= track_index; ++id) {
+                    box(u32_be('trex'), [&]() {
+                        bs << u32(0);       // version and flags (none)
+                        bs << u32_be(id);   // track ID
+                        bs << u32_be(1);    // default sample description index
+                        bs << u32(0);       // default sample duration
+                        bs << u32(0);       // default sample size
+                        bs << u32(0);       // default sample flags
+                    }); // trex
+                }
+            }); // mvex
+        }
+    }); // moov
 }
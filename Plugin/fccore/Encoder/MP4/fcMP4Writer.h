@@ -13,6 +13,9 @@ public:
 private:
     void mp4Begin();
     void mp4End();
+    void writeMoov(BinaryStream& bs, bool fragmented);
+    // non-seekable streams: emit buffered samples as a moof + mdat pair. the moov (without samples) goes first.
+    void flushFragment(uint64_t next_video_timestamp);
 
 private:
     BinaryStream *m_stream = nullptr;
@@ -24,7 +27,26 @@ private:
     RawVector<u8> m_sps;
     RawVector<u32> m_iframe_ids;
     RawVector<u8> m_audio_encoder_info;
+    RawVector<u32> m_nal_lengths;
+    RawVector<fcWriteSpan> m_spans;
 
     size_t m_mdat_begin = 0;
     size_t m_mdat_end = 0;
+
+    // fragmented mode. m_video_frame_info and m_audio_frame_info hold samples of the current fragment.
+    bool m_fragmented = false;
+    bool m_moov_written = false;
+    u32 m_fragment_seq = 0;
+    u32 m_video_track_id = 0;
+    u32 m_audio_track_id = 0;
+    u64 m_video_base_time = 0;
+    u64 m_audio_base_time = 0;
+    u64 m_video_decode_time = 0;
+    u64 m_audio_decode_time = 0;
+    u32 m_last_video_duration = 0;
+    u32 m_last_audio_duration = 0;
+    bool m_has_video_base = false;
+    bool m_has_audio_base = false;
+    Buffer m_fragment_video;
+    Buffer m_fragment_audio;
 };
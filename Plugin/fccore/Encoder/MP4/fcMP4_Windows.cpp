@@ -31,15 +31,16 @@ class fcMP4ContextWMF : public fcIMP4Context
 {
 public:
     using VideoBuffer   = Buffer;
-    using VideoBuffers  = SharedResources<VideoBuffer>;
+    using VideoBuffers  = ResourcePool<VideoBuffer>;
 
     using AudioBuffer   = RawVector<float>;
-    using AudioBuffers  = SharedResources<AudioBuffer>;
+    using AudioBuffers  = ResourcePool<AudioBuffer>;
 
 
     fcMP4ContextWMF(const fcMP4Config &conf, fcIGraphicsDevice *dev, const char *path);
     ~fcMP4ContextWMF();
     bool isValid() const override;
+    bool getBufferPoolStats(fcBufferPoolType type, fcBufferPoolStats& dst) override;
 
     const char* getAudioEncoderInfo() override;
     const char* getVideoEncoderInfo() override;
@@ -47,8 +48,12 @@ public:
     void addOutputStream(fcStream *s) override;
 
     bool addVideoFrameTexture(void *tex, fcPixelFormat fmt, fcTime timestamp) override;
-    bool addVideoFramePixels(const void *pixels, fcPixelFormat fmt, fcTime timestamp) override;
-    bool addVideoFramePixelsImpl(const void *pixels, fcPixelFormat fmt, fcTime timestamp);
+    bool addVideoFramePixels(const void *pixels, fcPixelFormat fmt, fcTime timestamp, int pitch) override;
+    bool addVideoFramePixelsBorrowed(const void *pixels, fcPixelFormat fmt, fcTime timestamp, const std::function<void()>& release, int pitch) override;
+    fcFrameBuffer acquireVideoFrame(fcPixelFormat fmt) override;
+    bool submitVideoFrame(fcFrameBuffer& frame, fcTime timestamp) override;
+    void releaseVideoFrame(fcFrameBuffer& frame) override;
+    bool addVideoFramePixelsImpl(const void *pixels, fcPixelFormat fmt, int pitch, fcTime timestamp);
 
     bool addAudioSamples(const float *samples, int num_samples) override;
     void writeOutAudioSamples(double timestamp);
@@ -63,8 +68,10 @@ private:
 
     TaskQueue           m_video_tasks;
     VideoBuffers        m_video_buffers;
+    AcquiredHandles     m_acquired_frames;
     Buffer              m_rgba_image;
     I420Image           m_i420_image;
+    YUVConvertOptions   m_yuv_options;
     int                 m_frame_count = 0;
     double              m_last_timestamp = 0.0;
 
@@ -142,6 +149,9 @@ fcMP4ContextWMF::fcMP4ContextWMF(const fcMP4Config &conf, fcIGraphicsDevice *dev
     g_MFInitializer.get();
     m_conf.video_max_tasks = std::max<int>(m_conf.video_max_tasks, 1);
     m_conf.audio_max_tasks = std::max<int>(m_conf.audio_max_tasks, 1);
+    m_yuv_options.linear_to_srgb = m_conf.video_linear_to_srgb;
+    m_yuv_options.matrix = m_conf.video_color_matrix;
+    m_yuv_options.range = m_conf.video_color_range;
 
     initializeSinkWriter(path);
 }
@@ -163,6 +173,15 @@ bool fcMP4ContextWMF::isValid() const
     return m_mf_writer != nullptr;
 }
 
+bool fcMP4ContextWMF::getBufferPoolStats(fcBufferPoolType type, fcBufferPoolStats& dst)
+{
+    switch (type) {
+    case fcBufferPoolType::Video: m_video_buffers.getStats(dst); return m_video_buffers.getCapacity() > 0;
+    case fcBufferPoolType::Audio: m_audio_buffers.getStats(dst); return m_audio_buffers.getCapacity() > 0;
+    }
+    return false;
+}
+
 const char* fcMP4ContextWMF::getAudioEncoderInfo()
 {
     return nullptr;
@@ -187,6 +206,35 @@ static inline HRESULT SetAttributeU32(ComPtr<ICodecAPI>& codec, const GUID& guid
     return codec->SetValue(&guid, &val);
 }
 
+// tell the encoder how the I420 input is encoded, and signal it in the output (H.264 VUI)
+static void SetColorAttributes(IMFMediaType *type, const fcMP4Config& conf)
+{
+    MFVideoTransferMatrix matrix = MFVideoTransferMatrix_BT601;
+    MFVideoPrimaries primaries = MFVideoPrimaries_SMPTE170M;
+    MFVideoTransferFunction transfer = MFVideoTransFunc_709; // BT.601 uses the same curve
+    switch (conf.video_color_matrix) {
+    case fcColorMatrix::BT709:
+        matrix = MFVideoTransferMatrix_BT709;
+        primaries = MFVideoPrimaries_BT709;
+        break;
+    case fcColorMatrix::BT2020:
+#if (WINVER >= _WIN32_WINNT_WIN8)
+        matrix = MFVideoTransferMatrix_BT2020_10;
+        primaries = MFVideoPrimaries_BT2020;
+        transfer = MFVideoTransFunc_2020;
+#else
+        fcDebugLog("fcMP4ContextWMF: BT.2020 requires Windows 8 SDK. BT.601 is signaled instead.\n");
+#endif
+        break;
+    default:
+        break;
+    }
+    type->SetUINT32(MF_MT_YUV_MATRIX, matrix);
+    type->SetUINT32(MF_MT_VIDEO_PRIMARIES, primaries);
+    type->SetUINT32(MF_MT_TRANSFER_FUNCTION, transfer);
+    type->SetUINT32(MF_MT_VIDEO_NOMINAL_RANGE, conf.video_color_range == fcColorRange::Full ? MFNominalRange_0_255 : MFNominalRange_16_235);
+}
+
 bool fcMP4ContextWMF::initializeSinkWriter(const char *path)
 {
     if (!g_MFPlat || !g_MFReadWrite) { return false; }
@@ -226,6 +274,7 @@ bool fcMP4ContextWMF::initializeSinkWriter(const char *path)
             MFSetAttributeSize(pVideoOutMediaType.Get(), MF_MT_FRAME_SIZE, m_conf.video_width, m_conf.video_height);
             MFSetAttributeRatio(pVideoOutMediaType.Get(), MF_MT_FRAME_RATE, m_conf.video_target_framerate, 1);
             MFSetAttributeRatio(pVideoOutMediaType.Get(), MF_MT_PIXEL_ASPECT_RATIO, 1, 1);
+            SetColorAttributes(pVideoOutMediaType.Get(), m_conf);
             hr = pSinkWriter->AddStream(pVideoOutMediaType.Get(), &m_mf_video_index);
 
             pVideoInputMediaType->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Video);
@@ -234,6 +283,7 @@ bool fcMP4ContextWMF::initializeSinkWriter(const char *path)
             MFSetAttributeSize(pVideoInputMediaType.Get(), MF_MT_FRAME_SIZE, m_conf.video_width, m_conf.video_height);
             MFSetAttributeRatio(pVideoInputMediaType.Get(), MF_MT_FRAME_RATE, m_conf.video_target_framerate, 1);
             MFSetAttributeRatio(pVideoInputMediaType.Get(), MF_MT_PIXEL_ASPECT_RATIO, 1, 1);
+            SetColorAttributes(pVideoInputMediaType.Get(), m_conf);
             hr = pSinkWriter->SetInputMediaType(m_mf_video_index, pVideoInputMediaType.Get(), nullptr);
 
             ComPtr<ICodecAPI> encoder;
@@ -260,8 +310,10 @@ bool fcMP4ContextWMF::initializeSinkWriter(const char *path)
                 }
             }
 
+            // pre-allocate for RGBA8 frames. buffers grow once if wider pixel formats come.
+            size_t frame_size = m_conf.video_width * m_conf.video_height * fcGetPixelSize(fcPixelFormat_RGBAu8);
             for (int i = 0; i < m_conf.video_max_tasks; ++i) {
-                m_video_buffers.emplace();
+                m_video_buffers.emplace(frame_size);
             }
         }
     }
@@ -329,7 +381,7 @@ bool fcMP4ContextWMF::addVideoFrameTexture(void *tex, fcPixelFormat fmt, fcTime
     buf->resize(size);
     if (m_gdev->readTexture(buf->data(), buf->size(), tex, m_conf.video_width, m_conf.video_height, fmt)) {
         m_video_tasks.run([this, buf, fmt, timestamp]() {
-            addVideoFramePixelsImpl(buf->data(), fmt, timestamp);
+            addVideoFramePixelsImpl(buf->data(), fmt, 0, timestamp);
         });
     }
     else {
@@ -342,7 +394,7 @@ bool fcMP4ContextWMF::addVideoFrameTexture(void *tex, fcPixelFormat fmt, fcTime
     return true;
 }
 
-bool fcMP4ContextWMF::addVideoFramePixels(const void *pixels, fcPixelFormat fmt, fcTime timestamp)
+bool fcMP4ContextWMF::addVideoFramePixels(const void *pixels, fcPixelFormat fmt, fcTime timestamp, int pitch)
 {
     if (!isValid() || !m_conf.video || !pixels) { return false; }
 
@@ -350,10 +402,69 @@ bool fcMP4ContextWMF::addVideoFramePixels(const void *pixels, fcPixelFormat fmt,
     size_t psize = fcGetPixelSize(fmt);
     size_t size = m_conf.video_width * m_conf.video_height * psize;
     buf->resize(size);
-    memcpy(buf->data(), pixels, size);
+    // bottom-up images are flipped here while copying
+    fcConvertPixelFormat2D(buf->data(), fmt, 0, pixels, fmt, pitch, m_conf.video_width, m_conf.video_height);
+
+    m_video_tasks.run([this, buf, fmt, timestamp]() {
+        addVideoFramePixelsImpl(buf->data(), fmt, 0, timestamp);
+    });
+
+    ++m_frame_count;
+    if (m_frame_count % 30 == 0) { writeOutAudioSamples(timestamp); }
+    m_last_timestamp = timestamp;
+    return true;
+}
+
+bool fcMP4ContextWMF::addVideoFramePixelsBorrowed(const void *pixels, fcPixelFormat fmt, fcTime timestamp, const std::function<void()>& release, int pitch)
+{
+    if (!isValid() || !m_conf.video || !pixels) { return false; }
+
+    // borrowed frames count against the same video_max_tasks budget as copied ones. the buffer itself is not used.
+    auto slot = m_video_buffers.acquire();
+    m_video_tasks.run([this, slot, pixels, fmt, pitch, timestamp, release]() mutable {
+        addVideoFramePixelsImpl(pixels, fmt, pitch, timestamp);
+        // encoder is the last consumer of raw pixels. writers only get encoded data.
+        if (release) { release(); }
+        slot.reset();
+    });
+
+    ++m_frame_count;
+    if (m_frame_count % 30 == 0) { writeOutAudioSamples(timestamp); }
+    m_last_timestamp = timestamp;
+    return true;
+}
+
+fcFrameBuffer fcMP4ContextWMF::acquireVideoFrame(fcPixelFormat fmt)
+{
+    fcFrameBuffer ret;
+    if (!isValid() || !m_conf.video) { return ret; }
+
+    auto buf = m_video_buffers.acquire();
+    size_t psize = fcGetPixelSize(fmt);
+    buf->resize(m_conf.video_width * m_conf.video_height * psize);
+
+    ret.pixels = buf->data();
+    ret.pitch = int(m_conf.video_width * psize);
+    ret.format = fmt;
+    ret.handle = buf.detach();
+    m_acquired_frames.add(ret.handle);
+    return ret;
+}
+
+bool fcMP4ContextWMF::submitVideoFrame(fcFrameBuffer& frame, fcTime timestamp)
+{
+    if (!isValid() || !m_conf.video || !frame.handle) { return false; }
+    if (!m_acquired_frames.take(frame.handle)) {
+        fcDebugLog("fcMP4ContextWMF::submitVideoFrame(): frame is not acquired from this context or already submitted.\n");
+        return false;
+    }
+
+    auto buf = m_video_buffers.attach(frame.handle);
+    auto fmt = frame.format;
+    frame = fcFrameBuffer();
 
     m_video_tasks.run([this, buf, fmt, timestamp]() {
-        addVideoFramePixelsImpl(buf->data(), fmt, timestamp);
+        addVideoFramePixelsImpl(buf->data(), fmt, 0, timestamp);
     });
 
     ++m_frame_count;
@@ -362,16 +473,28 @@ bool fcMP4ContextWMF::addVideoFramePixels(const void *pixels, fcPixelFormat fmt,
     return true;
 }
 
-bool fcMP4ContextWMF::addVideoFramePixelsImpl(const void *pixels, fcPixelFormat fmt, fcTime timestamp)
+void fcMP4ContextWMF::releaseVideoFrame(fcFrameBuffer& frame)
+{
+    if (!frame.handle) { return; }
+    if (!m_acquired_frames.take(frame.handle)) {
+        fcDebugLog("fcMP4ContextWMF::releaseVideoFrame(): frame is not acquired from this context or already submitted.\n");
+        return;
+    }
+
+    // back to the pool when the holder is gone
+    m_video_buffers.attach(frame.handle);
+    frame = fcFrameBuffer();
+}
+
+bool fcMP4ContextWMF::addVideoFramePixelsImpl(const void *pixels, fcPixelFormat fmt, int pitch, fcTime timestamp)
 {
     const LONGLONG start = to_hnsec(timestamp);
     const LONGLONG duration = to_hnsec(1.0 / m_conf.video_target_framerate);
-    const DWORD size = roundup<2>(m_conf.video_width) * roundup<2>(m_conf.video_height);
-    const DWORD buffer_size = size + (size >> 2) + (size >> 2);
 
     // convert image to I420
-    AnyToI420(m_i420_image, m_rgba_image, pixels, fmt, m_conf.video_width, m_conf.video_height);
+    AnyToI420(m_i420_image, m_rgba_image, pixels, fmt, m_conf.video_width, m_conf.video_height, pitch, m_yuv_options);
     auto& i420 = m_i420_image.data();
+    const DWORD buffer_size = DWORD(i420.pitch_y * i420.height + (i420.pitch_u + i420.pitch_v) * ((i420.height + 1) / 2));
 
 
     ComPtr<IMFMediaBuffer> pBuffer;
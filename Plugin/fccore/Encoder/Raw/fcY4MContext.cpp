@@ -0,0 +1,165 @@
+#include "pch.h"
+#include "fcInternal.h"
+#include "Foundation/fcFoundation.h"
+#include "GraphicsDevice/fcGraphicsDevice.h"
+#include "fcY4MContext.h"
+
+#ifdef fcSupportY4M
+#include <libyuv.h>
+
+static const char fcY4MFrameHeader[] = "FRAME\n";
+
+class fcY4MContext : public fcIY4MContext
+{
+public:
+    fcY4MContext(const fcY4MConfig &conf, fcIGraphicsDevice *dev);
+    ~fcY4MContext() override;
+
+    void addOutputStream(fcStream *s) override;
+    bool addFrameTexture(void *tex, fcPixelFormat fmt) override;
+    bool addFramePixels(const void *pixels, fcPixelFormat fmt, int pitch) override;
+
+private:
+    void writeFrame(const void *y, const void *u, const void *v);
+
+    fcY4MConfig m_conf;
+    fcIGraphicsDevice *m_dev = nullptr;
+    std::vector<fcStream*> m_streams;
+    std::string m_header;
+    YUVConvertOptions m_convert_options;
+
+    // reused across frames. nothing is allocated per frame once they are grown.
+    I420Image m_i420;
+    NV12Image m_nv12;
+    Buffer m_y_plane;
+    Buffer m_uv_planes;
+    Buffer m_tmp;
+    Buffer m_texture_pixels;
+};
+
+
+fcY4MContext::fcY4MContext(const fcY4MConfig &conf, fcIGraphicsDevice *dev)
+    : m_conf(conf)
+    , m_dev(dev)
+{
+    m_conf.framerate = std::max<int>(m_conf.framerate, 1);
+    m_convert_options.linear_to_srgb = m_conf.linear_to_srgb;
+    m_convert_options.matrix = m_conf.color_matrix;
+    m_convert_options.range = m_conf.color_range;
+
+    // C420jpeg: chroma sited at the center, same as our converters.
+    char buf[256];
+    snprintf(buf, sizeof(buf), "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg XCOLORRANGE=%s\n",
+        m_conf.width, m_conf.height, m_conf.framerate,
+        m_conf.color_range == fcColorRange::Full ? "FULL" : "LIMITED");
+    m_header = buf;
+}
+
+fcY4MContext::~fcY4MContext()
+{
+    for (auto s : m_streams) { s->release(); }
+    m_streams.clear();
+}
+
+void fcY4MContext::addOutputStream(fcStream *s)
+{
+    if (s) {
+        s->addRef();
+        s->write(m_header.data(), m_header.size());
+        m_streams.push_back(s);
+    }
+}
+
+bool fcY4MContext::addFrameTexture(void *tex, fcPixelFormat fmt)
+{
+    if (m_dev == nullptr) {
+        fcDebugLog("fcY4MContext::addFrameTexture(): gfx device is null.");
+        return false;
+    }
+    m_texture_pixels.resize(m_conf.width * m_conf.height * fcGetPixelSize(fmt));
+    if (!m_dev->readTexture(m_texture_pixels.data(), m_texture_pixels.size(), tex, m_conf.width, m_conf.height, fmt)) {
+        return false;
+    }
+    return addFramePixels(m_texture_pixels.data(), fmt, 0);
+}
+
+bool fcY4MContext::addFramePixels(const void *pixels, fcPixelFormat fmt, int pitch)
+{
+    if (!pixels) { return false; }
+
+    int width = m_conf.width;
+    int height = m_conf.height;
+    int cw = (width + 1) / 2;
+    int ch = (height + 1) / 2;
+    if (fmt == fcPixelFormat_NV12) {
+        // y4m has no semi-planar format. y is written as is and only uv is split to planes.
+        // pitch is the row pitch of both y and uv planes. uv rows follow y rows.
+        if (pitch < 0) {
+            fcDebugLog("fcY4MContext::addFramePixels(): bottom-up NV12 is not supported.\n");
+            return false;
+        }
+        m_nv12.attach(pixels, width, height);
+        auto nv12 = m_nv12.data();
+        if (pitch != 0 && pitch != nv12.pitch_y) {
+            nv12.pitch_y = nv12.pitch_uv = pitch;
+            nv12.uv = (char*)pixels + (size_t)pitch * height;
+            m_y_plane.resize((size_t)width * height);
+            libyuv::CopyPlane((const uint8_t*)nv12.y, pitch, (uint8_t*)m_y_plane.data(), width, width, height);
+            nv12.y = m_y_plane.data();
+        }
+        m_uv_planes.resize((size_t)cw * ch * 2);
+        char *u = m_uv_planes.data();
+        char *v = u + cw * ch;
+        libyuv::SplitUVPlane((const uint8_t*)nv12.uv, nv12.pitch_uv, (uint8_t*)u, cw, (uint8_t*)v, cw, cw, ch);
+        writeFrame(nv12.y, u, v);
+    }
+    else if (fmt == fcPixelFormat_I420 && pitch != 0) {
+        fcDebugLog("fcY4MContext::addFramePixels(): I420 must be tightly packed.\n");
+        return false;
+    }
+    else {
+        // I420 input is referred, not copied.
+        AnyToI420(m_i420, m_tmp, pixels, fmt, width, height, pitch, m_convert_options);
+        auto& i420 = m_i420.data();
+        writeFrame(i420.y, i420.u, i420.v);
+    }
+    return true;
+}
+
+void fcY4MContext::writeFrame(const void *y, const void *u, const void *v)
+{
+    size_t luma_size = (size_t)m_conf.width * m_conf.height;
+    size_t chroma_size = (size_t)((m_conf.width + 1) / 2) * ((m_conf.height + 1) / 2);
+
+    fcWriteSpan spans[4];
+    spans[0].data = fcY4MFrameHeader;
+    spans[0].size = sizeof(fcY4MFrameHeader) - 1;
+    spans[1].data = y;
+    spans[1].size = luma_size;
+    spans[2].data = u;
+    spans[2].size = chroma_size;
+    spans[3].data = v;
+    spans[3].size = chroma_size;
+    for (auto s : m_streams) {
+        s->writev(spans, 4);
+    }
+}
+
+
+fcIY4MContext* fcY4MCreateContextImpl(const fcY4MConfig &conf, fcIGraphicsDevice *dev)
+{
+    if (conf.width <= 0 || conf.height <= 0) {
+        fcDebugLog("fcY4MCreateContextImpl(): width and height must be positive.\n");
+        return nullptr;
+    }
+    return new fcY4MContext(conf, dev);
+}
+
+#else // fcSupportY4M
+
+fcIY4MContext* fcY4MCreateContextImpl(const fcY4MConfig &conf, fcIGraphicsDevice *dev)
+{
+    return nullptr;
+}
+
+#endif // fcSupportY4M
@@ -0,0 +1,11 @@
+#pragma once
+
+class fcIY4MContext : public fcContextBase
+{
+public:
+    virtual void addOutputStream(fcStream *s) = 0;
+    virtual bool addFrameTexture(void *tex, fcPixelFormat fmt) = 0;
+    virtual bool addFramePixels(const void *pixels, fcPixelFormat fmt, int pitch = 0) = 0;
+};
+
+fcIY4MContext* fcY4MCreateContextImpl(const fcY4MConfig &conf, fcIGraphicsDevice *dev);
@@ -20,6 +20,7 @@ public:
     ~fcVPXEncoder() override;
     const char* getMatroskaCodecID() const override;
     const Buffer& getCodecPrivate() const override;
+    fcPixelFormat getInputFormat() const override;
 
     bool encode(fcWebMFrameData& dst, const void *image, fcPixelFormat fmt, fcTime timestamp, bool force_keyframe) override;
     bool flush(fcWebMFrameData& dst) override;
@@ -75,6 +76,18 @@ fcVPXEncoder::fcVPXEncoder(const fcVPXEncoderConfig& conf, fcWebMVideoEncoder en
     if (encoder == fcWebMVideoEncoder::VPX_VP9LossLess) {
         vpx_codec_control_(&m_vpx_ctx, VP9E_SET_LOSSLESS, 1);
     }
+    if (encoder != fcWebMVideoEncoder::VPX_VP8) {
+        // VP8 has no way to signal these
+        vpx_color_space_t cs = VPX_CS_BT_601;
+        switch (conf.color_matrix) {
+        case fcColorMatrix::BT601: cs = VPX_CS_BT_601; break;
+        case fcColorMatrix::BT709: cs = VPX_CS_BT_709; break;
+        case fcColorMatrix::BT2020: cs = VPX_CS_BT_2020; break;
+        }
+        vpx_codec_control_(&m_vpx_ctx, VP9E_SET_COLOR_SPACE, (int)cs);
+        vpx_codec_control_(&m_vpx_ctx, VP9E_SET_COLOR_RANGE,
+            (int)(conf.color_range == fcColorRange::Full ? VPX_CR_FULL_RANGE : VPX_CR_STUDIO_RANGE));
+    }
 
     vpx_img_wrap(&m_vpx_img, VPX_IMG_FMT_I420, m_conf.width, m_conf.height, 2, nullptr);
 }
@@ -95,6 +108,11 @@ const Buffer & fcVPXEncoder::getCodecPrivate() const
     return s_dummy;
 }
 
+fcPixelFormat fcVPXEncoder::getInputFormat() const
+{
+    return fcPixelFormat_I420;
+}
+
 
 bool fcVPXEncoder::encode(fcWebMFrameData& dst, const void *image, fcPixelFormat fmt, fcTime timestamp, bool force_keyframe)
 {
@@ -111,6 +129,9 @@ bool fcVPXEncoder::encode(fcWebMFrameData& dst, const void *image, fcPixelFormat
     m_vpx_img.planes[VPX_PLANE_Y] = (uint8_t*)data.y;
     m_vpx_img.planes[VPX_PLANE_U] = (uint8_t*)data.u;
     m_vpx_img.planes[VPX_PLANE_V] = (uint8_t*)data.v;
+    m_vpx_img.stride[VPX_PLANE_Y] = data.pitch_y;
+    m_vpx_img.stride[VPX_PLANE_U] = data.pitch_u;
+    m_vpx_img.stride[VPX_PLANE_V] = data.pitch_v;
 
     auto res = vpx_codec_encode(&m_vpx_ctx, &m_vpx_img, vpx_time, duration, vpx_flags, 0);
     if (res != VPX_CODEC_OK) {
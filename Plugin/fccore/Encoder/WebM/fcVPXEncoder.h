@@ -7,6 +7,8 @@ struct fcVPXEncoderConfig
     int target_framerate;
     fcBitrateMode bitrate_mode;
     int target_bitrate;
+    fcColorMatrix color_matrix;
+    fcColorRange color_range;
 };
 
 
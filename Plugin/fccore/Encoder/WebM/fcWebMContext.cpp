@@ -17,22 +17,40 @@ public:
     using WriterPtr         = std::unique_ptr<fcWebMWriter>;
     using WriterPtrs        = std::vector<WriterPtr>;
     using VideoBuffer       = Buffer;
-    using VideoBuffers      = SharedResources<VideoBuffer>;
+    using VideoBuffers      = ResourcePool<VideoBuffer>;
     using AudioBuffer       = RawVector<float>;
-    using AudioBuffers      = SharedResources<AudioBuffer>;
+    using AudioBuffers      = ResourcePool<AudioBuffer>;
     using MKVFramePtr       = std::unique_ptr<mkvmuxer::Frame>;
     using MKVFramePtrs      = std::vector<MKVFramePtr>;
 
+    // a frame moving through convert -> encode -> mux
+    struct VideoFrame
+    {
+        YUVImage image;
+        fcWebMFrameData encoded;
+        fcTime timestamp = 0.0;
+    };
+    using VideoFrames       = ResourcePool<VideoFrame>;
+    using VideoFramePtr     = VideoFrames::ResourceHolder;
+
 
     fcWebMContext(fcWebMConfig &conf, fcIGraphicsDevice *gd);
+    bool getBufferPoolStats(fcBufferPoolType type, fcBufferPoolStats& dst) override;
     void addOutputStream(fcStream *s) override;
     bool addVideoFrameTexture(void *tex, fcPixelFormat fmt, fcTime timestamp) override;
-    bool addVideoFramePixels(const void *pixels, fcPixelFormat fmt, fcTime timestamp) override;
+    fcFrameBuffer acquireVideoFrame(fcPixelFormat fmt) override;
+    bool submitVideoFrame(fcFrameBuffer& frame, fcTime timestamp) override;
+    void releaseVideoFrame(fcFrameBuffer& frame) override;
+    bool addVideoFramePixels(const void *pixels, fcPixelFormat fmt, fcTime timestamp, int pitch) override;
+    bool addVideoFramePixelsBorrowed(const void *pixels, fcPixelFormat fmt, fcTime timestamp, const std::function<void()>& release, int pitch) override;
     bool addAudioSamples(const float *samples, int num_samples) override;
 
 private:
     ~fcWebMContext() override;
-    void addVideoFramePixelsImpl(const void *pixels, fcPixelFormat fmt, fcTime timestamp);
+    // release is called when pixels are no longer needed
+    void kickVideoFrame(const void *pixels, fcPixelFormat fmt, int pitch, fcTime timestamp, const std::function<void()>& release);
+    void encodeVideoFrame(VideoFramePtr& frame);
+    void muxVideoFrame(VideoFramePtr& frame, bool flush);
     void flushVideo();
     void flushAudio();
     void addMkvFrames(fcWebMFrameData& data, int track, double& last_timestamp);
@@ -46,10 +64,14 @@ private:
     WriterPtrs          m_writers;
     MKVFramePtrs        m_mkv_frames;
 
-    TaskQueue           m_video_tasks;
+    TaskGroup           m_convert_tasks;
+    OrderedTaskQueue    m_video_tasks;
+    TaskQueue           m_mux_tasks;
     VideoEncoderPtr     m_video_encoder;
     VideoBuffers        m_video_buffers;
-    fcWebMFrameData     m_video_frame;
+    VideoFrames         m_video_frames;
+    AcquiredHandles     m_acquired_frames;
+    YUVConvertOptions   m_yuv_options;
     double              m_video_last_timestamp = 0.0;
 
     TaskQueue           m_audio_tasks;
@@ -74,6 +96,8 @@ fcWebMContext::fcWebMContext(fcWebMConfig &conf, fcIGraphicsDevice *gd)
         econf.target_framerate = conf.video_target_framerate;
         econf.bitrate_mode = conf.video_bitrate_mode;
         econf.target_bitrate = conf.video_target_bitrate;
+        econf.color_matrix = conf.video_color_matrix;
+        econf.color_range = conf.video_color_range;
 
         switch (conf.video_encoder) {
         case fcWebMVideoEncoder::VPX_VP8:
@@ -87,9 +111,20 @@ fcWebMContext::fcWebMContext(fcWebMConfig &conf, fcIGraphicsDevice *gd)
             break;
         }
 
+        // pre-allocate for RGBA8 frames. buffers grow once if wider pixel formats come.
+        size_t frame_size = m_conf.video_width * m_conf.video_height * fcGetPixelSize(fcPixelFormat_RGBAu8);
         for (int i = 0; i < m_conf.video_max_tasks; ++i) {
-            m_video_buffers.emplace();
+            m_video_buffers.emplace(frame_size);
+        }
+
+        // video_max_tasks frames can be converted in parallel while one is encoded and one is muxed
+        m_convert_tasks.setMaxTasks(m_conf.video_max_tasks);
+        for (int i = 0; i < m_conf.video_max_tasks + 2; ++i) {
+            m_video_frames.emplace();
         }
+        m_yuv_options.linear_to_srgb = m_conf.video_linear_to_srgb;
+        m_yuv_options.matrix = m_conf.video_color_matrix;
+        m_yuv_options.range = m_conf.video_color_range;
     }
 
     if (conf.audio) {
@@ -118,7 +153,9 @@ fcWebMContext::~fcWebMContext()
 {
     flushVideo();
     flushAudio();
+    m_convert_tasks.wait();
     m_video_tasks.wait();
+    m_mux_tasks.wait();
     m_audio_tasks.wait();
 
     if (m_conf.video && m_conf.audio) {
@@ -131,6 +168,15 @@ fcWebMContext::~fcWebMContext()
     m_audio_encoder.reset();
 }
 
+bool fcWebMContext::getBufferPoolStats(fcBufferPoolType type, fcBufferPoolStats& dst)
+{
+    switch (type) {
+    case fcBufferPoolType::Video: m_video_buffers.getStats(dst); return m_video_buffers.getCapacity() > 0;
+    case fcBufferPoolType::Audio: m_audio_buffers.getStats(dst); return m_audio_buffers.getCapacity() > 0;
+    }
+    return false;
+}
+
 void fcWebMContext::addOutputStream(fcStream *s)
 {
     if (!s) { return; }
@@ -146,9 +192,7 @@ bool fcWebMContext::addVideoFrameTexture(void *tex, fcPixelFormat fmt, fcTime ti
     size_t size = m_conf.video_width * m_conf.video_height * psize;
     buf->resize(size);
     if (m_gdev->readTexture(buf->data(), buf->size(), tex, m_conf.video_width, m_conf.video_height, fmt)) {
-        m_video_tasks.run([this, buf, fmt, timestamp]() {
-            addVideoFramePixelsImpl(buf->data(), fmt, timestamp);
-        });
+        kickVideoFrame(buf->data(), fmt, 0, timestamp, [buf]() mutable { buf.reset(); });
     }
     else {
         return false;
@@ -156,7 +200,53 @@ bool fcWebMContext::addVideoFrameTexture(void *tex, fcPixelFormat fmt, fcTime ti
     return true;
 }
 
-bool fcWebMContext::addVideoFramePixels(const void *pixels, fcPixelFormat fmt, fcTime timestamp)
+fcFrameBuffer fcWebMContext::acquireVideoFrame(fcPixelFormat fmt)
+{
+    fcFrameBuffer ret;
+    if (!m_video_encoder) { return ret; }
+
+    auto buf = m_video_buffers.acquire();
+    size_t psize = fcGetPixelSize(fmt);
+    buf->resize(m_conf.video_width * m_conf.video_height * psize);
+
+    ret.pixels = buf->data();
+    ret.pitch = int(m_conf.video_width * psize);
+    ret.format = fmt;
+    ret.handle = buf.detach();
+    m_acquired_frames.add(ret.handle);
+    return ret;
+}
+
+bool fcWebMContext::submitVideoFrame(fcFrameBuffer& frame, fcTime timestamp)
+{
+    if (!frame.handle || !m_video_encoder) { return false; }
+    if (!m_acquired_frames.take(frame.handle)) {
+        fcDebugLog("fcWebMContext::submitVideoFrame(): frame is not acquired from this context or already submitted.\n");
+        return false;
+    }
+
+    auto buf = m_video_buffers.attach(frame.handle);
+    auto fmt = frame.format;
+    frame = fcFrameBuffer();
+
+    kickVideoFrame(buf->data(), fmt, 0, timestamp, [buf]() mutable { buf.reset(); });
+    return true;
+}
+
+void fcWebMContext::releaseVideoFrame(fcFrameBuffer& frame)
+{
+    if (!frame.handle) { return; }
+    if (!m_acquired_frames.take(frame.handle)) {
+        fcDebugLog("fcWebMContext::releaseVideoFrame(): frame is not acquired from this context or already submitted.\n");
+        return;
+    }
+
+    // back to the pool when the holder is gone
+    m_video_buffers.attach(frame.handle);
+    frame = fcFrameBuffer();
+}
+
+bool fcWebMContext::addVideoFramePixels(const void *pixels, fcPixelFormat fmt, fcTime timestamp, int pitch)
 {
     if (!pixels || !m_video_encoder) { return false; }
 
@@ -164,20 +254,64 @@ bool fcWebMContext::addVideoFramePixels(const void *pixels, fcPixelFormat fmt, f
     size_t psize = fcGetPixelSize(fmt);
     size_t size = m_conf.video_width * m_conf.video_height * psize;
     buf->resize(size);
-    memcpy(buf->data(), pixels, size);
+    // bottom-up images are flipped here while copying
+    fcConvertPixelFormat2D(buf->data(), fmt, 0, pixels, fmt, pitch, m_conf.video_width, m_conf.video_height);
+
+    kickVideoFrame(buf->data(), fmt, 0, timestamp, [buf]() mutable { buf.reset(); });
+    return true;
+}
 
-    m_video_tasks.run([this, buf, fmt, timestamp]() {
-        addVideoFramePixelsImpl(buf->data(), fmt, timestamp);
+bool fcWebMContext::addVideoFramePixelsBorrowed(const void *pixels, fcPixelFormat fmt, fcTime timestamp, const std::function<void()>& release, int pitch)
+{
+    if (!pixels || !m_video_encoder) { return false; }
+
+    // borrowed frames count against the same video_max_tasks budget as copied ones. the buffer itself is not used.
+    auto slot = m_video_buffers.acquire();
+    // converter is the last consumer of raw pixels. encoder and writers only get converted / encoded data.
+    kickVideoFrame(pixels, fmt, pitch, timestamp, [slot, release]() mutable {
+        if (release) { release(); }
+        slot.reset();
     });
     return true;
 }
 
-void fcWebMContext::addVideoFramePixelsImpl(const void *pixels, fcPixelFormat fmt, fcTime timestamp)
+void fcWebMContext::kickVideoFrame(const void *pixels, fcPixelFormat fmt, int pitch, fcTime timestamp, const std::function<void()>& release)
 {
-    if (m_video_encoder->encode(m_video_frame, pixels, fmt, timestamp)) {
-        {
-            std::unique_lock<std::mutex> lock(m_mutex);
-            addMkvFrames(m_video_frame, fcWebMWriter::VideoTrackIndex, m_video_last_timestamp);
+    // convert -> encode -> mux.
+    // frames are converted in parallel, encoded in submission order and muxed on another strand.
+    // number of frames in the pipeline is bounded by m_video_frames.
+    auto frame = m_video_frames.acquire();
+    auto seq = m_video_tasks.issue();
+    m_convert_tasks.run([this, frame, pixels, fmt, pitch, timestamp, release, seq]() mutable {
+        frame->timestamp = timestamp;
+        frame->image.convert(pixels, fmt, m_video_encoder->getInputFormat(), m_conf.video_width, m_conf.video_height, pitch, m_yuv_options);
+        if (release) { release(); }
+
+        m_video_tasks.run(seq, [this, frame]() mutable {
+            encodeVideoFrame(frame);
+        });
+    });
+}
+
+void fcWebMContext::encodeVideoFrame(VideoFramePtr& frame)
+{
+    frame->encoded.clear();
+    if (!frame->image.data()) { return; }
+
+    if (m_video_encoder->encode(frame->encoded, frame->image.data(), frame->image.format(), frame->timestamp)) {
+        m_mux_tasks.run([this, frame]() mutable {
+            muxVideoFrame(frame, false);
+        });
+    }
+}
+
+void fcWebMContext::muxVideoFrame(VideoFramePtr& frame, bool flush)
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        addMkvFrames(frame->encoded, fcWebMWriter::VideoTrackIndex, m_video_last_timestamp);
+        // flushed frames are written out by the destructor
+        if (!flush) {
             if (!m_conf.audio) {
                 writeOut(m_video_last_timestamp);
             }
@@ -185,21 +319,21 @@ void fcWebMContext::addVideoFramePixelsImpl(const void *pixels, fcPixelFormat fm
                 writeOut(std::min<double>(m_video_last_timestamp, m_audio_last_timestamp) - 1.0);
             }
         }
-        m_video_frame.clear();
     }
+    frame->encoded.clear();
 }
 
 void fcWebMContext::flushVideo()
 {
     if (!m_video_encoder) { return; }
 
-    m_video_tasks.run([this]() {
-        if (m_video_encoder->flush(m_video_frame)) {
-            {
-                std::unique_lock<std::mutex> lock(m_mutex);
-                addMkvFrames(m_video_frame, fcWebMWriter::VideoTrackIndex, m_video_last_timestamp);
-            }
-            m_video_frame.clear();
+    auto frame = m_video_frames.acquire();
+    m_video_tasks.run(m_video_tasks.issue(), [this, frame]() mutable {
+        frame->encoded.clear();
+        if (m_video_encoder->flush(frame->encoded)) {
+            m_mux_tasks.run([this, frame]() mutable {
+                muxVideoFrame(frame, true);
+            });
         }
     });
 }
@@ -9,7 +9,19 @@ public:
     virtual bool addVideoFrameTexture(void *tex, fcPixelFormat fmt, fcTime timestamp = -1.0) = 0;
 
     // timestamp=-1 is treated as current time.
-    virtual bool addVideoFramePixels(const void *pixels, fcPixelFormat fmt, fcTime timestamp = -1.0) = 0;
+    // pitch: see fcGetPitch(). bottom-up images are flipped in the conversion.
+    virtual bool addVideoFramePixels(const void *pixels, fcPixelFormat fmt, fcTime timestamp = -1.0, int pitch = 0) = 0;
+
+    // no-copy path: pixels are referenced until the frame is encoded and then release is called (from a worker thread).
+    // if this returns false release is not called and pixels can be reused immediately.
+    virtual bool addVideoFramePixelsBorrowed(const void *pixels, fcPixelFormat fmt, fcTime timestamp, const std::function<void()>& release, int pitch = 0) = 0;
+
+    // zero-copy path: acquire a frame from the buffer pool, fill it and submit it.
+    // a frame that is not submitted must be released by releaseVideoFrame().
+    virtual fcFrameBuffer acquireVideoFrame(fcPixelFormat fmt) = 0;
+    // timestamp=-1 is treated as current time.
+    virtual bool submitVideoFrame(fcFrameBuffer& frame, fcTime timestamp = -1.0) = 0;
+    virtual void releaseVideoFrame(fcFrameBuffer& frame) = 0;
 
     virtual bool addAudioSamples(const float *samples, int num_samples) = 0;
 };
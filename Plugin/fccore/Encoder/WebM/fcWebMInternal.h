@@ -51,6 +51,8 @@ class fcIWebMVideoEncoder : public fcIWebMEncoderInfo
 {
 public:
     virtual ~fcIWebMVideoEncoder() {}
+    // frames in this format are passed to encoder without conversion.
+    virtual fcPixelFormat getInputFormat() const = 0;
     virtual bool encode(fcWebMFrameData& dst, const void *image, fcPixelFormat fmt, fcTime timestamp, bool force_keyframe = false) = 0;
     virtual bool flush(fcWebMFrameData& dst) = 0;
 };
@@ -14,11 +14,11 @@ class fcMkvStream : public mkvmuxer::IMkvWriter
 {
 public:
     fcMkvStream(BinaryStream *stream) : m_stream(stream) { m_stream->addRef(); }
-    ~fcMkvStream() { m_stream->release(); }
+    ~fcMkvStream() { m_stream->flush(); m_stream->release(); }
     int32_t Write(const void* buf, uint32_t len) override { m_stream->write(buf, len); return 0; }
     mkvmuxer::int64 Position() const override { return m_stream->tellp(); }
     mkvmuxer::int32 Position(mkvmuxer::int64 position) override { m_stream->seekp((size_t)position); return 0; }
-    bool Seekable() const override { return true; }
+    bool Seekable() const override { return m_stream->isSeekable(); }
     void ElementStartNotify(mkvmuxer::uint64 element_id, mkvmuxer::int64 position) override {}
 private:
     BinaryStream *m_stream = nullptr;
@@ -31,8 +31,14 @@ fcWebMWriter::fcWebMWriter(
     : m_stream(new fcMkvStream(stream))
 {
     m_segment.Init(m_stream.get());
-    m_segment.set_mode(mkvmuxer::Segment::kFile);
-    m_segment.set_estimate_file_duration(true);
+    if (stream->isSeekable()) {
+        m_segment.set_mode(mkvmuxer::Segment::kFile);
+        m_segment.set_estimate_file_duration(true);
+    }
+    else {
+        // sizes, duration and cues can't be written back. clusters are written with unknown sizes instead.
+        m_segment.set_mode(mkvmuxer::Segment::kLive);
+    }
 
     if (conf.video && vinfo) {
         m_video_track_id = m_segment.AddVideoTrack(conf.video_width, conf.video_height, VideoTrackIndex);
@@ -42,6 +48,14 @@ fcWebMWriter::fcWebMWriter(
         track->set_display_height(conf.video_height);
         track->set_frame_rate(conf.video_target_framerate);
 
+        auto cd = GetYUVColorDescription(conf.video_color_matrix, conf.video_color_range);
+        mkvmuxer::Colour colour;
+        colour.set_primaries(cd.primaries);
+        colour.set_transfer_characteristics(cd.transfer);
+        colour.set_matrix_coefficients(cd.matrix);
+        colour.set_range(cd.full_range ? 2 : 1); // 1: broadcast range, 2: full range
+        track->SetColour(colour);
+
         m_segment.CuesTrack(m_video_track_id);
     }
 
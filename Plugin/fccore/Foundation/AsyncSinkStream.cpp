@@ -0,0 +1,357 @@
+#include "pch.h"
+#include "fcInternal.h"
+#include "AsyncSinkStream.h"
+
+// small writes are packed into packets of this size
+static const size_t fcSinkPacketSize = 256 * 1024;
+// max number of contiguous packets handed to the sink in one writev() call
+static const size_t fcSinkMaxBatch = 16;
+
+// spill files can exceed 2GB
+static int SpillSeek(FILE *f, uint64_t pos)
+{
+#ifdef _WIN32
+    return _fseeki64(f, (int64_t)pos, SEEK_SET);
+#else
+    return fseeko(f, (off_t)pos, SEEK_SET);
+#endif
+}
+
+
+size_t AsyncPacketStream::tellp()
+{
+    return m_pos;
+}
+
+void AsyncPacketStream::seekp(size_t pos)
+{
+    m_pos = pos;
+}
+
+size_t AsyncPacketStream::write(const void *data, size_t len)
+{
+    if (len == 0) { return 0; }
+
+    // extend or patch the current packet if possible (sequential writes and back-patching of box sizes)
+    auto& cur = m_current;
+    if (cur.data && m_pos >= cur.pos && m_pos <= cur.pos + cur.data->size() && m_pos + len <= cur.pos + fcSinkPacketSize) {
+        size_t offset = m_pos - cur.pos;
+        if (cur.data->size() < offset + len) {
+            cur.data->resize(offset + len);
+        }
+        memcpy(cur.data->data() + offset, data, len);
+    }
+    else {
+        sealPacket();
+        cur.pos = m_pos;
+        cur.data = std::make_shared<Buffer>();
+        cur.data->reserve(std::max<size_t>(len, fcSinkPacketSize));
+        cur.data->assign((const char*)data, len);
+    }
+    m_pos += len;
+
+    if (cur.data->size() >= fcSinkPacketSize) {
+        sealPacket();
+    }
+    return len;
+}
+
+void AsyncPacketStream::sealPacket()
+{
+    if (!m_current.data) { return; }
+    enqueue(m_current);
+    m_current = Packet();
+}
+
+
+AsyncSinkStream::AsyncSinkStream(BinaryStream *stream, const fcAsyncSinkConfig& conf)
+    : m_stream(stream)
+    , m_conf(conf)
+{
+    if (m_conf.spill_path) {
+        m_spill_path = m_conf.spill_path;
+    }
+    m_conf.spill_path = nullptr;
+
+    m_stream->addRef();
+    m_pos = m_stream->tellp();
+    size_t pos = m_pos;
+    m_thread = std::thread([this, pos]() { process(pos); });
+}
+
+AsyncSinkStream::~AsyncSinkStream()
+{
+    flush();
+    {
+        Lock l(m_mutex);
+        m_stop = true;
+    }
+    m_cond_queue.notify_all();
+    m_thread.join();
+
+    if (m_spill) {
+        fclose(m_spill);
+        if (!m_spill_path.empty()) {
+            remove(m_spill_path.c_str());
+        }
+    }
+    m_stream->release();
+}
+
+size_t AsyncSinkStream::tellg()
+{
+    flush();
+    return m_stream->tellg();
+}
+
+void AsyncSinkStream::seekg(size_t pos)
+{
+    flush();
+    m_stream->seekg(pos);
+}
+
+size_t AsyncSinkStream::read(void *dst, size_t len)
+{
+    flush();
+    return m_stream->read(dst, len);
+}
+
+void AsyncSinkStream::flush()
+{
+    sealPacket();
+    {
+        Lock l(m_mutex);
+        m_cond_space.wait(l, [this]() { return m_dropped || (m_queue.empty() && !m_spilling && !m_busy); });
+        if (m_dropped) { return; }
+    }
+    m_stream->flush();
+}
+
+bool AsyncSinkStream::getStats(fcStreamStats& dst)
+{
+    return m_stream->getStats(dst);
+}
+
+bool AsyncSinkStream::isSeekable()
+{
+    return m_stream->isSeekable();
+}
+
+void AsyncSinkStream::getSinkStats(fcAsyncSinkStats& dst)
+{
+    Lock l(m_mutex);
+    dst.queued_bytes = m_queued_bytes;
+    dst.max_queued_bytes = m_max_queued_bytes;
+    dst.spill_bytes = m_spill_wpos - m_spill_rpos;
+    dst.total_spilled_bytes = m_spilled_bytes;
+    dst.written_bytes = m_written_bytes;
+    dst.total_block_time = (double)m_block_time / 1000000000.0;
+    dst.dropped = m_dropped;
+}
+
+
+void AsyncSinkStream::enqueue(Packet& p)
+{
+    size_t size = p.data->size();
+    {
+        Lock l(m_mutex);
+        if (m_dropped) { return; }
+
+        bool fits = m_queued_bytes + size <= m_conf.max_queued_bytes || m_queue.empty();
+        if (!m_spilling && !fits) {
+            switch (m_conf.policy) {
+            case fcSinkPolicy::Block:
+            {
+                auto begin = std::chrono::steady_clock::now();
+                m_cond_space.wait(l, [&]() { return m_queued_bytes + size <= m_conf.max_queued_bytes || m_queue.empty(); });
+                m_block_time += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+                break;
+            }
+            case fcSinkPolicy::Drop:
+                fcDebugLog("AsyncSinkStream: sink is %llu bytes behind. dropped.\n", (unsigned long long)m_queued_bytes);
+                m_dropped = true;
+                m_queue.clear();
+                m_queued_bytes = 0;
+                m_cond_space.notify_all();
+                return;
+            case fcSinkPolicy::Spill:
+                m_spilling = true;
+                break;
+            }
+        }
+
+        if (m_spilling) {
+            if (spill(p)) {
+                m_cond_queue.notify_one();
+                return;
+            }
+            // spill failed. fall back to blocking.
+            m_spilling = m_spill_wpos != m_spill_rpos;
+            m_cond_space.wait(l, [&]() { return !m_spilling && (m_queued_bytes + size <= m_conf.max_queued_bytes || m_queue.empty()); });
+        }
+
+        m_queue.push_back(std::move(p));
+        m_queued_bytes += size;
+        m_max_queued_bytes = std::max<uint64_t>(m_max_queued_bytes, m_queued_bytes);
+    }
+    m_cond_queue.notify_one();
+}
+
+// called with m_mutex locked
+bool AsyncSinkStream::spill(const Packet& p)
+{
+    if (!m_spill) {
+        m_spill = m_spill_path.empty() ? tmpfile() : fopen(m_spill_path.c_str(), "w+b");
+        if (!m_spill) {
+            fcDebugLog("AsyncSinkStream: failed to open spill file\n");
+            return false;
+        }
+    }
+
+    SpillHeader header = { (uint64_t)p.pos, (uint64_t)p.data->size() };
+    SpillSeek(m_spill, m_spill_wpos);
+    if (fwrite(&header, sizeof(header), 1, m_spill) != 1 ||
+        fwrite(p.data->data(), 1, p.data->size(), m_spill) != p.data->size())
+    {
+        fcDebugLog("AsyncSinkStream: failed to write spill file\n");
+        return false;
+    }
+    m_spill_wpos += sizeof(header) + p.data->size();
+    m_spilled_bytes += p.data->size();
+    return true;
+}
+
+// called with m_mutex locked
+bool AsyncSinkStream::unspill(Packet& dst)
+{
+    if (m_spill_rpos == m_spill_wpos) { return false; }
+
+    SpillHeader header;
+    SpillSeek(m_spill, m_spill_rpos);
+    if (fread(&header, sizeof(header), 1, m_spill) != 1) { return false; }
+    dst.pos = (size_t)header.pos;
+    dst.data = std::make_shared<Buffer>((size_t)header.size);
+    if (fread(dst.data->data(), 1, (size_t)header.size, m_spill) != (size_t)header.size) { return false; }
+    m_spill_rpos += sizeof(header) + header.size;
+
+    if (m_spill_rpos == m_spill_wpos) {
+        // drained. reuse the file from the beginning.
+        m_spill_rpos = m_spill_wpos = 0;
+        m_spilling = false;
+    }
+    return true;
+}
+
+void AsyncSinkStream::process(size_t sink_pos)
+{
+    std::vector<Packet> batch;
+    std::vector<fcWriteSpan> spans;
+    for (;;) {
+        batch.clear();
+        {
+            Lock l(m_mutex);
+            m_busy = false;
+            m_cond_space.notify_all();
+            m_cond_queue.wait(l, [this]() { return m_stop || !m_queue.empty() || m_spill_rpos != m_spill_wpos; });
+
+            if (!m_queue.empty()) {
+                // take packets that continue each other at once. sockets and pipes get fewer, larger writes.
+                size_t end = m_queue.front().pos;
+                while (!m_queue.empty() && m_queue.front().pos == end && batch.size() < fcSinkMaxBatch) {
+                    end += m_queue.front().data->size();
+                    m_queued_bytes -= m_queue.front().data->size();
+                    batch.push_back(std::move(m_queue.front()));
+                    m_queue.pop_front();
+                }
+            }
+            else if (m_spill_rpos != m_spill_wpos) {
+                Packet p;
+                if (!unspill(p)) {
+                    fcDebugLog("AsyncSinkStream: failed to read spill file. remaining data is lost.\n");
+                    m_spill_rpos = m_spill_wpos = 0;
+                    m_spilling = false;
+                    continue;
+                }
+                batch.push_back(std::move(p));
+            }
+            else {
+                break; // m_stop
+            }
+            m_busy = true;
+            m_cond_space.notify_all();
+        }
+
+        size_t size = 0;
+        spans.clear();
+        for (auto& p : batch) {
+            fcWriteSpan span;
+            span.data = p.data->data();
+            span.size = p.data->size();
+            spans.push_back(span);
+            size += span.size;
+        }
+        if (sink_pos != batch.front().pos) {
+            m_stream->seekp(batch.front().pos);
+        }
+        m_stream->writev(spans.data(), (int)spans.size());
+        sink_pos = batch.front().pos + size;
+
+        Lock l(m_mutex);
+        m_written_bytes += size;
+    }
+}
+
+
+AsyncFanOutStream* AsyncFanOutStream::create(AsyncSinkStream **sinks, int num_sinks)
+{
+    if (!sinks || num_sinks <= 0) { return nullptr; }
+    for (int i = 0; i < num_sinks; ++i) {
+        if (!sinks[i] || sinks[i]->tellp() != sinks[0]->tellp()) {
+            fcDebugLog("AsyncFanOutStream: sinks must be valid and at the same position\n");
+            return nullptr;
+        }
+    }
+    return new AsyncFanOutStream(sinks, num_sinks);
+}
+
+AsyncFanOutStream::AsyncFanOutStream(AsyncSinkStream **sinks, int num_sinks)
+    : m_sinks(sinks, sinks + num_sinks)
+{
+    for (auto *s : m_sinks) {
+        s->addRef();
+    }
+    m_pos = m_sinks.front()->tellp();
+}
+
+AsyncFanOutStream::~AsyncFanOutStream()
+{
+    sealPacket();
+    for (auto *s : m_sinks) {
+        s->release();
+    }
+}
+
+void AsyncFanOutStream::flush()
+{
+    sealPacket();
+    for (auto *s : m_sinks) {
+        s->flush();
+    }
+}
+
+bool AsyncFanOutStream::isSeekable()
+{
+    for (auto *s : m_sinks) {
+        if (!s->isSeekable()) { return false; }
+    }
+    return true;
+}
+
+void AsyncFanOutStream::enqueue(Packet& p)
+{
+    // every sink shares p.data. only the reference is copied.
+    for (auto *s : m_sinks) {
+        Packet ref = p;
+        s->enqueue(ref);
+    }
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "Buffer.h"
+
+
+// producer side of async streams: packs writes into reference-counted packets and hands sealed packets
+// (immutable from then on) to enqueue(). tellp() is answered from the position tracked here,
+// so muxers never wait for sinks.
+class AsyncPacketStream : public BinaryStream
+{
+public:
+    using PacketPtr = std::shared_ptr<Buffer>;
+
+    size_t  tellp() override;
+    void    seekp(size_t pos) override;
+    size_t  write(const void *data, size_t len) override;
+
+protected:
+    struct Packet
+    {
+        size_t pos = 0;
+        PacketPtr data;
+    };
+
+    void sealPacket();
+    virtual void enqueue(Packet& p) = 0;
+
+protected:
+    size_t m_pos = 0;
+    Packet m_current;
+};
+
+
+// decouples an output stream from the encoder.
+// a dedicated thread writes queued packets to the wrapped stream. when the sink falls behind more than
+// conf.max_queued_bytes, conf.policy decides: block the producer, drop the sink or spill packets to a file on disk.
+class AsyncSinkStream : public AsyncPacketStream
+{
+friend class AsyncFanOutStream;
+public:
+    using Lock = std::unique_lock<std::mutex>;
+
+    AsyncSinkStream(BinaryStream *stream, const fcAsyncSinkConfig& conf);
+    ~AsyncSinkStream() override;
+
+    size_t  tellg() override;
+    void    seekg(size_t pos) override;
+    size_t  read(void *dst, size_t len) override;
+
+    // wait until everything queued is written to the wrapped stream
+    void    flush() override;
+    bool    getStats(fcStreamStats& dst) override;
+    bool    isSeekable() override;
+
+    void    getSinkStats(fcAsyncSinkStats& dst);
+
+private:
+    AsyncSinkStream(const AsyncSinkStream&) = delete;
+    AsyncSinkStream& operator=(const AsyncSinkStream&) = delete;
+
+    struct SpillHeader
+    {
+        uint64_t pos;
+        uint64_t size;
+    };
+
+    void enqueue(Packet& p) override;
+    bool spill(const Packet& p);
+    bool unspill(Packet& dst);
+    void process(size_t sink_pos);
+
+private:
+    BinaryStream *m_stream = nullptr;
+    fcAsyncSinkConfig m_conf;
+    std::string m_spill_path;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond_queue; // producer -> writer thread
+    std::condition_variable m_cond_space; // writer thread -> producer
+    std::deque<Packet> m_queue;
+    bool m_stop = false;
+    bool m_busy = false;
+    bool m_dropped = false;
+
+    // spill file. used only by the Spill policy. once spilling starts, all packets go there until it is drained.
+    FILE *m_spill = nullptr;
+    bool m_spilling = false;
+    uint64_t m_spill_rpos = 0;
+    uint64_t m_spill_wpos = 0;
+
+    // telemetry (guarded by m_mutex)
+    uint64_t m_queued_bytes = 0;
+    uint64_t m_max_queued_bytes = 0;
+    uint64_t m_spilled_bytes = 0;
+    uint64_t m_written_bytes = 0;
+    uint64_t m_block_time = 0; // in nanoseconds
+
+    std::thread m_thread;
+};
+
+
+// writes the same data to several AsyncSinkStreams. each packet is built once and every sink queues a reference
+// to it, so N outputs cost one copy instead of N. sinks keep their own thread and policy.
+// the sinks must start at the same position and must not be written directly while attached.
+class AsyncFanOutStream : public AsyncPacketStream
+{
+public:
+    // return nullptr if sinks is empty or their positions differ
+    static AsyncFanOutStream* create(AsyncSinkStream **sinks, int num_sinks);
+    ~AsyncFanOutStream() override;
+
+    // write only
+    size_t  tellg() override { return 0; }
+    void    seekg(size_t) override {}
+    size_t  read(void*, size_t) override { return 0; }
+
+    // wait until every sink has written everything queued
+    void    flush() override;
+    // seekable only if all sinks are
+    bool    isSeekable() override;
+
+private:
+    AsyncFanOutStream(AsyncSinkStream **sinks, int num_sinks);
+    AsyncFanOutStream(const AsyncFanOutStream&) = delete;
+    AsyncFanOutStream& operator=(const AsyncFanOutStream&) = delete;
+
+    void enqueue(Packet& p) override;
+
+private:
+    std::vector<AsyncSinkStream*> m_sinks;
+};
@@ -2,6 +2,18 @@
 #include "fcInternal.h"
 #include "Buffer.h"
 
+static std::atomic<size_t> g_stream_buffer_size = { BufferedStream::DefaultBlockSize };
+
+void fcSetStreamBufferSizeImpl(size_t size)
+{
+    g_stream_buffer_size = size;
+}
+
+size_t fcGetStreamBufferSizeImpl()
+{
+    return g_stream_buffer_size;
+}
+
 fcAPI void* AlignedAlloc(size_t size, size_t alignment)
 {
     size_t mask = alignment - 1;
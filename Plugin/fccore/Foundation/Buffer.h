@@ -4,6 +4,8 @@
 #include <algorithm>
 #include <cstring>
 
+struct fcStreamStats;
+
 fcAPI void* AlignedAlloc(size_t size, size_t align);
 fcAPI void  AlignedFree(void *p);
 
@@ -185,6 +187,22 @@ public:
     virtual size_t  tellp() = 0;
     virtual void    seekp(size_t pos) = 0;
     virtual size_t  write(const void *data, size_t len) = 0;
+    virtual size_t  writev(const fcWriteSpan *spans, int num_spans)
+    {
+        size_t ret = 0;
+        for (int i = 0; i < num_spans; ++i) {
+            ret += write(spans[i].data, spans[i].size);
+        }
+        return ret;
+    }
+
+    // push buffered data to the underlying device. streams without own buffer do nothing.
+    virtual void    flush() {}
+    // return false if the stream doesn't write asynchronously
+    virtual bool    getStats(fcStreamStats& /*dst*/) { return false; }
+    // false for sinks that can only be appended (sockets, pipes, shared memory rings).
+    // muxers switch to modes that don't back-patch what is already written.
+    virtual bool    isSeekable() { return true; }
 
 private:
     std::atomic_int m_ref_count = { 1 };
@@ -272,6 +290,129 @@ protected:
 };
 
 
+// memory stream that grows by fixed-size chunks. unlike BufferStream, growing never moves or copies written data.
+// random access seekp() (back-patching) is supported. use getChunk() to consume data without a big copy.
+class ChunkedBufferStream : public BinaryStream
+{
+public:
+    static const size_t DefaultChunkSize = 1024 * 1024;
+
+    ChunkedBufferStream(size_t chunk_size = DefaultChunkSize)
+        : m_chunk_size(std::max<size_t>(chunk_size, 1))
+    {}
+
+    ~ChunkedBufferStream() override
+    {
+        for (auto c : m_chunks) { AlignedFree(c); }
+    }
+
+    size_t size() const { return m_size; }
+    size_t getNumChunks() const { return (m_size + m_chunk_size - 1) / m_chunk_size; }
+
+    // the last chunk may be partially filled. len receives valid size of the chunk.
+    const char* getChunk(size_t i, size_t& len) const
+    {
+        if (i >= getNumChunks()) {
+            len = 0;
+            return nullptr;
+        }
+        len = std::min<size_t>(m_chunk_size, m_size - i * m_chunk_size);
+        return m_chunks[i];
+    }
+
+    // copy [pos, pos + len) to dst. return copied size.
+    size_t copyTo(void *dst, size_t pos, size_t len) const
+    {
+        if (pos >= m_size) { return 0; }
+        len = std::min<size_t>(len, m_size - pos);
+        auto *d = (char*)dst;
+        size_t rest = len;
+        while (rest > 0) {
+            size_t offset = pos % m_chunk_size;
+            size_t n = std::min<size_t>(rest, m_chunk_size - offset);
+            memcpy(d, m_chunks[pos / m_chunk_size] + offset, n);
+            d += n;
+            pos += n;
+            rest -= n;
+        }
+        return len;
+    }
+
+    // whole data in one contiguous buffer. built on demand and kept until the next write.
+    const Buffer& flatten()
+    {
+        if (!m_flat_valid) {
+            m_flat.resize(m_size);
+            copyTo(m_flat.data(), 0, m_size);
+            m_flat_valid = true;
+        }
+        return m_flat;
+    }
+
+
+    size_t tellg() override
+    {
+        return m_rpos;
+    }
+
+    void seekg(size_t pos) override
+    {
+        m_rpos = std::min<size_t>(pos, m_size);
+    }
+
+    size_t read(void *dst, size_t len) override
+    {
+        size_t ret = copyTo(dst, m_rpos, len);
+        m_rpos += ret;
+        return ret;
+    }
+
+
+    size_t tellp() override
+    {
+        return m_wpos;
+    }
+
+    void seekp(size_t pos) override
+    {
+        m_wpos = std::min<size_t>(pos, m_size);
+    }
+
+    size_t write(const void *data, size_t len) override
+    {
+        m_flat_valid = false;
+        auto *s = (const char*)data;
+        size_t rest = len;
+        while (rest > 0) {
+            size_t index = m_wpos / m_chunk_size;
+            size_t offset = m_wpos % m_chunk_size;
+            if (index == m_chunks.size()) {
+                m_chunks.push_back((char*)AlignedAlloc(m_chunk_size, 0x20));
+            }
+            size_t n = std::min<size_t>(rest, m_chunk_size - offset);
+            memcpy(m_chunks[index] + offset, s, n);
+            s += n;
+            m_wpos += n;
+            rest -= n;
+        }
+        m_size = std::max<size_t>(m_size, m_wpos);
+        return len;
+    }
+
+private:
+    ChunkedBufferStream(const ChunkedBufferStream&) = delete;
+    ChunkedBufferStream& operator=(const ChunkedBufferStream&) = delete;
+
+    std::vector<char*> m_chunks;
+    size_t m_chunk_size = 0;
+    size_t m_size = 0;
+    size_t m_wpos = 0;
+    size_t m_rpos = 0;
+    Buffer m_flat;
+    bool m_flat_valid = false;
+};
+
+
 class StdOStream : public BinaryStream
 {
 public:
@@ -303,6 +444,11 @@ public:
         return len;
     }
 
+    void flush() override
+    {
+        m_os.flush();
+    }
+
 protected:
     std::ostream& m_os;
     bool m_delete_flag;
@@ -389,6 +535,11 @@ public:
         return len;
     }
 
+    void flush() override
+    {
+        m_ios.flush();
+    }
+
 protected:
     std::iostream& m_ios;
     bool m_delete_flag;
@@ -403,6 +554,8 @@ using read_t  = size_t (*)(void *obj, void *dst, size_t len);
 using tellp_t = size_t (*)(void *obj);
 using seekp_t = void   (*)(void *obj, size_t pos);
 using write_t = size_t (*)(void *obj, const void *data, size_t len);
+using writev_t = size_t (*)(void *obj, const fcWriteSpan *spans, int num_spans);
+using flush_t = void   (*)(void *obj);
 
 struct CustomStreamData
 {
@@ -413,11 +566,13 @@ struct CustomStreamData
     tellp_t tellp;
     seekp_t seekp;
     write_t write;
+    writev_t writev;    // optional. used instead of write if set.
+    flush_t flush;      // optional
 
     CustomStreamData()
         : obj()
         , tellg(), seekg(), read()
-        , tellp(), seekp(), write()
+        , tellp(), seekp(), write(), writev(), flush()
     {}
 };
 
@@ -452,14 +607,190 @@ public:
 
     void seekp(size_t pos) override
     {
-        return m_csd.seekp(m_csd.obj, pos);
+        if (m_csd.seekp) {
+            m_csd.seekp(m_csd.obj, pos);
+        }
+    }
+
+    bool isSeekable() override
+    {
+        return m_csd.seekp != nullptr;
     }
 
     size_t write(const void *data, size_t len) override
     {
+        if (m_csd.writev) {
+            fcWriteSpan span;
+            span.data = data;
+            span.size = len;
+            return m_csd.writev(m_csd.obj, &span, 1);
+        }
         return m_csd.write(m_csd.obj, data, len);
     }
 
+    size_t writev(const fcWriteSpan *spans, int num_spans) override
+    {
+        if (m_csd.writev) {
+            return m_csd.writev(m_csd.obj, spans, num_spans);
+        }
+        return BinaryStream::writev(spans, num_spans);
+    }
+
+    void flush() override
+    {
+        if (m_csd.flush) {
+            m_csd.flush(m_csd.obj);
+        }
+    }
+
 private:
     CustomStreamData m_csd;
 };
+
+
+// block size of BufferedStream that wraps file and custom streams. 0 disables buffering.
+void   fcSetStreamBufferSizeImpl(size_t size);
+size_t fcGetStreamBufferSizeImpl();
+
+// write-behind buffer on top of another stream.
+// small writes (box fields, NAL length prefixes, etc.) are coalesced into one aligned block and go to the
+// underlying stream in big chunks. seekp() inside the buffered window (back-patching box sizes) doesn't flush.
+// reads are passed through after flushing.
+class BufferedStream : public BinaryStream
+{
+public:
+    static const size_t DefaultBlockSize = 1024 * 1024;
+    static const size_t BlockAlignment = 4096;
+
+    BufferedStream(BinaryStream *stream, size_t block_size = DefaultBlockSize)
+        : m_stream(stream)
+        , m_capacity(std::max<size_t>(block_size, 1))
+    {
+        m_stream->addRef();
+        m_data = (char*)AlignedAlloc(m_capacity, BlockAlignment);
+        m_base = m_stream->tellp();
+    }
+
+    ~BufferedStream() override
+    {
+        flush();
+        AlignedFree(m_data);
+        m_stream->release();
+    }
+
+    BinaryStream* get()             { return m_stream; }
+    const BinaryStream* get() const { return m_stream; }
+
+    size_t tellg() override
+    {
+        flushBuffer();
+        return m_stream->tellg();
+    }
+
+    void seekg(size_t pos) override
+    {
+        flushBuffer();
+        m_stream->seekg(pos);
+    }
+
+    size_t read(void *dst, size_t len) override
+    {
+        flushBuffer();
+        return m_stream->read(dst, len);
+    }
+
+
+    size_t tellp() override
+    {
+        return m_base + m_pos;
+    }
+
+    void seekp(size_t pos) override
+    {
+        if (pos >= m_base && pos <= m_base + m_size) {
+            m_pos = pos - m_base;
+        }
+        else {
+            flushBuffer();
+            m_stream->seekp(pos);
+            m_base = pos;
+        }
+    }
+
+    size_t write(const void *data, size_t len) override
+    {
+        if (m_pos + len > m_capacity) {
+            flushBuffer();
+            if (len >= m_capacity) {
+                // too big to buffer. write it through.
+                size_t ret = m_stream->write(data, len);
+                m_base += ret;
+                return ret;
+            }
+        }
+        memcpy(m_data + m_pos, data, len);
+        m_pos += len;
+        m_size = std::max<size_t>(m_size, m_pos);
+        return len;
+    }
+
+    size_t writev(const fcWriteSpan *spans, int num_spans) override
+    {
+        size_t total = 0;
+        for (int i = 0; i < num_spans; ++i) {
+            total += spans[i].size;
+        }
+        if (m_pos + total > m_capacity) {
+            flushBuffer();
+            if (total >= m_capacity) {
+                size_t ret = m_stream->writev(spans, num_spans);
+                m_base += ret;
+                return ret;
+            }
+        }
+        for (int i = 0; i < num_spans; ++i) {
+            memcpy(m_data + m_pos, spans[i].data, spans[i].size);
+            m_pos += spans[i].size;
+        }
+        m_size = std::max<size_t>(m_size, m_pos);
+        return total;
+    }
+
+    void flush() override
+    {
+        flushBuffer();
+        m_stream->flush();
+    }
+
+    bool getStats(fcStreamStats& dst) override
+    {
+        return m_stream->getStats(dst);
+    }
+
+    bool isSeekable() override
+    {
+        return m_stream->isSeekable();
+    }
+
+private:
+    BufferedStream(const BufferedStream&) = delete;
+    BufferedStream& operator=(const BufferedStream&) = delete;
+
+    void flushBuffer()
+    {
+        if (m_size == 0) { return; }
+        m_stream->write(m_data, m_size);
+        if (m_pos != m_size) {
+            m_stream->seekp(m_base + m_pos);
+        }
+        m_base += m_pos;
+        m_pos = m_size = 0;
+    }
+
+    BinaryStream *m_stream = nullptr;
+    char *m_data = nullptr;
+    size_t m_capacity = 0;
+    size_t m_base = 0;  // position of m_data[0] in the underlying stream
+    size_t m_pos = 0;   // write position in m_data
+    size_t m_size = 0;  // valid bytes in m_data
+};
@@ -0,0 +1,804 @@
+#include "pch.h"
+#include "fcInternal.h"
+#include "Buffer.h"
+#include "FileStream.h"
+
+#if defined(fcLinux) || defined(fcMac) || defined(fcAndroid)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <cerrno>
+
+#if defined(fcLinux) && defined(__has_include)
+    #if __has_include(<linux/io_uring.h>)
+        #include <linux/io_uring.h>
+        #include <sys/mman.h>
+        #include <sys/syscall.h>
+        #ifdef __NR_io_uring_setup
+            #define fcSupportIOUring
+        #endif
+    #endif
+#endif
+
+namespace {
+
+const size_t fcDirectIOAlignment = 4096;
+const size_t fcDirectIOStagingSize = 4 * 1024 * 1024;
+
+bool PWriteAll(int fd, const void *data, size_t len, size_t pos)
+{
+    auto *src = (const char*)data;
+    while (len > 0) {
+        ssize_t r = ::pwrite(fd, src, len, (off_t)pos);
+        if (r < 0) {
+            if (errno == EINTR) { continue; }
+            return false;
+        }
+        src += r;
+        pos += r;
+        len -= r;
+    }
+    return true;
+}
+
+class PosixFileStream : public BinaryStream
+{
+public:
+    PosixFileStream(int fd, int direct_fd, bool preallocated)
+        : m_fd(fd)
+        , m_direct_fd(direct_fd)
+        , m_preallocated(preallocated)
+    {
+        if (m_direct_fd >= 0) {
+            m_stage = (char*)AlignedAlloc(fcDirectIOStagingSize, fcDirectIOAlignment);
+        }
+    }
+
+    ~PosixFileStream() override
+    {
+        flush();
+        if (m_preallocated) {
+            // drop the unused part of preallocation
+            if (::ftruncate(m_fd, (off_t)m_end) != 0) {
+                fcDebugLog("PosixFileStream: ftruncate() failed (%d)\n", errno);
+            }
+        }
+        if (m_direct_fd >= 0) { ::close(m_direct_fd); }
+        ::close(m_fd);
+        AlignedFree(m_stage);
+    }
+
+    size_t tellg() override
+    {
+        return m_rpos;
+    }
+
+    void seekg(size_t pos) override
+    {
+        m_rpos = pos;
+    }
+
+    size_t read(void *dst, size_t len) override
+    {
+        flush();
+        ssize_t r;
+        do {
+            r = ::pread(m_fd, dst, len, (off_t)m_rpos);
+        } while (r < 0 && errno == EINTR);
+        if (r <= 0) { return 0; }
+        m_rpos += r;
+        return (size_t)r;
+    }
+
+
+    size_t tellp() override
+    {
+        return m_pos;
+    }
+
+    void seekp(size_t pos) override
+    {
+        // direct mode can't leave holes in the staging block
+        m_pos = m_direct_fd >= 0 ? std::min<size_t>(pos, m_end) : pos;
+    }
+
+    size_t write(const void *data, size_t len) override
+    {
+        if (m_direct_fd < 0) {
+            if (!PWriteAll(m_fd, data, len, m_pos)) {
+                return 0;
+            }
+            m_pos += len;
+            m_end = std::max<size_t>(m_end, m_pos);
+            return len;
+        }
+
+        auto *src = (const char*)data;
+        size_t rest = len;
+
+        // back-patch of the area already written with O_DIRECT. go through the page cache.
+        if (m_pos < m_stage_base) {
+            size_t n = std::min<size_t>(rest, m_stage_base - m_pos);
+            if (!PWriteAll(m_fd, src, n, m_pos)) {
+                return 0;
+            }
+            src += n;
+            rest -= n;
+            m_pos += n;
+        }
+
+        while (rest > 0) {
+            size_t offset = m_pos - m_stage_base;
+            size_t n = std::min<size_t>(rest, fcDirectIOStagingSize - offset);
+            memcpy(m_stage + offset, src, n);
+            src += n;
+            rest -= n;
+            m_pos += n;
+            m_stage_size = std::max<size_t>(m_stage_size, offset + n);
+            m_end = std::max<size_t>(m_end, m_pos);
+            if (m_stage_size == fcDirectIOStagingSize) {
+                flushStage();
+            }
+        }
+        return len;
+    }
+
+    void flush() override
+    {
+        // the partial block goes through the page cache but stays in the staging buffer.
+        // it is written again with O_DIRECT once the block is full.
+        if (m_direct_fd >= 0 && m_stage_size > 0) {
+            PWriteAll(m_fd, m_stage, m_stage_size, m_stage_base);
+        }
+    }
+
+private:
+    void flushStage()
+    {
+        if (!PWriteAll(m_direct_fd, m_stage, m_stage_size, m_stage_base)) {
+            // direct write rejected (alignment requirements of the device etc.). fall back to normal I/O.
+            fcDebugLog("PosixFileStream: O_DIRECT write failed (%d). falling back.\n", errno);
+            PWriteAll(m_fd, m_stage, m_stage_size, m_stage_base);
+        }
+        m_stage_base += m_stage_size;
+        m_stage_size = 0;
+    }
+
+    int m_fd = -1;          // regular fd. used for all I/O in normal mode and for unaligned writes in direct mode.
+    int m_direct_fd = -1;   // O_DIRECT fd. -1 if direct I/O is not used.
+    bool m_preallocated = false;
+    size_t m_rpos = 0;
+    size_t m_pos = 0;
+    size_t m_end = 0;       // logical file size
+
+    // direct mode: data from m_stage_base (always aligned) to m_end
+    char *m_stage = nullptr;
+    size_t m_stage_base = 0;
+    size_t m_stage_size = 0;
+};
+
+// a write in flight. the block must not be touched until its completion is reaped.
+struct AsyncWriteCompletion
+{
+    int block = -1;
+    ssize_t result = 0; // written bytes or -errno
+    std::chrono::steady_clock::time_point completed;
+};
+
+class AsyncWriteBackend
+{
+public:
+    virtual ~AsyncWriteBackend() {}
+    virtual bool isIOUring() const = 0;
+    virtual bool submit(int block, int fd, size_t len, size_t pos) = 0;
+    // return false if no completion is ready (wait == false) or nothing is in flight
+    virtual bool reap(AsyncWriteCompletion& dst, bool wait) = 0;
+};
+
+
+// fallback backend. a dedicated thread does pwrite() so that blocking I/O doesn't occupy workers of the thread pool.
+class ThreadWriteBackend : public AsyncWriteBackend
+{
+public:
+    using Lock = std::unique_lock<std::mutex>;
+
+    ThreadWriteBackend(const std::vector<char*>& blocks)
+        : m_blocks(blocks)
+    {
+        m_thread = std::thread([this]() { process(); });
+    }
+
+    ~ThreadWriteBackend() override
+    {
+        {
+            Lock l(m_mutex);
+            m_stop = true;
+        }
+        m_cond_request.notify_all();
+        m_thread.join();
+    }
+
+    bool isIOUring() const override { return false; }
+
+    bool submit(int block, int fd, size_t len, size_t pos) override
+    {
+        {
+            Lock l(m_mutex);
+            m_requests.push_back({ block, fd, len, pos });
+            ++m_in_flight;
+        }
+        m_cond_request.notify_one();
+        return true;
+    }
+
+    bool reap(AsyncWriteCompletion& dst, bool wait) override
+    {
+        Lock l(m_mutex);
+        if (wait) {
+            m_cond_done.wait(l, [this]() { return !m_done.empty() || m_in_flight == 0; });
+        }
+        if (m_done.empty()) { return false; }
+        dst = m_done.front();
+        m_done.pop_front();
+        return true;
+    }
+
+private:
+    struct Request
+    {
+        int block;
+        int fd;
+        size_t len;
+        size_t pos;
+    };
+
+    void process()
+    {
+        for (;;) {
+            Request r;
+            {
+                Lock l(m_mutex);
+                m_cond_request.wait(l, [this]() { return m_stop || !m_requests.empty(); });
+                if (m_requests.empty()) { break; }
+                r = m_requests.front();
+                m_requests.pop_front();
+            }
+
+            AsyncWriteCompletion c;
+            c.block = r.block;
+            c.result = PWriteAll(r.fd, m_blocks[r.block], r.len, r.pos) ? (ssize_t)r.len : -errno;
+            c.completed = std::chrono::steady_clock::now();
+            {
+                Lock l(m_mutex);
+                m_done.push_back(c);
+                --m_in_flight;
+            }
+            m_cond_done.notify_one();
+        }
+    }
+
+    std::vector<char*> m_blocks;
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_cond_request;
+    std::condition_variable m_cond_done;
+    std::deque<Request> m_requests;
+    std::deque<AsyncWriteCompletion> m_done;
+    int m_in_flight = 0;
+    bool m_stop = false;
+};
+
+
+#ifdef fcSupportIOUring
+// io_uring backend. talks to the kernel with raw syscalls so that liburing is not needed.
+// blocks are registered as fixed buffers if possible (IORING_OP_WRITE_FIXED). otherwise IORING_OP_WRITEV is used.
+// only the thread that owns the stream submits and reaps, so the rings need no locking.
+// the kernel doesn't tell when a write finished. completion time is when it is reaped, which is an upper bound.
+class IOUringWriteBackend : public AsyncWriteBackend
+{
+public:
+    static IOUringWriteBackend* create(const std::vector<char*>& blocks, size_t block_size)
+    {
+        auto *ret = new IOUringWriteBackend();
+        if (!ret->setup(blocks, block_size)) {
+            delete ret;
+            ret = nullptr;
+        }
+        return ret;
+    }
+
+    ~IOUringWriteBackend() override
+    {
+        if (m_sqes) { ::munmap(m_sqes, m_sqes_size); }
+        if (m_cq_ptr && m_cq_ptr != m_sq_ptr) { ::munmap(m_cq_ptr, m_cq_size); }
+        if (m_sq_ptr) { ::munmap(m_sq_ptr, m_sq_size); }
+        if (m_ring >= 0) { ::close(m_ring); }
+    }
+
+    bool isIOUring() const override { return true; }
+
+    bool submit(int block, int fd, size_t len, size_t pos) override
+    {
+        unsigned tail = *m_sq_tail;
+        unsigned index = tail & *m_sq_mask;
+        io_uring_sqe *sqe = &m_sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        if (m_fixed) {
+            sqe->opcode = IORING_OP_WRITE_FIXED;
+            sqe->addr = (uint64_t)(uintptr_t)m_iovecs[block].iov_base;
+            sqe->len = (uint32_t)len;
+            sqe->buf_index = (uint16_t)block;
+        }
+        else {
+            m_iovecs[block].iov_len = len;
+            sqe->opcode = IORING_OP_WRITEV;
+            sqe->addr = (uint64_t)(uintptr_t)&m_iovecs[block];
+            sqe->len = 1;
+        }
+        sqe->fd = fd;
+        sqe->off = pos;
+        sqe->user_data = (uint64_t)block;
+        m_sq_array[index] = index;
+        __atomic_store_n(m_sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+        int r;
+        do {
+            r = enter(1, 0, 0);
+        } while (r < 0 && errno == EINTR);
+        if (r < 1 && __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE) == tail) {
+            // the kernel didn't take the sqe. take it back, otherwise a later enter() would submit it
+            // after the caller has written and reused the block.
+            __atomic_store_n(m_sq_tail, tail, __ATOMIC_RELEASE);
+            fcDebugLog("IOUringWriteBackend: io_uring_enter() failed (%d)\n", r < 0 ? errno : 0);
+            return false;
+        }
+        ++m_in_flight;
+        return true;
+    }
+
+    bool reap(AsyncWriteCompletion& dst, bool wait) override
+    {
+        for (;;) {
+            unsigned head = *m_cq_head;
+            unsigned tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+            if (head != tail) {
+                io_uring_cqe *cqe = &m_cqes[head & *m_cq_mask];
+                dst.block = (int)cqe->user_data;
+                dst.result = cqe->res;
+                dst.completed = std::chrono::steady_clock::now();
+                __atomic_store_n(m_cq_head, head + 1, __ATOMIC_RELEASE);
+                --m_in_flight;
+                return true;
+            }
+            if (!wait || m_in_flight == 0) { return false; }
+            if (enter(0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+                return false;
+            }
+        }
+    }
+
+private:
+    IOUringWriteBackend() {}
+
+    int enter(unsigned to_submit, unsigned min_complete, unsigned flags)
+    {
+        return (int)::syscall(__NR_io_uring_enter, m_ring, to_submit, min_complete, flags, nullptr, 0);
+    }
+
+    bool setup(const std::vector<char*>& blocks, size_t block_size)
+    {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        m_ring = (int)::syscall(__NR_io_uring_setup, (unsigned)blocks.size(), &params);
+        if (m_ring < 0) {
+            // ENOSYS on old kernels, EPERM if disabled by sysctl or seccomp
+            fcDebugLog("IOUringWriteBackend: io_uring is not available (%d)\n", errno);
+            return false;
+        }
+
+        m_sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        m_cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single_mmap) {
+            m_sq_size = m_cq_size = std::max<size_t>(m_sq_size, m_cq_size);
+        }
+
+        m_sq_ptr = ::mmap(nullptr, m_sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring, IORING_OFF_SQ_RING);
+        if (m_sq_ptr == MAP_FAILED) { m_sq_ptr = nullptr; return false; }
+        if (single_mmap) {
+            m_cq_ptr = m_sq_ptr;
+        }
+        else {
+            m_cq_ptr = ::mmap(nullptr, m_cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring, IORING_OFF_CQ_RING);
+            if (m_cq_ptr == MAP_FAILED) { m_cq_ptr = nullptr; return false; }
+        }
+        m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        m_sqes = (io_uring_sqe*)::mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring, IORING_OFF_SQES);
+        if (m_sqes == MAP_FAILED) { m_sqes = nullptr; return false; }
+
+        auto *sq = (char*)m_sq_ptr;
+        m_sq_head = (unsigned*)(sq + params.sq_off.head);
+        m_sq_tail = (unsigned*)(sq + params.sq_off.tail);
+        m_sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+        m_sq_array = (unsigned*)(sq + params.sq_off.array);
+        auto *cq = (char*)m_cq_ptr;
+        m_cq_head = (unsigned*)(cq + params.cq_off.head);
+        m_cq_tail = (unsigned*)(cq + params.cq_off.tail);
+        m_cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+        m_cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+
+        m_iovecs.resize(blocks.size());
+        for (size_t i = 0; i < blocks.size(); ++i) {
+            m_iovecs[i].iov_base = blocks[i];
+            m_iovecs[i].iov_len = block_size;
+        }
+        // may fail by RLIMIT_MEMLOCK. not fatal.
+        m_fixed = ::syscall(__NR_io_uring_register, m_ring, IORING_REGISTER_BUFFERS, m_iovecs.data(), (unsigned)m_iovecs.size()) == 0;
+        return true;
+    }
+
+    int m_ring = -1;
+    void *m_sq_ptr = nullptr;
+    void *m_cq_ptr = nullptr;
+    size_t m_sq_size = 0;
+    size_t m_cq_size = 0;
+    io_uring_sqe *m_sqes = nullptr;
+    size_t m_sqes_size = 0;
+
+    unsigned *m_sq_head = nullptr;
+    unsigned *m_sq_tail = nullptr;
+    unsigned *m_sq_mask = nullptr;
+    unsigned *m_sq_array = nullptr;
+    unsigned *m_cq_head = nullptr;
+    unsigned *m_cq_tail = nullptr;
+    unsigned *m_cq_mask = nullptr;
+    io_uring_cqe *m_cqes = nullptr;
+
+    std::vector<iovec> m_iovecs;
+    bool m_fixed = false;
+    int m_in_flight = 0;
+};
+#endif // fcSupportIOUring
+
+
+// appends are collected in fixed-size blocks and each full block is written in the background.
+// back-patches before the current block wait for writes in flight and go synchronously.
+class AsyncFileStream : public BinaryStream
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    AsyncFileStream(int fd, int direct_fd, bool preallocated, size_t block_size, int queue_depth)
+        : m_fd(fd)
+        , m_direct_fd(direct_fd)
+        , m_preallocated(preallocated)
+        , m_block_size(block_size)
+        , m_max_in_flight(queue_depth)
+    {
+        // +1: the block being filled
+        int num_blocks = queue_depth + 1;
+        m_blocks.resize(num_blocks);
+        m_block_info.resize(num_blocks);
+        for (auto& b : m_blocks) {
+            b = (char*)AlignedAlloc(m_block_size, fcDirectIOAlignment);
+        }
+#ifdef fcSupportIOUring
+        m_backend.reset(IOUringWriteBackend::create(m_blocks, m_block_size));
+#endif
+        if (!m_backend) {
+            m_backend.reset(new ThreadWriteBackend(m_blocks));
+        }
+
+        for (int i = num_blocks - 1; i > 0; --i) {
+            m_free.push_back(i);
+        }
+        m_current = 0;
+    }
+
+    ~AsyncFileStream() override
+    {
+        flush();
+        m_backend.reset();
+        if (m_preallocated) {
+            if (::ftruncate(m_fd, (off_t)m_end) != 0) {
+                fcDebugLog("AsyncFileStream: ftruncate() failed (%d)\n", errno);
+            }
+        }
+        if (m_direct_fd >= 0) { ::close(m_direct_fd); }
+        ::close(m_fd);
+        for (auto b : m_blocks) { AlignedFree(b); }
+    }
+
+    size_t tellg() override
+    {
+        return m_rpos;
+    }
+
+    void seekg(size_t pos) override
+    {
+        m_rpos = pos;
+    }
+
+    size_t read(void *dst, size_t len) override
+    {
+        flush();
+        ssize_t r;
+        do {
+            r = ::pread(m_fd, dst, len, (off_t)m_rpos);
+        } while (r < 0 && errno == EINTR);
+        if (r <= 0) { return 0; }
+        m_rpos += r;
+        return (size_t)r;
+    }
+
+
+    size_t tellp() override
+    {
+        return m_pos;
+    }
+
+    void seekp(size_t pos) override
+    {
+        // blocks are contiguous. holes are not allowed.
+        m_pos = std::min<size_t>(pos, m_end);
+    }
+
+    size_t write(const void *data, size_t len) override
+    {
+        auto *src = (const char*)data;
+        size_t rest = len;
+
+        if (m_pos < m_stage_base) {
+            // the area may be in flight. wait for it before overwriting.
+            drain();
+            size_t n = std::min<size_t>(rest, m_stage_base - m_pos);
+            if (!PWriteAll(m_fd, src, n, m_pos)) {
+                return 0;
+            }
+            src += n;
+            rest -= n;
+            m_pos += n;
+        }
+
+        while (rest > 0) {
+            size_t offset = m_pos - m_stage_base;
+            size_t n = std::min<size_t>(rest, m_block_size - offset);
+            memcpy(m_blocks[m_current] + offset, src, n);
+            src += n;
+            rest -= n;
+            m_pos += n;
+            m_stage_size = std::max<size_t>(m_stage_size, offset + n);
+            m_end = std::max<size_t>(m_end, m_pos);
+            if (m_stage_size == m_block_size) {
+                submitCurrent();
+            }
+        }
+        return len;
+    }
+
+    void flush() override
+    {
+        drain();
+        // the partial block is written synchronously but kept. it is submitted again once it is full.
+        if (m_stage_size > 0) {
+            PWriteAll(m_fd, m_blocks[m_current], m_stage_size, m_stage_base);
+        }
+    }
+
+    bool getStats(fcStreamStats& dst) override
+    {
+        dst.io_uring = m_backend->isIOUring();
+        dst.queue_depth = m_queue_depth.load(std::memory_order_relaxed);
+        dst.max_queue_depth = m_max_queue_depth.load(std::memory_order_relaxed);
+        dst.bytes_in_flight = m_bytes_in_flight.load(std::memory_order_relaxed);
+        dst.bytes_written = m_bytes_written.load(std::memory_order_relaxed);
+        dst.num_writes = m_num_writes.load(std::memory_order_relaxed);
+        dst.total_latency = (double)m_total_latency.load(std::memory_order_relaxed) / 1000000000.0;
+        dst.max_latency = (double)m_max_latency.load(std::memory_order_relaxed) / 1000000000.0;
+        return true;
+    }
+
+private:
+    struct BlockInfo
+    {
+        size_t pos = 0;
+        size_t len = 0;
+        Clock::time_point submitted;
+        bool in_flight = false;
+    };
+
+    void submitCurrent()
+    {
+        while (m_queue_depth >= m_max_in_flight) {
+            if (!waitOne()) { break; }
+        }
+
+        int b = m_current;
+        auto& info = m_block_info[b];
+        info.pos = m_stage_base;
+        info.len = m_stage_size;
+        info.submitted = Clock::now();
+
+        // blocks start at multiples of the block size. full blocks can go with O_DIRECT.
+        int fd = m_direct_fd >= 0 && info.len == m_block_size ? m_direct_fd : m_fd;
+        if (m_backend->submit(b, fd, info.len, info.pos)) {
+            info.in_flight = true;
+            int depth = ++m_queue_depth;
+            if (depth > m_max_queue_depth) { m_max_queue_depth = depth; }
+            m_bytes_in_flight += info.len;
+        }
+        else {
+            PWriteAll(m_fd, m_blocks[b], info.len, info.pos);
+            m_free.push_back(b);
+        }
+
+        m_stage_base += m_stage_size;
+        m_stage_size = 0;
+        m_current = acquireBlock();
+    }
+
+    int acquireBlock()
+    {
+        while (reapOne(false)) {}
+        // blocks are either free, in flight or current. waitOne() reclaims at least one in flight block.
+        while (m_free.empty()) {
+            waitOne();
+        }
+        int ret = m_free.back();
+        m_free.pop_back();
+        return ret;
+    }
+
+    bool reapOne(bool wait)
+    {
+        AsyncWriteCompletion c;
+        if (!m_backend->reap(c, wait)) { return false; }
+
+        auto& info = m_block_info[c.block];
+        info.in_flight = false;
+        if (c.result < (ssize_t)info.len) {
+            // error (e.g. O_DIRECT rejected by the device) or short write. finish it synchronously.
+            size_t done = c.result > 0 ? (size_t)c.result : 0;
+            if (c.result < 0) {
+                fcDebugLog("AsyncFileStream: async write failed (%d). retrying synchronously.\n", (int)-c.result);
+            }
+            PWriteAll(m_fd, m_blocks[c.block] + done, info.len - done, info.pos + done);
+        }
+
+        auto latency = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(c.completed - info.submitted).count();
+        --m_queue_depth;
+        m_bytes_in_flight -= info.len;
+        m_bytes_written += info.len;
+        ++m_num_writes;
+        m_total_latency += latency;
+        if (latency > m_max_latency) { m_max_latency = latency; }
+
+        m_free.push_back(c.block);
+        return true;
+    }
+
+    // wait for a write in flight. return false if nothing is in flight.
+    bool waitOne()
+    {
+        if (reapOne(true)) { return true; }
+        if (m_queue_depth == 0) { return false; }
+
+        // the backend can't reap anymore (io_uring_enter() failed etc.). write the blocks in flight synchronously,
+        // reclaim them and continue with the thread backend.
+        fcDebugLog("AsyncFileStream: failed to reap async writes. falling back to the thread backend.\n");
+        m_backend.reset(new ThreadWriteBackend(m_blocks));
+        for (int b = 0; b < (int)m_blocks.size(); ++b) {
+            auto& info = m_block_info[b];
+            if (!info.in_flight) { continue; }
+            PWriteAll(m_fd, m_blocks[b], info.len, info.pos);
+            info.in_flight = false;
+            --m_queue_depth;
+            m_bytes_in_flight -= info.len;
+            m_bytes_written += info.len;
+            ++m_num_writes;
+            m_free.push_back(b);
+        }
+        return true;
+    }
+
+    void drain()
+    {
+        while (waitOne()) {}
+    }
+
+    int m_fd = -1;
+    int m_direct_fd = -1;
+    bool m_preallocated = false;
+    size_t m_block_size = 0;
+    int m_max_in_flight = 0;
+    size_t m_rpos = 0;
+    size_t m_pos = 0;
+    size_t m_end = 0;
+
+    std::unique_ptr<AsyncWriteBackend> m_backend;
+    std::vector<char*> m_blocks;
+    std::vector<BlockInfo> m_block_info;
+    std::vector<int> m_free;
+    int m_current = 0;
+    size_t m_stage_base = 0;
+    size_t m_stage_size = 0;
+
+    // telemetry. written by the writing thread, read by fcStreamGetStats() from any thread.
+    std::atomic_int         m_queue_depth = { 0 };
+    std::atomic_int         m_max_queue_depth = { 0 };
+    std::atomic<uint64_t>   m_bytes_in_flight = { 0 };
+    std::atomic<uint64_t>   m_bytes_written = { 0 };
+    std::atomic<uint64_t>   m_num_writes = { 0 };
+    std::atomic<uint64_t>   m_total_latency = { 0 }; // in nanoseconds
+    std::atomic<uint64_t>   m_max_latency = { 0 };   // in nanoseconds
+};
+
+
+bool OpenFile(const char *path, const fcFileStreamConfig& conf, int& fd, int& direct_fd, bool& preallocated)
+{
+    fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        fcDebugLog("OpenFile: failed to open %s (%d)\n", path, errno);
+        return false;
+    }
+
+    preallocated = false;
+#if defined(fcLinux) || defined(fcAndroid)
+    if (conf.expected_size > 0) {
+        preallocated = ::posix_fallocate(fd, 0, (off_t)conf.expected_size) == 0;
+    }
+#endif
+
+    direct_fd = -1;
+    if (conf.direct_io) {
+#if defined(fcLinux) || defined(fcAndroid)
+        // may fail on file systems that don't support O_DIRECT (tmpfs etc.). normal I/O is used in that case.
+        direct_fd = ::open(path, O_WRONLY | O_DIRECT | O_CLOEXEC);
+#elif defined(fcMac)
+        direct_fd = ::open(path, O_WRONLY | O_CLOEXEC);
+        if (direct_fd >= 0) { ::fcntl(direct_fd, F_NOCACHE, 1); }
+#endif
+    }
+    return true;
+}
+
+} // namespace
+
+BinaryStream* CreatePosixFileStream(const char *path, const fcFileStreamConfig& conf)
+{
+    int fd, direct_fd;
+    bool preallocated;
+    if (!OpenFile(path, conf, fd, direct_fd, preallocated)) {
+        return nullptr;
+    }
+    return new PosixFileStream(fd, direct_fd, preallocated);
+}
+
+BinaryStream* CreateAsyncFileStream(const char *path, const fcFileStreamConfig& conf)
+{
+    int fd, direct_fd;
+    bool preallocated;
+    if (!OpenFile(path, conf, fd, direct_fd, preallocated)) {
+        return nullptr;
+    }
+    // round up to the alignment of direct I/O
+    size_t block_size = conf.async_block_size > 0 ? (size_t)conf.async_block_size : BufferedStream::DefaultBlockSize;
+    block_size = (block_size + fcDirectIOAlignment - 1) & ~(fcDirectIOAlignment - 1);
+    int queue_depth = std::max<int>(conf.async_queue_depth, 1);
+    return new AsyncFileStream(fd, direct_fd, preallocated, block_size, queue_depth);
+}
+
+#else // POSIX
+
+BinaryStream* CreatePosixFileStream(const char *path, const fcFileStreamConfig& conf)
+{
+    return nullptr;
+}
+
+BinaryStream* CreateAsyncFileStream(const char *path, const fcFileStreamConfig& conf)
+{
+    return nullptr;
+}
+
+#endif // POSIX
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "Buffer.h"
+
+// fd-based file stream (POSIX only). no iostream locking and no extra copy.
+// writes go to pwrite() at the tracked position, so seekp() for header fix-ups is just an assignment.
+// with conf.direct_io, appends are staged in an aligned block and written with O_DIRECT in whole blocks.
+// returns nullptr if the platform is not supported or the file can't be opened.
+BinaryStream* CreatePosixFileStream(const char *path, const fcFileStreamConfig& conf);
+
+// appends are collected in blocks and full blocks are written in the background (conf.async_io).
+// Linux uses io_uring if the kernel allows it. otherwise (and on other POSIX platforms) a writer thread does pwrite().
+// the stream itself must be used from one thread at a time. getStats() can be called from any thread.
+BinaryStream* CreateAsyncFileStream(const char *path, const fcFileStreamConfig& conf);
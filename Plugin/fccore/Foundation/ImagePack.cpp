@@ -0,0 +1,243 @@
+#include "pch.h"
+#include "fcInternal.h"
+#include "Buffer.h"
+#include "ImagePack.h"
+
+static const char g_index_magic[8] = { 'F', 'C', 'P', 'K', 'I', 'D', 'X', '1' };
+static const size_t g_tar_block = 512;
+
+// archives can exceed 2GB
+static int PackSeek(FILE *f, uint64_t pos)
+{
+#ifdef _WIN32
+    return _fseeki64(f, (int64_t)pos, SEEK_SET);
+#else
+    return fseeko(f, (off_t)pos, SEEK_SET);
+#endif
+}
+
+static void StoreU64LE(char *dst, uint64_t v)
+{
+    for (int i = 0; i < 8; ++i) { dst[i] = (char)(v >> (i * 8)); }
+}
+
+static uint64_t LoadU64LE(const char *src)
+{
+    uint64_t ret = 0;
+    for (int i = 0; i < 8; ++i) { ret |= (uint64_t)(uint8_t)src[i] << (i * 8); }
+    return ret;
+}
+
+static const char* GetFileName(const char *path)
+{
+    const char *ret = path;
+    for (const char *p = path; *p; ++p) {
+        if (*p == '/' || *p == '\\') { ret = p + 1; }
+    }
+    return ret;
+}
+
+// octal number, NUL terminated, right aligned in a field of width bytes
+static void PutOctal(char *dst, size_t width, uint64_t v)
+{
+    dst[width - 1] = '\0';
+    for (size_t i = width - 1; i > 0; --i) {
+        dst[i - 1] = (char)('0' + (v & 7));
+        v >>= 3;
+    }
+}
+
+static uint64_t GetOctal(const char *src, size_t width)
+{
+    uint64_t ret = 0;
+    for (size_t i = 0; i < width && src[i] >= '0' && src[i] <= '7'; ++i) {
+        ret = (ret << 3) | (uint64_t)(src[i] - '0');
+    }
+    return ret;
+}
+
+static void MakeTarHeader(char *dst, const char *name, uint64_t size, uint64_t mtime)
+{
+    memset(dst, 0, g_tar_block);
+    strncpy(dst, name, 100);
+    PutOctal(dst + 100, 8, 0644);   // mode
+    PutOctal(dst + 108, 8, 0);      // uid
+    PutOctal(dst + 116, 8, 0);      // gid
+    PutOctal(dst + 124, 12, size);
+    PutOctal(dst + 136, 12, mtime);
+    dst[156] = '0';                 // regular file
+    memcpy(dst + 257, "ustar", 6);
+    memcpy(dst + 263, "00", 2);
+
+    // checksum is computed with the checksum field filled with spaces
+    memset(dst + 148, ' ', 8);
+    uint32_t sum = 0;
+    for (size_t i = 0; i < g_tar_block; ++i) { sum += (uint8_t)dst[i]; }
+    PutOctal(dst + 148, 7, sum);
+    dst[155] = ' ';
+}
+
+// copy size bytes from fin to the file at dst_path
+static bool CopyToFile(FILE *fin, uint64_t size, const char *dst_path)
+{
+    FILE *fout = fopen(dst_path, "wb");
+    if (!fout) {
+        fcDebugLog("ImagePack: failed to create %s\n", dst_path);
+        return false;
+    }
+    char buf[64 * 1024];
+    bool ret = true;
+    while (size > 0) {
+        size_t n = (size_t)std::min<uint64_t>(size, sizeof(buf));
+        if (fread(buf, 1, n, fin) != n || fwrite(buf, 1, n, fout) != n) {
+            ret = false;
+            break;
+        }
+        size -= n;
+    }
+    fclose(fout);
+    return ret;
+}
+
+
+ImagePack::ImagePack(BinaryStream *stream, FILE *index)
+    : m_stream(stream)
+    , m_index(index)
+{
+    m_stream->addRef();
+    m_pos = m_stream->tellp();
+}
+
+ImagePack::~ImagePack()
+{
+    // end of archive: two zero blocks
+    char zero[g_tar_block * 2] = {};
+    m_stream->write(zero, sizeof(zero));
+    m_stream->flush();
+    m_stream->release();
+    if (m_index) {
+        fclose(m_index);
+    }
+}
+
+bool ImagePack::add(const char *path, const void *data, size_t size)
+{
+    const char *name = GetFileName(path);
+    size_t name_len = strlen(name);
+    if (name_len == 0 || name_len > MaxNameLength) {
+        fcDebugLog("ImagePack::add(): invalid entry name %s\n", name);
+        return false;
+    }
+
+    char header[g_tar_block];
+    MakeTarHeader(header, name, size, (uint64_t)::time(nullptr));
+    static const char padding[g_tar_block] = {};
+    size_t padding_size = (g_tar_block - size % g_tar_block) % g_tar_block;
+
+    fcWriteSpan spans[3];
+    spans[0].data = header;
+    spans[0].size = sizeof(header);
+    spans[1].data = data;
+    spans[1].size = size;
+    spans[2].data = padding;
+    spans[2].size = padding_size;
+
+    std::unique_lock<std::mutex> l(m_mutex);
+    if (m_broken) {
+        fcDebugLog("ImagePack::add(): archive is broken by a previous write failure. %s is dropped\n", name);
+        return false;
+    }
+    uint64_t data_pos = m_pos + g_tar_block;
+    size_t entry_size = sizeof(header) + size + padding_size;
+    if (m_stream->writev(spans, padding_size > 0 ? 3 : 2) != entry_size) {
+        fcDebugLog("ImagePack::add(): write failed. %s is dropped\n", name);
+        m_broken = true;
+        return false;
+    }
+    m_pos += entry_size;
+    ++m_num_entries;
+
+    if (m_index) {
+        char record[IndexRecordSize] = {};
+        StoreU64LE(record, data_pos);
+        StoreU64LE(record + 8, size);
+        memcpy(record + 16, name, name_len);
+        fwrite(record, 1, sizeof(record), m_index);
+        fflush(m_index);
+    }
+    return true;
+}
+
+int ImagePack::getNumEntries()
+{
+    std::unique_lock<std::mutex> l(m_mutex);
+    return m_num_entries;
+}
+
+
+ImagePack* CreateImagePack(BinaryStream *stream, const char *index_path)
+{
+    if (!stream) { return nullptr; }
+
+    FILE *index = nullptr;
+    if (index_path) {
+        index = fopen(index_path, "wb");
+        if (!index) {
+            fcDebugLog("CreateImagePack(): failed to create index %s\n", index_path);
+            return nullptr;
+        }
+        fwrite(g_index_magic, 1, sizeof(g_index_magic), index);
+        fflush(index);
+    }
+    return new ImagePack(stream, index);
+}
+
+int ExtractImagePack(const char *pack_path, const char *dst_dir)
+{
+    FILE *fin = fopen(pack_path, "rb");
+    if (!fin) { return -1; }
+
+    int ret = 0;
+    char header[g_tar_block];
+    while (fread(header, 1, sizeof(header), fin) == sizeof(header)) {
+        if (header[0] == '\0') { break; } // end of archive
+
+        char name[101] = {};
+        memcpy(name, header, 100);
+        uint64_t size = GetOctal(header + 124, 12);
+        uint64_t padding_size = (g_tar_block - size % g_tar_block) % g_tar_block;
+
+        std::string dst_path = std::string(dst_dir) + "/" + GetFileName(name);
+        if (!CopyToFile(fin, size, dst_path.c_str())) {
+            break;
+        }
+        ++ret;
+        char padding[g_tar_block];
+        if (fread(padding, 1, (size_t)padding_size, fin) != padding_size) { break; }
+    }
+    fclose(fin);
+    return ret;
+}
+
+bool ExtractImagePackEntry(const char *pack_path, const char *index_path, int n, const char *dst_path)
+{
+    if (n < 0) { return false; }
+
+    char record[ImagePack::IndexRecordSize];
+    {
+        FILE *index = fopen(index_path, "rb");
+        if (!index) { return false; }
+        char magic[sizeof(g_index_magic)];
+        bool ok = fread(magic, 1, sizeof(magic), index) == sizeof(magic) && memcmp(magic, g_index_magic, sizeof(magic)) == 0 &&
+            PackSeek(index, ImagePack::IndexHeaderSize + ImagePack::IndexRecordSize * (uint64_t)n) == 0 &&
+            fread(record, 1, sizeof(record), index) == sizeof(record);
+        fclose(index);
+        if (!ok) { return false; }
+    }
+
+    FILE *fin = fopen(pack_path, "rb");
+    if (!fin) { return false; }
+    bool ret = PackSeek(fin, LoadU64LE(record)) == 0 && CopyToFile(fin, LoadU64LE(record + 8), dst_path);
+    fclose(fin);
+    return ret;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <atomic>
+#include <mutex>
+
+
+// appends encoded image files (PNG, EXR) to one uncompressed tar archive instead of creating a file per frame.
+// the archive is a standard ustar file that any tar tool can extract. each entry (header + data + padding) is
+// passed to the stream in one writev() call, so pre-allocated (fcFileStreamConfig::expected_size) and async
+// file streams work well as the sink.
+// a fixed size record per entry is appended to the index file, so n-th entry is located without scanning:
+//   "FCPKIDX1" (8 bytes), then 128 byte records of
+//   { uint64 data offset, uint64 data size, char name[104] (NUL padded), 8 reserved bytes }. little-endian.
+//   offsets are positions in the stream (tellp()), i.e. file offsets when the pack is written to a file stream.
+//   they equal archive-relative offsets only if the stream was at 0 when the pack was created.
+// reference-counted. contexts hold a reference while they use it. the archive is closed when the last one is released.
+class ImagePack
+{
+public:
+    static const size_t IndexHeaderSize = 8;
+    static const size_t IndexRecordSize = 128;
+    static const size_t MaxNameLength = 100; // ustar name field
+
+    ImagePack(BinaryStream *stream, FILE *index);
+    void addRef() { m_ref_count++; }
+    void release() { if (--m_ref_count == 0) { delete this; } }
+
+    // thread safe. entries are stored in the order of calls.
+    // entry name is the file name of path (directories are dropped). return false if it is too long or the write fails.
+    // a failed write leaves the archive in an unknown state, so all later adds fail too.
+    bool add(const char *path, const void *data, size_t size);
+    int getNumEntries();
+
+private:
+    ~ImagePack();
+
+    BinaryStream *m_stream = nullptr;
+    FILE *m_index = nullptr;
+    std::mutex m_mutex;
+    uint64_t m_pos = 0;         // stream position of the next entry. the stream may already have data before the archive
+    int m_num_entries = 0;
+    bool m_broken = false;
+    std::atomic_int m_ref_count = { 1 };
+};
+
+// index_path: null means no index. return nullptr if the index can't be created.
+ImagePack* CreateImagePack(BinaryStream *stream, const char *index_path);
+
+// extract all entries into dst_dir by walking the archive. the index is not needed.
+// the archive must start at the beginning of the file. return the number of extracted files, or -1 if it can't be read.
+int ExtractImagePack(const char *pack_path, const char *dst_dir);
+// extract n-th entry to dst_path. seeks directly to the file offset stored in the index.
+bool ExtractImagePackEntry(const char *pack_path, const char *index_path, int n, const char *dst_path);
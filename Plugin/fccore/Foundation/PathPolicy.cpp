@@ -0,0 +1,108 @@
+#include "pch.h"
+#include "fcInternal.h"
+#include "PathPolicy.h"
+#include <mutex>
+
+
+class StripedPathPolicy : public PathPolicy
+{
+public:
+    StripedPathPolicy(const char * const *directories, int num_directories, fcStripeMode mode);
+    ~StripedPathPolicy() override;
+    bool openManifest(const char *path);
+    std::string resolve(const char *name) override;
+
+private:
+    static std::string Join(const std::string& dir, const char *name);
+    static uint64_t Hash(const char *str);
+
+    std::vector<std::string> m_directories;
+    fcStripeMode m_mode = fcStripeMode::RoundRobin;
+    std::mutex m_mutex;
+    FILE *m_manifest = nullptr;
+    uint64_t m_seq = 0;
+};
+
+
+StripedPathPolicy::StripedPathPolicy(const char * const *directories, int num_directories, fcStripeMode mode)
+    : m_mode(mode)
+{
+    for (int i = 0; i < num_directories; ++i) {
+        if (directories[i] && directories[i][0] != '\0') {
+            m_directories.push_back(directories[i]);
+        }
+    }
+}
+
+StripedPathPolicy::~StripedPathPolicy()
+{
+    if (m_manifest) {
+        fclose(m_manifest);
+    }
+}
+
+bool StripedPathPolicy::openManifest(const char *path_)
+{
+    if (m_directories.empty()) { return false; }
+
+    std::string path = path_ ? path_ : Join(m_directories.front(), "stripe_manifest.txt");
+    m_manifest = fopen(path.c_str(), "wb");
+    if (!m_manifest) {
+        fcDebugLog("StripedPathPolicy: failed to create manifest %s\n", path.c_str());
+        return false;
+    }
+    fprintf(m_manifest, "# fccore stripe manifest\n");
+    for (size_t i = 0; i < m_directories.size(); ++i) {
+        fprintf(m_manifest, "dir\t%d\t%s\n", (int)i, m_directories[i].c_str());
+    }
+    fflush(m_manifest);
+    return true;
+}
+
+std::string StripedPathPolicy::resolve(const char *name)
+{
+    std::unique_lock<std::mutex> l(m_mutex);
+
+    uint64_t seq = m_seq++;
+    size_t n = m_directories.size();
+    size_t di = m_mode == fcStripeMode::Hash ? (size_t)(Hash(name) % n) : (size_t)(seq % n);
+
+    // flushed per entry so the manifest stays usable even if the process dies in the middle of capture
+    fprintf(m_manifest, "%llu\t%d\t%s\n", (unsigned long long)seq, (int)di, name);
+    fflush(m_manifest);
+    return Join(m_directories[di], name);
+}
+
+std::string StripedPathPolicy::Join(const std::string& dir, const char *name)
+{
+    std::string ret = dir;
+    char last = ret.back();
+    if (last != '/' && last != '\\') {
+        ret += '/';
+    }
+    ret += name;
+    return ret;
+}
+
+// FNV-1a. same name always goes to the same directory, so re-rendered frames overwrite old ones.
+uint64_t StripedPathPolicy::Hash(const char *str)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (; *str; ++str) {
+        h ^= (uint8_t)*str;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+
+PathPolicy* CreateStripedPathPolicy(const char * const *directories, int num_directories, fcStripeMode mode, const char *manifest_path)
+{
+    if (!directories || num_directories <= 0) { return nullptr; }
+    auto *ret = new StripedPathPolicy(directories, num_directories, mode);
+    if (!ret->openManifest(manifest_path)) {
+        ret->release();
+        return nullptr;
+    }
+    return ret;
+}
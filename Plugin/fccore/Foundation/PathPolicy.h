@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include <atomic>
+
+
+// maps file names given to image sequence contexts (PNG, EXR) to the paths actually written.
+// reference-counted. contexts hold a reference while they use it.
+class PathPolicy
+{
+public:
+    virtual ~PathPolicy() {}
+    void addRef() { m_ref_count++; }
+    void release() { if (--m_ref_count == 0) { delete this; } }
+
+    // called once per file in submission order. thread safe.
+    virtual std::string resolve(const char *name) = 0;
+
+private:
+    std::atomic_int m_ref_count = { 1 };
+};
+
+// spreads files across directories (typically on separate volumes) so sequence I/O scales with the number of disks.
+// every resolved file is appended to a text manifest in submission order:
+//   "# fccore stripe manifest" line, "dir\t<index>\t<directory>" lines, then "<seq>\t<dir index>\t<name>" per file.
+// manifest_path: null means "stripe_manifest.txt" in the first directory.
+// return nullptr if no directory is given or the manifest can't be created.
+PathPolicy* CreateStripedPathPolicy(const char * const *directories, int num_directories, fcStripeMode mode, const char *manifest_path);
@@ -2,9 +2,22 @@
 #include "fcInternal.h"
 #include "Buffer.h"
 #include "PixelFormat.h"
+#include "TaskGroup.h"
 
 #define fcEnableISPCKernel
 
+static std::atomic_int g_min_convert_band_size = { 128 * 1024 };
+
+void fcSetMinConvertBandSizeImpl(int num_pixels)
+{
+    g_min_convert_band_size = std::max<int>(num_pixels, 0);
+}
+
+int fcGetMinConvertBandSizeImpl()
+{
+    return g_min_convert_band_size;
+}
+
 
 int fcGetPixelSize(fcPixelFormat format)
 {
@@ -37,18 +50,30 @@ int fcGetPixelSize(fcPixelFormat format)
 }
 
 
+int fcGetPitch(int pitch, int width, fcPixelFormat fmt)
+{
+    return pitch != 0 ? pitch : width * fcGetPixelSize(fmt);
+}
+
+const void* fcGetTopRow(const void *pixels, int& pitch, int width, int height, fcPixelFormat fmt)
+{
+    pitch = fcGetPitch(pitch, width, fmt);
+    if (pitch < 0) {
+        return (const char*)pixels + (ptrdiff_t)-pitch * (height - 1);
+    }
+    return pixels;
+}
+
+
 void fcImageFlipY(void *image_, int width, int height, fcPixelFormat fmt)
 {
+    // swap rows in place. no temporary row.
     size_t pitch = width * fcGetPixelSize(fmt);
-    Buffer buf_((size_t)pitch);
     char *image = (char*)image_;
-    char *buf = &buf_[0];
-
     for (int y = 0; y < height / 2; ++y) {
-        int iy = height - y - 1;
-        memcpy(buf, image + (pitch*y), pitch);
-        memcpy(image + (pitch*y), image + (pitch*iy), pitch);
-        memcpy(image + (pitch*iy), buf, pitch);
+        char *a = image + pitch * y;
+        char *b = image + pitch * (height - y - 1);
+        std::swap_ranges(a, a + pitch, b);
     }
 }
 
@@ -298,7 +323,85 @@ const void* fcConvertPixelFormat_ISPC(void *dst, fcPixelFormat dstfmt, const voi
 
 fcAPI const void* fcConvertPixelFormat(void *dst, fcPixelFormat dstfmt, const void *src, fcPixelFormat srcfmt, size_t size)
 {
-    return fcConvertPixelFormat_ISPC(dst, dstfmt, src, srcfmt, size);
+    int band_size = fcGetMinConvertBandSizeImpl();
+    if (dstfmt == srcfmt || band_size == 0 || size <= (size_t)band_size) {
+        return fcConvertPixelFormat_ISPC(dst, dstfmt, src, srcfmt, size);
+    }
+
+    // kernels are per-pixel. split into bands and convert them in parallel.
+    size_t dst_psize = fcGetPixelSize(dstfmt);
+    size_t src_psize = fcGetPixelSize(srcfmt);
+    ParallelFor((int)size, band_size, [=](int begin, int end) {
+        fcConvertPixelFormat_ISPC((char*)dst + dst_psize * begin, dstfmt, (const char*)src + src_psize * begin, srcfmt, end - begin);
+    });
+    return dst;
+}
+
+fcAPI const void* fcConvertPixelFormat2D(void *dst, fcPixelFormat dstfmt, int dst_pitch,
+    const void *src, fcPixelFormat srcfmt, int src_pitch, int width, int height)
+{
+    int dst_row = width * fcGetPixelSize(dstfmt);
+    int src_row = width * fcGetPixelSize(srcfmt);
+    char *dst_top = (char*)fcGetTopRow(dst, dst_pitch, width, height, dstfmt);
+    const char *src_top = (const char*)fcGetTopRow(src, src_pitch, width, height, srcfmt);
+
+    if (dst_pitch == dst_row && src_pitch == src_row) {
+        // both are contiguous
+        if (dstfmt == srcfmt) {
+            memcpy(dst, src, (size_t)src_row * height);
+        }
+        else {
+            fcConvertPixelFormat(dst, dstfmt, src, srcfmt, (size_t)width * height);
+        }
+        return dst;
+    }
+
+    // row by row. flip and stride are handled here for free as rows are read from src_top stepping by src_pitch.
+    int band_size = fcGetMinConvertBandSizeImpl();
+    int min_rows = band_size > 0 ? std::max<int>(band_size / std::max<int>(width, 1), 1) : height;
+    ParallelFor(height, min_rows, [=](int begin, int end) {
+        for (int y = begin; y < end; ++y) {
+            char *d = dst_top + (ptrdiff_t)dst_pitch * y;
+            const char *s = src_top + (ptrdiff_t)src_pitch * y;
+            if (dstfmt == srcfmt) {
+                memcpy(d, s, src_row);
+            }
+            else {
+                fcConvertPixelFormat_ISPC(d, dstfmt, s, srcfmt, width);
+            }
+        }
+    });
+    return dst;
+}
+
+static void fcConvertToU16BE_ISPC(uint16_t *dst, int dst_ch, const void *src, fcPixelFormat srcfmt, size_t size_)
+{
+    uint32_t size = (uint32_t)size_;
+    int src_ch = srcfmt & fcPixelFormat_ChannelMask;
+    switch (srcfmt & fcPixelFormat_TypeMask) {
+    case fcPixelFormat_Type_u8: ispc::U8ToU16BE(dst, (uint8_t*)src, src_ch, dst_ch, size); break;
+    case fcPixelFormat_Type_i16: ispc::I16ToU16BE(dst, (uint16_t*)src, src_ch, dst_ch, size); break;
+    case fcPixelFormat_Type_f16: ispc::F16ToU16BE(dst, (int16_t*)src, src_ch, dst_ch, size); break;
+    case fcPixelFormat_Type_f32: ispc::F32ToU16BE(dst, (float*)src, src_ch, dst_ch, size); break;
+    }
+}
+
+bool fcConvertToU16BE(uint16_t *dst, int dst_ch, const void *src, fcPixelFormat srcfmt, size_t size)
+{
+    int type = srcfmt & fcPixelFormat_TypeMask;
+    int src_ch = srcfmt & fcPixelFormat_ChannelMask;
+    if (type == 0 || type == fcPixelFormat_Type_i32 || src_ch < 1 || src_ch > 4 || dst_ch < 1 || dst_ch > 4) { return false; }
+
+    int band_size = fcGetMinConvertBandSizeImpl();
+    if (band_size == 0 || size <= (size_t)band_size) {
+        fcConvertToU16BE_ISPC(dst, dst_ch, src, srcfmt, size);
+        return true;
+    }
+    size_t src_psize = fcGetPixelSize(srcfmt);
+    ParallelFor((int)size, band_size, [=](int begin, int end) {
+        fcConvertToU16BE_ISPC(dst + (size_t)dst_ch * begin, dst_ch, (const char*)src + src_psize * begin, srcfmt, end - begin);
+    });
+    return true;
 }
 
 void fcF32ToU8Samples(uint8_t *dst, const float *src, size_t size)
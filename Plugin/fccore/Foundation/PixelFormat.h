@@ -3,6 +3,7 @@
 enum fcPixelFormat;
 int fcGetPixelSize(fcPixelFormat format);
 
+// separate pass. prefer passing negative pitch to conversions that take it (see fcGetPitch()).
 void fcImageFlipY(void *image_, int width, int height, fcPixelFormat fmt);
 
 class half;
@@ -13,6 +14,25 @@ void fcScaleArray(half *data, size_t size, float scale);
 void fcScaleArray(float *data, size_t size, float scale);
 fcAPI const void* fcConvertPixelFormat(void *dst, fcPixelFormat dstfmt, const void *src, fcPixelFormat srcfmt, size_t size);
 
+// pitch: bytes between rows. 0 means tightly packed.
+// negative pitch means rows are stored bottom-up (e.g. OpenGL readback). pixels still points to the start of the buffer.
+// such images are flipped by conversions that take pitch. there is no need to call fcImageFlipY().
+int fcGetPitch(int pitch, int width, fcPixelFormat fmt);
+// returns the top row and makes pitch the signed step to the next row
+const void* fcGetTopRow(const void *pixels, int& pitch, int width, int height, fcPixelFormat fmt);
+
+// image version of fcConvertPixelFormat(). dst is always written even if formats are the same.
+fcAPI const void* fcConvertPixelFormat2D(void *dst, fcPixelFormat dstfmt, int dst_pitch,
+    const void *src, fcPixelFormat srcfmt, int src_pitch, int width, int height);
+
+// to 16 bit unsigned samples in big-endian (PNG's layout). [0, 1] of float / half and full range of u8 map to [0, 65535].
+// dst_ch: 1 - 4. return false if srcfmt is not supported.
+bool fcConvertToU16BE(uint16_t *dst, int dst_ch, const void *src, fcPixelFormat srcfmt, size_t size);
+
+// large images are converted in bands of at least this number of pixels in parallel. 0 disables it.
+void fcSetMinConvertBandSizeImpl(int num_pixels);
+int  fcGetMinConvertBandSizeImpl();
+
 // audio sample conversion
 void fcF32ToU8Samples(uint8_t *dst, const float *src, size_t size);
 void fcF32ToI16Samples(int16_t *dst, const float *src, size_t size);
@@ -0,0 +1,305 @@
+#include "pch.h"
+#include "fcInternal.h"
+#include "Buffer.h"
+#include "Misc.h"
+#include "ProcessStream.h"
+
+#ifdef fcWindows
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <signal.h>
+    #include <spawn.h>
+    #include <pthread.h>
+    #include <sys/uio.h>
+    #include <sys/wait.h>
+    #include <climits>
+    #include <cerrno>
+    extern char **environ;
+#endif
+
+// large pipe buffer lets the child read whole frames at once. Linux only (F_SETPIPE_SZ).
+static const int fcPipeBufferSize = 1024 * 1024;
+
+// spans passed to one writev() call
+static const int fcMaxPipeSpans = 64;
+
+// time given to the child to finish its output after stdin is closed. it is killed after that
+// so that a hung encoder can't block releasing the stream forever.
+static const int fcProcessExitTimeoutMs = 30000;
+
+
+class ProcessStream : public BinaryStream
+{
+public:
+    ~ProcessStream() override
+    {
+        close();
+    }
+
+    bool open(const char *command);
+
+    size_t tellg() override { return 0; }
+    void seekg(size_t) override {}
+    size_t read(void*, size_t) override { return 0; }
+
+    size_t tellp() override { return m_pos; }
+
+    void seekp(size_t pos) override
+    {
+        if (pos != m_pos && !m_seek_warned) {
+            fcDebugLog("ProcessStream: seekp() is not supported. use non-seekable output modes.\n");
+            m_seek_warned = true;
+        }
+    }
+
+    bool isSeekable() override { return false; }
+
+    size_t write(const void *data, size_t len) override
+    {
+        fcWriteSpan span;
+        span.data = data;
+        span.size = len;
+        return writev(&span, 1);
+    }
+
+    size_t writev(const fcWriteSpan *spans, int num_spans) override;
+
+private:
+    void close();
+
+#ifdef fcWindows
+    HANDLE m_pipe = nullptr;
+    HANDLE m_process = nullptr;
+#else
+    int m_pipe = -1;
+    pid_t m_pid = -1;
+#endif
+    size_t m_pos = 0;
+    bool m_failed = false;
+    bool m_seek_warned = false;
+};
+
+
+#ifdef fcWindows
+
+bool ProcessStream::open(const char *command_)
+{
+    SECURITY_ATTRIBUTES sa = {};
+    sa.nLength = sizeof(sa);
+    sa.bInheritHandle = TRUE;
+
+    HANDLE read_end = nullptr;
+    if (!::CreatePipe(&read_end, &m_pipe, &sa, fcPipeBufferSize)) {
+        fcWinPrintLastError();
+        return false;
+    }
+    // only the read end goes to the child
+    ::SetHandleInformation(m_pipe, HANDLE_FLAG_INHERIT, 0);
+
+    STARTUPINFOA si;
+    PROCESS_INFORMATION pi;
+    memset(&si, 0, sizeof(si));
+    memset(&pi, 0, sizeof(pi));
+    si.cb = sizeof(si);
+    si.dwFlags = STARTF_USESTDHANDLES;
+    si.hStdInput = read_end;
+    si.hStdOutput = ::GetStdHandle(STD_OUTPUT_HANDLE);
+    si.hStdError = ::GetStdHandle(STD_ERROR_HANDLE);
+    std::string command = command_; // CreateProcessA() require **non const** string...
+    BOOL ok = ::CreateProcessA(nullptr, (LPSTR)command.c_str(), nullptr, nullptr, TRUE, CREATE_NO_WINDOW, nullptr, nullptr, &si, &pi);
+    ::CloseHandle(read_end);
+    if (!ok) {
+        fcWinPrintLastError();
+        return false;
+    }
+    ::CloseHandle(pi.hThread);
+    m_process = pi.hProcess;
+    return true;
+}
+
+void ProcessStream::close()
+{
+    if (m_pipe) {
+        // the child sees EOF
+        ::CloseHandle(m_pipe);
+        m_pipe = nullptr;
+    }
+    if (m_process) {
+        DWORD exit_code = 0;
+        if (::WaitForSingleObject(m_process, fcProcessExitTimeoutMs) == WAIT_TIMEOUT) {
+            fcDebugLog("ProcessStream: process didn't exit in %d ms. terminating it.\n", fcProcessExitTimeoutMs);
+            ::TerminateProcess(m_process, 1);
+            ::WaitForSingleObject(m_process, INFINITE);
+        }
+        ::GetExitCodeProcess(m_process, &exit_code);
+        ::CloseHandle(m_process);
+        m_process = nullptr;
+        if (exit_code != 0) {
+            fcDebugLog("ProcessStream: process exited with %d\n", (int)exit_code);
+        }
+    }
+}
+
+size_t ProcessStream::writev(const fcWriteSpan *spans, int num_spans)
+{
+    size_t total = 0;
+    for (int i = 0; i < num_spans; ++i) {
+        auto *p = (const char*)spans[i].data;
+        size_t rest = spans[i].size;
+        total += rest;
+        while (!m_failed && rest > 0) {
+            DWORD written = 0;
+            DWORD n = (DWORD)std::min<size_t>(rest, 0x40000000);
+            if (!::WriteFile(m_pipe, p, n, &written, nullptr)) {
+                fcDebugLog("ProcessStream: write failed. further data is discarded.\n");
+                m_failed = true;
+                break;
+            }
+            p += written;
+            rest -= written;
+        }
+    }
+    m_pos += total;
+    return total;
+}
+
+#else // fcWindows
+
+// return false if the child is still running after timeout_ms
+static bool WaitChild(pid_t pid, int& status, int timeout_ms)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    for (;;) {
+        pid_t r = waitpid(pid, &status, WNOHANG);
+        if (r == pid) { return true; }
+        if (r < 0 && errno != EINTR) { return true; } // already reaped or not our child
+        if (std::chrono::steady_clock::now() >= deadline) { return false; }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+}
+
+bool ProcessStream::open(const char *command)
+{
+    int fds[2];
+    if (pipe(fds) != 0) { return false; }
+    // keep the write end out of this and other children
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+#ifdef F_SETPIPE_SZ
+    fcntl(fds[1], F_SETPIPE_SZ, fcPipeBufferSize);
+#endif
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[0], STDIN_FILENO);
+    posix_spawn_file_actions_addclose(&actions, fds[0]);
+
+    const char *argv[] = { "sh", "-c", command, nullptr };
+    int err = posix_spawn(&m_pid, "/bin/sh", &actions, nullptr, (char* const*)argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    ::close(fds[0]);
+    if (err != 0) {
+        fcDebugLog("ProcessStream: failed to start %s (%d)\n", command, err);
+        ::close(fds[1]);
+        m_pid = -1;
+        return false;
+    }
+    m_pipe = fds[1];
+    return true;
+}
+
+void ProcessStream::close()
+{
+    if (m_pipe >= 0) {
+        // the child sees EOF
+        ::close(m_pipe);
+        m_pipe = -1;
+    }
+    if (m_pid > 0) {
+        int status = 0;
+        if (!WaitChild(m_pid, status, fcProcessExitTimeoutMs)) {
+            fcDebugLog("ProcessStream: process didn't exit in %d ms. terminating it.\n", fcProcessExitTimeoutMs);
+            kill(m_pid, SIGTERM);
+            if (!WaitChild(m_pid, status, 1000)) {
+                kill(m_pid, SIGKILL);
+                while (waitpid(m_pid, &status, 0) < 0 && errno == EINTR) {}
+            }
+        }
+        m_pid = -1;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fcDebugLog("ProcessStream: process exited with %d\n", status);
+        }
+    }
+}
+
+size_t ProcessStream::writev(const fcWriteSpan *spans, int num_spans)
+{
+    size_t total = 0;
+    for (int i = 0; i < num_spans; ++i) {
+        total += spans[i].size;
+    }
+    m_pos += total;
+    if (m_failed) { return total; }
+
+    // if the child is gone, writing raises SIGPIPE. block it on this thread and take the pending signal
+    // instead of letting it kill the host application.
+    sigset_t pipe_set, old_set;
+    sigemptyset(&pipe_set);
+    sigaddset(&pipe_set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_set, &old_set);
+
+    int si = 0;
+    size_t skip = 0;
+    while (si < num_spans) {
+        iovec iov[fcMaxPipeSpans];
+        int n = std::min<int>(num_spans - si, fcMaxPipeSpans);
+        for (int i = 0; i < n; ++i) {
+            size_t offset = i == 0 ? skip : 0;
+            iov[i].iov_base = (char*)spans[si + i].data + offset;
+            iov[i].iov_len = spans[si + i].size - offset;
+        }
+        ssize_t r = ::writev(m_pipe, iov, n);
+        if (r < 0) {
+            // fcDebugLog() may overwrite errno
+            int err = errno;
+            if (err == EINTR) { continue; }
+            fcDebugLog("ProcessStream: write failed (%d). further data is discarded.\n", err);
+            m_failed = true;
+            if (err == EPIPE) {
+                sigset_t pending;
+                sigpending(&pending);
+                if (sigismember(&pending, SIGPIPE)) {
+                    int sig;
+                    sigwait(&pipe_set, &sig);
+                }
+            }
+            break;
+        }
+
+        // writev() may take partial data. skip what was written and continue from there.
+        size_t written = (size_t)r + skip;
+        while (si < num_spans && written >= spans[si].size) {
+            written -= spans[si].size;
+            ++si;
+        }
+        skip = written;
+    }
+
+    pthread_sigmask(SIG_SETMASK, &old_set, nullptr);
+    return total;
+}
+
+#endif // fcWindows
+
+
+BinaryStream* CreateProcessStream(const char *command)
+{
+    if (!command) { return nullptr; }
+    auto *ret = new ProcessStream();
+    if (!ret->open(command)) {
+        ret->release();
+        return nullptr;
+    }
+    return ret;
+}
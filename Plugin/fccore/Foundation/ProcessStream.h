@@ -0,0 +1,9 @@
+#pragma once
+
+#include "Buffer.h"
+
+// spawns command (through the shell on POSIX, CreateProcess() on Windows) and writes to its stdin through a pipe.
+// the pipe is not seekable. releasing the stream closes the pipe and waits for the process to exit,
+// so the output of the external encoder is complete by then. a process that doesn't exit in 30 seconds is killed.
+// returns nullptr if the process can't be started.
+BinaryStream* CreateProcessStream(const char *command);
@@ -0,0 +1,350 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+
+// fixed-size pool of pre-allocated resources (mainly frame buffers).
+// free resources are kept in a lock-free bounded MPMC queue, so acquire / release don't take locks
+// unless the pool is exhausted and the caller has to wait.
+// resources must be added by emplace() before the pool is used.
+template<class T>
+class ResourcePool
+{
+public:
+    using Resource = T;
+    using Lock = std::unique_lock<std::mutex>;
+    using Clock = std::chrono::steady_clock;
+
+private:
+    struct Slot
+    {
+        Resource resource;
+        std::atomic_int ref_count = { 0 };
+
+        template<typename ...Params>
+        Slot(Params&&... params) : resource(std::forward<Params>(params)...) {}
+    };
+    using SlotPtr = std::unique_ptr<Slot>;
+
+public:
+    // holds a resource while it is in use. copyable. the resource is returned to the pool when the last holder is gone.
+    class ResourceHolder
+    {
+    public:
+        ResourceHolder() {}
+        ResourceHolder(const ResourceHolder& v) : m_owner(v.m_owner), m_slot(v.m_slot) { addRef(); }
+        ResourceHolder(ResourceHolder&& v) : m_owner(v.m_owner), m_slot(v.m_slot) { v.m_owner = nullptr; v.m_slot = nullptr; }
+        ~ResourceHolder() { reset(); }
+
+        ResourceHolder& operator=(const ResourceHolder& v)
+        {
+            if (this != &v) {
+                reset();
+                m_owner = v.m_owner;
+                m_slot = v.m_slot;
+                addRef();
+            }
+            return *this;
+        }
+
+        ResourceHolder& operator=(ResourceHolder&& v)
+        {
+            if (this != &v) {
+                reset();
+                std::swap(m_owner, v.m_owner);
+                std::swap(m_slot, v.m_slot);
+            }
+            return *this;
+        }
+
+        void reset()
+        {
+            if (m_slot && m_slot->ref_count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                m_owner->release(m_slot);
+            }
+            m_owner = nullptr;
+            m_slot = nullptr;
+        }
+
+        // give up the reference without releasing it and return an opaque handle.
+        // the resource stays in use until the handle is passed to ResourcePool::attach().
+        void* detach()
+        {
+            void *ret = m_slot;
+            m_owner = nullptr;
+            m_slot = nullptr;
+            return ret;
+        }
+
+        operator bool() const { return m_slot != nullptr; }
+        Resource& operator*() { return m_slot->resource; }
+        const Resource& operator*() const { return m_slot->resource; }
+        Resource* operator->() { return &m_slot->resource; }
+        const Resource* operator->() const { return &m_slot->resource; }
+
+    private:
+        friend class ResourcePool;
+        ResourceHolder(ResourcePool *owner, Slot *slot) : m_owner(owner), m_slot(slot) { addRef(); }
+        void addRef() { if (m_slot) { m_slot->ref_count.fetch_add(1, std::memory_order_relaxed); } }
+
+        ResourcePool *m_owner = nullptr;
+        Slot *m_slot = nullptr;
+    };
+
+
+    ResourcePool() {}
+    ResourcePool(const ResourcePool&) = delete;
+    ResourcePool& operator=(const ResourcePool&) = delete;
+
+    // not thread safe. must be called before the pool is used.
+    template<typename ...Params>
+    void emplace(Params&&... params)
+    {
+        m_slots.emplace_back(new Slot(std::forward<Params>(params)...));
+        m_free.resize(m_slots.size());
+        for (auto& s : m_slots) { m_free.push(s.get()); }
+    }
+
+    int getCapacity() const { return (int)m_slots.size(); }
+
+    // take over the reference detached by ResourceHolder::detach()
+    ResourceHolder attach(void *handle)
+    {
+        ResourceHolder ret;
+        ret.m_owner = this;
+        ret.m_slot = (Slot*)handle;
+        return ret;
+    }
+
+    // return empty holder immediately if no resource is available
+    ResourceHolder tryAcquire()
+    {
+        ResourceHolder ret;
+        if (m_slots.empty()) { return ret; }
+
+        if (Slot *slot = pop()) {
+            ret = ResourceHolder(this, slot);
+        }
+        return ret;
+    }
+
+    ResourceHolder acquire()
+    {
+        return acquire(std::chrono::hours(24));
+    }
+
+    // return empty holder if no resource is available in wait_time
+    template<class Rep, class Period>
+    ResourceHolder acquire(std::chrono::duration<Rep, Period> wait_time)
+    {
+        ResourceHolder ret;
+        if (m_slots.empty()) { return ret; }
+
+        if (Slot *slot = pop()) {
+            ret = ResourceHolder(this, slot);
+            return ret;
+        }
+
+        // slow path: pool is exhausted. wait until someone releases a resource.
+        m_num_exhaustions.fetch_add(1, std::memory_order_relaxed);
+        auto begin = Clock::now();
+        auto deadline = begin + wait_time;
+        Slot *slot = nullptr;
+        {
+            Lock l(m_mutex);
+            m_num_waiters.fetch_add(1);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            while ((slot = pop()) == nullptr) {
+                if (m_condition.wait_until(l, deadline) == std::cv_status::timeout) {
+                    slot = pop();
+                    break;
+                }
+            }
+            m_num_waiters.fetch_sub(1);
+        }
+
+        auto wait_ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin).count();
+        m_wait_time.fetch_add(wait_ns, std::memory_order_relaxed);
+        updateMax(m_max_wait_time, wait_ns);
+
+        if (slot) {
+            ret = ResourceHolder(this, slot);
+        }
+        else {
+            m_num_timeouts.fetch_add(1, std::memory_order_relaxed);
+        }
+        return ret;
+    }
+
+    void getStats(fcBufferPoolStats& dst) const
+    {
+        dst.capacity = getCapacity();
+        dst.in_use = m_in_use.load(std::memory_order_relaxed);
+        dst.high_water_mark = m_high_water_mark.load(std::memory_order_relaxed);
+        dst.num_acquires = m_num_acquires.load(std::memory_order_relaxed);
+        dst.num_exhaustions = m_num_exhaustions.load(std::memory_order_relaxed);
+        dst.num_timeouts = m_num_timeouts.load(std::memory_order_relaxed);
+        dst.total_wait_time = (double)m_wait_time.load(std::memory_order_relaxed) / 1000000000.0;
+        dst.max_wait_time = (double)m_max_wait_time.load(std::memory_order_relaxed) / 1000000000.0;
+    }
+
+private:
+    Slot* pop()
+    {
+        Slot *ret = nullptr;
+        if (m_free.pop(ret)) {
+            m_num_acquires.fetch_add(1, std::memory_order_relaxed);
+            int in_use = m_in_use.fetch_add(1, std::memory_order_relaxed) + 1;
+            updateMax(m_high_water_mark, in_use);
+        }
+        return ret;
+    }
+
+    void release(Slot *slot)
+    {
+        m_in_use.fetch_sub(1, std::memory_order_relaxed);
+        m_free.push(slot);
+
+        // pairs with the fence in acquire(). either we see the waiter, or the waiter sees the released slot.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_num_waiters.load(std::memory_order_relaxed) > 0) {
+            Lock l(m_mutex);
+            m_condition.notify_one();
+        }
+    }
+
+    template<class V>
+    static void updateMax(std::atomic<V>& dst, V v)
+    {
+        V prev = dst.load(std::memory_order_relaxed);
+        while (prev < v && !dst.compare_exchange_weak(prev, v, std::memory_order_relaxed)) {}
+    }
+
+
+    // bounded MPMC queue (Dmitry Vyukov's algorithm)
+    class FreeList
+    {
+    public:
+        void resize(size_t n)
+        {
+            size_t capacity = 1;
+            while (capacity < n) { capacity <<= 1; }
+            m_cells.reset(new Cell[capacity]);
+            m_mask = capacity - 1;
+            for (size_t i = 0; i < capacity; ++i) {
+                m_cells[i].sequence.store(i, std::memory_order_relaxed);
+            }
+            m_enqueue_pos.store(0, std::memory_order_relaxed);
+            m_dequeue_pos.store(0, std::memory_order_relaxed);
+        }
+
+        bool push(Slot *v)
+        {
+            Cell *cell;
+            size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+            for (;;) {
+                cell = &m_cells[pos & m_mask];
+                size_t seq = cell->sequence.load(std::memory_order_acquire);
+                intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+                if (diff == 0) {
+                    if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) { break; }
+                }
+                else if (diff < 0) {
+                    return false; // full
+                }
+                else {
+                    pos = m_enqueue_pos.load(std::memory_order_relaxed);
+                }
+            }
+            cell->data = v;
+            cell->sequence.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool pop(Slot *& v)
+        {
+            Cell *cell;
+            size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+            for (;;) {
+                cell = &m_cells[pos & m_mask];
+                size_t seq = cell->sequence.load(std::memory_order_acquire);
+                intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+                if (diff == 0) {
+                    if (m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) { break; }
+                }
+                else if (diff < 0) {
+                    return false; // empty
+                }
+                else {
+                    pos = m_dequeue_pos.load(std::memory_order_relaxed);
+                }
+            }
+            v = cell->data;
+            cell->sequence.store(pos + m_mask + 1, std::memory_order_release);
+            return true;
+        }
+
+    private:
+        struct Cell
+        {
+            std::atomic<size_t> sequence;
+            Slot *data = nullptr;
+        };
+        std::unique_ptr<Cell[]> m_cells;
+        size_t m_mask = 0;
+        std::atomic<size_t> m_enqueue_pos = { 0 };
+        std::atomic<size_t> m_dequeue_pos = { 0 };
+    };
+
+private:
+    std::vector<SlotPtr>    m_slots;
+    FreeList                m_free;
+
+    std::mutex              m_mutex;
+    std::condition_variable m_condition;
+    std::atomic_int         m_num_waiters = { 0 };
+
+    // telemetry
+    std::atomic_int         m_in_use = { 0 };
+    std::atomic_int         m_high_water_mark = { 0 };
+    std::atomic<uint64_t>   m_num_acquires = { 0 };
+    std::atomic<uint64_t>   m_num_exhaustions = { 0 };
+    std::atomic<uint64_t>   m_num_timeouts = { 0 };
+    std::atomic<uint64_t>   m_wait_time = { 0 };     // in nanoseconds
+    std::atomic<uint64_t>   m_max_wait_time = { 0 }; // in nanoseconds
+};
+
+
+// handles of resources handed out to the user (fc*AcquireFrame() etc.).
+// the user may pass back a handle of another context or the same one twice, so handles are checked before attach().
+class AcquiredHandles
+{
+public:
+    using Lock = std::unique_lock<std::mutex>;
+
+    void add(void *handle)
+    {
+        Lock l(m_mutex);
+        m_handles.push_back(handle);
+    }
+
+    // return false if handle is not added or already taken
+    bool take(void *handle)
+    {
+        Lock l(m_mutex);
+        auto it = std::find(m_handles.begin(), m_handles.end(), handle);
+        if (it == m_handles.end()) { return false; }
+        m_handles.erase(it);
+        return true;
+    }
+
+private:
+    std::mutex m_mutex;
+    std::vector<void*> m_handles;
+};
@@ -0,0 +1,44 @@
+#include "pch.h"
+#include "Semaphore.h"
+
+Semaphore::Semaphore(int count)
+    : m_count(count)
+{
+}
+
+void Semaphore::reset(int count)
+{
+    Lock l(m_mutex);
+    m_count = count;
+    m_condition.notify_all();
+}
+
+void Semaphore::acquire()
+{
+    Lock l(m_mutex);
+    while (m_count <= 0) {
+        m_condition.wait(l);
+    }
+    --m_count;
+}
+
+bool Semaphore::tryAcquire()
+{
+    Lock l(m_mutex);
+    if (m_count <= 0) { return false; }
+    --m_count;
+    return true;
+}
+
+void Semaphore::release()
+{
+    Lock l(m_mutex);
+    ++m_count;
+    m_condition.notify_one();
+}
+
+int Semaphore::getCount() const
+{
+    Lock l(m_mutex);
+    return m_count;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <mutex>
+#include <condition_variable>
+
+// counting semaphore. used to bound the number of in-flight tasks:
+// acquire a slot before submitting a task and release it when the task is done.
+class Semaphore
+{
+public:
+    using Lock = std::unique_lock<std::mutex>;
+
+    Semaphore(int count = 0);
+    void reset(int count);
+
+    // block until a slot is available
+    void acquire();
+    // return false immediately if no slot is available
+    bool tryAcquire();
+    void release();
+    int getCount() const;
+
+private:
+    mutable std::mutex m_mutex;
+    std::condition_variable m_condition;
+    int m_count = 0;
+};
@@ -0,0 +1,76 @@
+#include "pch.h"
+#include "fcInternal.h"
+#include "Buffer.h"
+#include "SharedMemoryStream.h"
+
+#if defined(fcLinux) || defined(fcMac)
+#include <cerrno>
+#include "ShmRing.h"
+
+class SharedMemoryStream : public BinaryStream
+{
+public:
+    bool open(const char *name, const fcSharedMemoryStreamConfig& conf)
+    {
+        if (!m_ring.create(name, conf.capacity, conf.replace_existing)) {
+            fcDebugLog("SharedMemoryStream: failed to create %s (%d)\n", name, errno);
+            return false;
+        }
+        m_ring.setStallTimeout(conf.stall_timeout_ms);
+        return true;
+    }
+
+    ~SharedMemoryStream() override
+    {
+        m_ring.close();
+    }
+
+    size_t tellg() override { return 0; }
+    void seekg(size_t) override {}
+    size_t read(void*, size_t) override { return 0; }
+
+    size_t tellp() override { return (size_t)m_ring.tell(); }
+    bool isSeekable() override { return false; }
+
+    void seekp(size_t pos) override
+    {
+        if (pos != tellp() && !m_seek_warned) {
+            fcDebugLog("SharedMemoryStream: seekp() is not supported. use non-seekable output modes.\n");
+            m_seek_warned = true;
+        }
+    }
+
+    size_t write(const void *data, size_t len) override
+    {
+        if (m_ring.isBroken()) { return 0; }
+        size_t ret = m_ring.write(data, len);
+        if (m_ring.isBroken()) {
+            fcDebugLog("SharedMemoryStream: the reader made no progress. further writes are dropped.\n");
+        }
+        return ret;
+    }
+
+private:
+    ShmRingWriter m_ring;
+    bool m_seek_warned = false;
+};
+
+BinaryStream* CreateSharedMemoryStream(const char *name, const fcSharedMemoryStreamConfig& conf)
+{
+    if (!name || conf.capacity == 0) { return nullptr; }
+    auto *ret = new SharedMemoryStream();
+    if (!ret->open(name, conf)) {
+        ret->release();
+        return nullptr;
+    }
+    return ret;
+}
+
+#else
+
+BinaryStream* CreateSharedMemoryStream(const char *, const fcSharedMemoryStreamConfig&)
+{
+    return nullptr;
+}
+
+#endif
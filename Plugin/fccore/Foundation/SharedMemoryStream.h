@@ -0,0 +1,10 @@
+#pragma once
+
+#include "Buffer.h"
+
+// writes into a ShmRing (see ShmRing.h) so that another process can consume the output without touching the disk.
+// the ring is not seekable: tellp() works, seekp() to other than the current position is ignored.
+// write() blocks while the ring is full, up to conf.stall_timeout_ms without progress of the reader.
+// after that the stream is broken and drops writes. the name is removed when the stream is released.
+// returns nullptr if the platform is not supported (Windows, Android) or the ring can't be created.
+BinaryStream* CreateSharedMemoryStream(const char *name, const fcSharedMemoryStreamConfig& conf);
@@ -0,0 +1,370 @@
+#pragma once
+
+// single-producer single-consumer byte ring in POSIX shared memory.
+// this header is self-contained so that other processes can include it to read what fcCreateSharedMemoryStream() writes:
+//
+//     ShmRingReader reader;
+//     if (reader.open("/my_capture")) {
+//         char buf[65536];
+//         size_t n;
+//         while ((n = reader.read(buf, sizeof(buf), 1000)) > 0 || !reader.isClosed()) { ... }
+//     }
+//
+// or, without the copy to buf:
+//
+//     const void *data; size_t size;
+//     while (reader.acquire(data, size, 1000)) { consume(data, size); reader.release(size); }
+//
+// positions are 64 bit monotonic byte counters. waits use futex on Linux (works across processes
+// because the words live in the shared mapping) and short sleeps on other platforms.
+
+#if !defined(_WIN32)
+
+#include <new>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <string>
+#include <cstdint>
+#include <algorithm>
+#include <cstring>
+#include <climits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+    #include <linux/futex.h>
+    #include <sys/syscall.h>
+    #include <time.h>
+#endif
+
+struct ShmRingHeader
+{
+    static const uint32_t Magic = 0x52524346; // "FCRR"
+    static const uint32_t Version = 1;
+
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;                      // size of the data area. power of two.
+    uint64_t data_offset;                   // from the beginning of the mapping
+
+    alignas(64) std::atomic<uint64_t> write_pos;
+    std::atomic<uint32_t> write_seq;        // bumped after write_pos is advanced. reader waits on it.
+    std::atomic<uint32_t> reader_waiting;
+    std::atomic<uint32_t> closed;           // writer is gone
+
+    alignas(64) std::atomic<uint64_t> read_pos;
+    std::atomic<uint32_t> read_seq;         // bumped after read_pos is advanced. writer waits on it.
+    std::atomic<uint32_t> writer_waiting;
+};
+
+namespace ShmRingDetail {
+
+// wait until *word != expected or timeout. timeout_ms < 0 means infinite.
+inline void Wait(std::atomic<uint32_t> *word, uint32_t expected, int timeout_ms)
+{
+#ifdef __linux__
+    timespec ts, *pts = nullptr;
+    if (timeout_ms >= 0) {
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (timeout_ms % 1000) * 1000000;
+        pts = &ts;
+    }
+    syscall(SYS_futex, (uint32_t*)word, FUTEX_WAIT, expected, pts, nullptr, 0);
+#else
+    (void)timeout_ms;
+    if (word->load() == expected) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+#endif
+}
+
+inline void Wake(std::atomic<uint32_t> *word)
+{
+#ifdef __linux__
+    syscall(SYS_futex, (uint32_t*)word, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#else
+    (void)word;
+#endif
+}
+
+inline size_t HeaderSize()
+{
+    return (sizeof(ShmRingHeader) + 4095) & ~(size_t)4095;
+}
+
+} // namespace ShmRingDetail
+
+
+class ShmRingBase
+{
+public:
+    ShmRingBase() {}
+    ShmRingBase(const ShmRingBase&) = delete;
+    ShmRingBase& operator=(const ShmRingBase&) = delete;
+    ~ShmRingBase() { unmap(); }
+
+    bool valid() const { return m_header != nullptr; }
+    uint64_t getCapacity() const { return m_header ? m_header->capacity : 0; }
+    bool isClosed() const { return m_header && m_header->closed.load(std::memory_order_acquire) != 0; }
+
+protected:
+    bool map(int fd, size_t size)
+    {
+        void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) { return false; }
+        m_map = p;
+        m_map_size = size;
+        m_header = (ShmRingHeader*)p;
+        return true;
+    }
+
+    void unmap()
+    {
+        if (m_map) { munmap(m_map, m_map_size); }
+        m_map = nullptr;
+        m_map_size = 0;
+        m_header = nullptr;
+        m_data = nullptr;
+    }
+
+    void *m_map = nullptr;
+    size_t m_map_size = 0;
+    ShmRingHeader *m_header = nullptr;
+    char *m_data = nullptr;
+};
+
+
+class ShmRingWriter : public ShmRingBase
+{
+public:
+    ~ShmRingWriter() { close(); }
+
+    // create the ring. capacity is rounded up to a power of two.
+    // fails if the name already exists, unless replace_existing is true (e.g. to clean up after a crashed writer).
+    bool create(const char *name, uint64_t capacity, bool replace_existing = false)
+    {
+        close();
+        uint64_t cap = 4096;
+        while (cap < capacity) { cap <<= 1; }
+
+        if (replace_existing) {
+            shm_unlink(name);
+        }
+        int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0) { return false; }
+        size_t size = ShmRingDetail::HeaderSize() + (size_t)cap;
+        bool ok = ftruncate(fd, (off_t)size) == 0 && map(fd, size);
+        ::close(fd);
+        if (!ok) {
+            shm_unlink(name);
+            return false;
+        }
+        m_name = name;
+
+        auto *h = new (m_map) ShmRingHeader();
+        h->capacity = cap;
+        h->data_offset = ShmRingDetail::HeaderSize();
+        h->write_pos.store(0);
+        h->write_seq.store(0);
+        h->reader_waiting.store(0);
+        h->closed.store(0);
+        h->read_pos.store(0);
+        h->read_seq.store(0);
+        h->writer_waiting.store(0);
+        h->version = ShmRingHeader::Version;
+        std::atomic_thread_fence(std::memory_order_release);
+        h->magic = ShmRingHeader::Magic;
+        m_data = (char*)m_map + h->data_offset;
+        m_broken = false;
+        return true;
+    }
+
+    // write() gives up if the reader makes no progress for timeout_ms while the ring is full. < 0: wait forever.
+    void setStallTimeout(int timeout_ms) { m_stall_timeout_ms = timeout_ms; }
+    // true once write() gave up. later writes are dropped, as the reader can't resync in the middle of the stream.
+    bool isBroken() const { return m_broken; }
+
+    // mark the ring closed and remove the name. a reader that already opened it can still drain the data.
+    void close()
+    {
+        if (!m_header) { return; }
+        m_header->closed.store(1);
+        m_header->write_seq.fetch_add(1);
+        ShmRingDetail::Wake(&m_header->write_seq);
+        shm_unlink(m_name.c_str());
+        unmap();
+    }
+
+    uint64_t tell() const { return m_header ? m_header->write_pos.load(std::memory_order_relaxed) : 0; }
+
+    // blocks while the ring is full. the only copy of the data is the one into the ring.
+    // return written size. it is less than len if the reader stalled (see setStallTimeout()).
+    size_t write(const void *data, size_t len)
+    {
+        if (!m_header || m_broken) { return 0; }
+        auto *h = m_header;
+        auto *src = (const char*)data;
+        const uint64_t cap = h->capacity;
+        const uint64_t mask = cap - 1;
+        size_t rest = len;
+        bool stalled = false;
+        std::chrono::steady_clock::time_point stall_begin;
+        while (rest > 0) {
+            uint64_t wpos = h->write_pos.load(std::memory_order_relaxed);
+            uint64_t space = cap - (wpos - h->read_pos.load(std::memory_order_acquire));
+            if (space == 0) {
+                h->writer_waiting.store(1);
+                uint32_t seq = h->read_seq.load();
+                space = cap - (wpos - h->read_pos.load());
+                if (space == 0) {
+                    // the reader may be gone. don't wait for it forever.
+                    auto now = std::chrono::steady_clock::now();
+                    if (!stalled) {
+                        stalled = true;
+                        stall_begin = now;
+                    }
+                    int wait_ms = 100;
+                    if (m_stall_timeout_ms >= 0) {
+                        auto left = m_stall_timeout_ms - std::chrono::duration_cast<std::chrono::milliseconds>(now - stall_begin).count();
+                        if (left <= 0) {
+                            m_broken = true;
+                            return len - rest;
+                        }
+                        wait_ms = (int)std::min<long long>(left, wait_ms);
+                    }
+                    ShmRingDetail::Wait(&h->read_seq, seq, wait_ms);
+                    continue;
+                }
+            }
+            stalled = false;
+
+            size_t n = (size_t)std::min<uint64_t>(rest, space);
+            size_t offset = (size_t)(wpos & mask);
+            size_t first = std::min<size_t>(n, (size_t)(cap - offset));
+            memcpy(m_data + offset, src, first);
+            memcpy(m_data, src + first, n - first);
+            h->write_pos.store(wpos + n, std::memory_order_release);
+            h->write_seq.fetch_add(1);
+            if (h->reader_waiting.load()) {
+                h->reader_waiting.store(0);
+                ShmRingDetail::Wake(&h->write_seq);
+            }
+            src += n;
+            rest -= n;
+        }
+        return len;
+    }
+
+private:
+    std::string m_name;
+    int m_stall_timeout_ms = -1;
+    bool m_broken = false;
+};
+
+
+class ShmRingReader : public ShmRingBase
+{
+public:
+    ~ShmRingReader() { close(); }
+
+    bool open(const char *name)
+    {
+        close();
+        int fd = shm_open(name, O_RDWR, 0600);
+        if (fd < 0) { return false; }
+        struct stat st;
+        bool ok = fstat(fd, &st) == 0 && (size_t)st.st_size > sizeof(ShmRingHeader) && map(fd, (size_t)st.st_size);
+        ::close(fd);
+        if (!ok) { return false; }
+        if (m_header->magic != ShmRingHeader::Magic || m_header->version != ShmRingHeader::Version) {
+            unmap();
+            return false;
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        // the header comes from another process. reject layouts that would index outside the mapping.
+        // capacity must be a power of two as positions are masked by capacity - 1.
+        uint64_t cap = m_header->capacity;
+        uint64_t offset = m_header->data_offset;
+        uint64_t size = (uint64_t)st.st_size;
+        if (cap == 0 || (cap & (cap - 1)) != 0 ||
+            offset < sizeof(ShmRingHeader) || offset > size || cap > size - offset)
+        {
+            unmap();
+            return false;
+        }
+        m_data = (char*)m_map + offset;
+        return true;
+    }
+
+    void close() { unmap(); }
+
+    uint64_t tell() const { return m_header ? m_header->read_pos.load(std::memory_order_relaxed) : 0; }
+
+    // contiguous readable span. waits up to timeout_ms (< 0: infinite) for data.
+    // return false on timeout, or if the writer closed the ring and everything is read.
+    bool acquire(const void *& data, size_t& size, int timeout_ms)
+    {
+        if (!m_header) { return false; }
+        auto *h = m_header;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        for (;;) {
+            uint64_t rpos = h->read_pos.load(std::memory_order_relaxed);
+            uint64_t avail = h->write_pos.load(std::memory_order_acquire) - rpos;
+            if (avail == 0) {
+                h->reader_waiting.store(1);
+                uint32_t seq = h->write_seq.load();
+                avail = h->write_pos.load() - rpos;
+                if (avail == 0) {
+                    if (isClosed()) { return false; }
+                    int wait_ms = 100;
+                    if (timeout_ms >= 0) {
+                        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+                        if (left <= 0) { return false; }
+                        wait_ms = (int)std::min<long long>(left, wait_ms);
+                    }
+                    ShmRingDetail::Wait(&h->write_seq, seq, wait_ms);
+                    continue;
+                }
+            }
+            size_t offset = (size_t)(rpos & (h->capacity - 1));
+            data = m_data + offset;
+            size = (size_t)std::min<uint64_t>(avail, h->capacity - offset);
+            return true;
+        }
+    }
+
+    // give back size bytes of the span from acquire()
+    void release(size_t size)
+    {
+        auto *h = m_header;
+        h->read_pos.store(h->read_pos.load(std::memory_order_relaxed) + size, std::memory_order_release);
+        h->read_seq.fetch_add(1);
+        if (h->writer_waiting.load()) {
+            h->writer_waiting.store(0);
+            ShmRingDetail::Wake(&h->read_seq);
+        }
+    }
+
+    // copy up to len bytes. return 0 on timeout or end of stream.
+    size_t read(void *dst, size_t len, int timeout_ms)
+    {
+        auto *d = (char*)dst;
+        size_t ret = 0;
+        while (ret < len) {
+            const void *data;
+            size_t size;
+            // wait only for the first chunk. then return what is available.
+            if (!acquire(data, size, ret == 0 ? timeout_ms : 0)) { break; }
+            size = std::min<size_t>(size, len - ret);
+            memcpy(d + ret, data, size);
+            release(size);
+            ret += size;
+        }
+        return ret;
+    }
+};
+
+#endif // !defined(_WIN32)
@@ -0,0 +1,246 @@
+#include "pch.h"
+#include "fcInternal.h"
+#include "Buffer.h"
+#include "SocketStream.h"
+
+#ifdef fcWindows
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+    #ifdef _MSC_VER
+        #pragma comment(lib, "ws2_32.lib")
+    #endif // _MSC_VER
+    using socket_t = SOCKET;
+    static const socket_t fcInvalidSocket = INVALID_SOCKET;
+    #define fcCloseSocket closesocket
+#else
+    #include <sys/types.h>
+    #include <sys/socket.h>
+    #include <sys/un.h>
+    #include <sys/uio.h>
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+    #include <netdb.h>
+    #include <unistd.h>
+    #include <climits>
+    #include <cerrno>
+    using socket_t = int;
+    static const socket_t fcInvalidSocket = -1;
+    #define fcCloseSocket ::close
+#endif
+
+#if defined(MSG_NOSIGNAL)
+    static const int fcSendFlags = MSG_NOSIGNAL;
+#else
+    static const int fcSendFlags = 0;
+#endif
+
+// spans passed to one sendmsg() / WSASend() call
+static const int fcMaxSendSpans = 64;
+
+
+static int GetSocketError()
+{
+#ifdef fcWindows
+    return WSAGetLastError();
+#else
+    return errno;
+#endif
+}
+
+static bool InitSockets()
+{
+#ifdef fcWindows
+    static bool s_ok = []() {
+        WSADATA wsa;
+        return WSAStartup(MAKEWORD(2, 2), &wsa) == 0;
+    }();
+    return s_ok;
+#else
+    return true;
+#endif
+}
+
+static void SetupSocket(socket_t s, const fcSocketStreamConfig& conf, bool tcp)
+{
+    if (conf.send_buffer_size > 0) {
+        int v = conf.send_buffer_size;
+        setsockopt(s, SOL_SOCKET, SO_SNDBUF, (const char*)&v, sizeof(v));
+    }
+    if (tcp) {
+        int v = conf.no_delay ? 1 : 0;
+        setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&v, sizeof(v));
+    }
+#ifdef SO_NOSIGPIPE
+    {
+        int v = 1;
+        setsockopt(s, SOL_SOCKET, SO_NOSIGPIPE, &v, sizeof(v));
+    }
+#endif
+}
+
+
+class SocketStream : public BinaryStream
+{
+public:
+    SocketStream(socket_t s) : m_socket(s) {}
+
+    ~SocketStream() override
+    {
+        fcCloseSocket(m_socket);
+    }
+
+    size_t tellg() override { return 0; }
+    void seekg(size_t) override {}
+    size_t read(void*, size_t) override { return 0; }
+
+    size_t tellp() override { return m_pos; }
+
+    void seekp(size_t pos) override
+    {
+        if (pos != m_pos && !m_seek_warned) {
+            fcDebugLog("SocketStream: seekp() is not supported. use non-seekable output modes.\n");
+            m_seek_warned = true;
+        }
+    }
+
+    bool isSeekable() override { return false; }
+
+    size_t write(const void *data, size_t len) override
+    {
+        fcWriteSpan span;
+        span.data = data;
+        span.size = len;
+        return writev(&span, 1);
+    }
+
+    size_t writev(const fcWriteSpan *spans, int num_spans) override
+    {
+        size_t total = 0;
+        for (int i = 0; i < num_spans; ++i) {
+            total += spans[i].size;
+        }
+
+        // m_pos advances even if the connection is lost. positions must stay consistent with what muxers wrote.
+        m_pos += total;
+        if (m_failed) { return total; }
+
+        // send() may take partial data. skip what was sent and continue from there.
+        int si = 0;
+        size_t skip = 0;
+        while (si < num_spans) {
+            size_t sent = 0;
+            int n = std::min<int>(num_spans - si, fcMaxSendSpans);
+#ifdef fcWindows
+            WSABUF bufs[fcMaxSendSpans];
+            for (int i = 0; i < n; ++i) {
+                size_t offset = i == 0 ? skip : 0;
+                bufs[i].buf = (CHAR*)spans[si + i].data + offset;
+                bufs[i].len = (ULONG)(spans[si + i].size - offset);
+            }
+            DWORD r = 0;
+            if (WSASend(m_socket, bufs, (DWORD)n, &r, 0, nullptr, nullptr) != 0) {
+                fail();
+                return total;
+            }
+            sent = r;
+#else
+            iovec iov[fcMaxSendSpans];
+            for (int i = 0; i < n; ++i) {
+                size_t offset = i == 0 ? skip : 0;
+                iov[i].iov_base = (char*)spans[si + i].data + offset;
+                iov[i].iov_len = spans[si + i].size - offset;
+            }
+            msghdr msg = {};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = n;
+            ssize_t r = sendmsg(m_socket, &msg, fcSendFlags);
+            if (r < 0) {
+                if (errno == EINTR) { continue; }
+                fail();
+                return total;
+            }
+            sent = (size_t)r;
+#endif
+            // advance
+            sent += skip;
+            skip = 0;
+            while (si < num_spans && sent >= spans[si].size) {
+                sent -= spans[si].size;
+                ++si;
+            }
+            skip = sent;
+        }
+        return total;
+    }
+
+private:
+    void fail()
+    {
+        fcDebugLog("SocketStream: send failed (%d). further data is discarded.\n", GetSocketError());
+        m_failed = true;
+    }
+
+    socket_t m_socket = fcInvalidSocket;
+    size_t m_pos = 0;
+    bool m_failed = false;
+    bool m_seek_warned = false;
+};
+
+
+BinaryStream* CreateTcpSocketStream(const char *host, int port, const fcSocketStreamConfig& conf)
+{
+    if (!host || !InitSockets()) { return nullptr; }
+
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    char service[16];
+    sprintf(service, "%d", port);
+
+    addrinfo *res = nullptr;
+    if (getaddrinfo(host, service, &hints, &res) != 0) {
+        fcDebugLog("CreateTcpSocketStream: failed to resolve %s\n", host);
+        return nullptr;
+    }
+
+    socket_t s = fcInvalidSocket;
+    for (addrinfo *ai = res; ai; ai = ai->ai_next) {
+        s = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (s == fcInvalidSocket) { continue; }
+        // SO_SNDBUF must be set before connect() to take effect on the window
+        SetupSocket(s, conf, true);
+        if (connect(s, ai->ai_addr, (int)ai->ai_addrlen) == 0) { break; }
+        fcCloseSocket(s);
+        s = fcInvalidSocket;
+    }
+    freeaddrinfo(res);
+
+    if (s == fcInvalidSocket) {
+        fcDebugLog("CreateTcpSocketStream: failed to connect to %s:%d (%d)\n", host, port, GetSocketError());
+        return nullptr;
+    }
+    return new SocketStream(s);
+}
+
+BinaryStream* CreateUnixSocketStream(const char *path, const fcSocketStreamConfig& conf)
+{
+#ifdef fcWindows
+    (void)path; (void)conf;
+    return nullptr;
+#else
+    sockaddr_un addr = {};
+    if (!path || strlen(path) >= sizeof(addr.sun_path)) { return nullptr; }
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    socket_t s = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (s == fcInvalidSocket) { return nullptr; }
+    SetupSocket(s, conf, false);
+    if (connect(s, (sockaddr*)&addr, sizeof(addr)) != 0) {
+        fcDebugLog("CreateUnixSocketStream: failed to connect to %s (%d)\n", path, errno);
+        fcCloseSocket(s);
+        return nullptr;
+    }
+    return new SocketStream(s);
+#endif
+}
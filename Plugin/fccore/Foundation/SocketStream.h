@@ -0,0 +1,11 @@
+#pragma once
+
+#include "Buffer.h"
+
+// blocking, append-only stream over a connected socket. isSeekable() is false, so muxers don't back-patch.
+// seekp() to other than the current position is ignored. after a send error further data is discarded.
+// meant to be wrapped by AsyncSinkStream, which gives it a writer thread and hands it batches of packets via writev().
+// return nullptr if the connection can't be established.
+BinaryStream* CreateTcpSocketStream(const char *host, int port, const fcSocketStreamConfig& conf);
+// POSIX only
+BinaryStream* CreateUnixSocketStream(const char *path, const fcSocketStreamConfig& conf);
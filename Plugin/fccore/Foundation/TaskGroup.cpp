@@ -1,6 +1,7 @@
 ﻿#include "pch.h"
 #include "fcInternal.h"
 #include "TaskGroup.h"
+#include "ThreadPool.h"
 
 TaskGroup::TaskGroup()
 {
@@ -13,8 +14,52 @@ TaskGroup::~TaskGroup()
 
 void TaskGroup::wait()
 {
-    for (auto& f : m_futures) {
-        f.get();
+    Lock l(m_mutex);
+    waitImpl(l, 0);
+}
+
+void TaskGroup::waitOwnTasks()
+{
+    Lock l(m_mutex);
+    waitImpl(l, 0, true);
+}
+
+void TaskGroup::enqueue(const Task& task)
+{
+    ThreadPool::getInstance().enqueue([this, task]() {
+        task();
+        // notify while locked. the group can be destroyed as soon as the waiter wakes up.
+        Lock l(m_mutex);
+        --m_active_tasks;
+        m_condition.notify_all();
+    });
+}
+
+void ParallelFor(int num, int min_chunk, const std::function<void(int, int)>& body)
+{
+    if (num <= 0) { return; }
+
+    // +1 for the calling thread. it is a worker itself if this is called from a task.
+    int max_chunks = ThreadPool::getInstance().getNumThreads() + (ThreadPool::isWorkerThread() ? 0 : 1);
+    int num_chunks = std::min<int>((num + std::max<int>(min_chunk, 1) - 1) / std::max<int>(min_chunk, 1), max_chunks);
+    if (num_chunks <= 1) {
+        body(0, num);
+        return;
+    }
+
+    int chunk_size = (num + num_chunks - 1) / num_chunks;
+    TaskGroup group;
+    group.setMaxTasks(num_chunks);
+    for (int begin = chunk_size; begin < num; begin += chunk_size) {
+        int end = std::min<int>(begin + chunk_size, num);
+        group.run([&body, begin, end]() { body(begin, end); });
     }
-    m_futures.clear();
+    body(0, chunk_size);
+    // ranges not stolen yet are in this worker's queue. anything else may be waiting for the caller.
+    group.waitOwnTasks();
+}
+
+void TaskGroup::waitImpl(Lock& l, int max_active_tasks, bool own_only)
+{
+    ThreadPool::waitHelping(l, m_condition, [this, max_active_tasks]() { return m_active_tasks <= max_active_tasks; }, own_only);
 }
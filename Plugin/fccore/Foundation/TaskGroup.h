@@ -1,32 +1,53 @@
 ﻿#pragma once
 #include <vector>
+#include <algorithm>
 #include <deque>
-#include <future>
+#include <functional>
+#include <mutex>
 #include <atomic>
+#include <condition_variable>
 
+// runs tasks in parallel on the shared ThreadPool. at most max_tasks tasks are in flight at once.
 class TaskGroup
 {
 public:
+    using Task = std::function<void()>;
+    using Lock = std::unique_lock<std::mutex>;
+
     TaskGroup();
     ~TaskGroup();
 
     int getMaxTasks() const { return m_max_tasks; }
     void setMaxTasks(int v) { m_max_tasks = v; }
 
+    // wait until all tasks are done
     void wait();
+    // same as wait(), but a waiting worker only helps with tasks it enqueued itself. for waits inside tasks.
+    void waitOwnTasks();
 
+    // block if max_tasks tasks are in flight
     template<class Body>
     void run(const Body &body)
     {
-        while (m_futures.size() >= (size_t)m_max_tasks) {
-            m_futures.front().get();
-            m_futures.pop_front();
+        {
+            Lock l(m_mutex);
+            waitImpl(l, std::max<int>(m_max_tasks, 1) - 1);
+            ++m_active_tasks;
         }
-
-        m_futures.push_back(std::async(std::launch::async, body));
+        enqueue(body);
     }
 
 private:
-    std::deque<std::future<void>> m_futures;
+    void enqueue(const Task& task);
+    void waitImpl(Lock& l, int max_active_tasks, bool own_only = false);
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    int m_active_tasks = 0;
     int m_max_tasks = 8;
 };
+
+// split [0, num) into ranges of at least min_chunk and call body(begin, end) for them in parallel on the ThreadPool.
+// calling thread processes a range too and returns when all ranges are done.
+void ParallelFor(int num, int min_chunk, const std::function<void(int, int)>& body);
@@ -1,8 +1,19 @@
 #include "pch.h"
+#include "fcInternal.h"
 #include "TaskQueue.h"
+#include "ThreadPool.h"
+#include <cassert>
 
 //#define fcForceSingleThreaded
 
+namespace {
+    // strand whose task is running on current thread
+    thread_local TaskQueue *g_current_strand = nullptr;
+}
+
+// max number of tasks processed in a row before yielding the worker to other strands
+static const int fcStrandBatchSize = 8;
+
 TaskQueue::TaskQueue()
 {
 }
@@ -17,68 +28,92 @@ void TaskQueue::run(const Task& v)
 #ifdef fcForceSingleThreaded
     v();
 #else
-    if (!m_running) {
-        m_thread = std::thread([this]() { process(); });
-        m_running = true;
-    }
-
+    bool schedule = false;
     {
         Lock l(m_mutex);
         m_tasks.push_back(v);
+        if (!m_scheduled) {
+            m_scheduled = schedule = true;
+        }
+    }
+    if (schedule) {
+        ThreadPool::getInstance().enqueue([this]() { process(); });
     }
-    m_condition.notify_one();
 #endif
 }
 
-void TaskQueue::wait()
+bool TaskQueue::wait()
 {
 #ifdef fcForceSingleThreaded
 #else
-    if (m_running) {
-        m_stop = true;
-        m_condition.notify_one();
-        m_thread.join();
-        m_running = false;
-        m_stop = false;
+    if (g_current_strand == this) {
+        // the strand is busy with the caller itself. waiting would never end.
+        fcDebugLog("TaskQueue::wait(): called from a task of the same queue.\n");
+        assert(false && "TaskQueue::wait() called from a task of the same queue");
+        return false;
     }
+    Lock l(m_mutex);
+    ThreadPool::waitHelping(l, m_condition, [this]() { return !m_scheduled; });
 #endif
+    return true;
 }
 
-bool TaskQueue::feed()
+void TaskQueue::process()
 {
-    Task task;
-    {
-        Lock lock(m_mutex);
-        if (!m_tasks.empty()) {
-            task = m_tasks.front();
+    for (int i = 0; i < fcStrandBatchSize; ++i) {
+        Task task;
+        {
+            Lock l(m_mutex);
+            if (m_tasks.empty()) {
+                m_scheduled = false;
+                m_condition.notify_all();
+                return;
+            }
+            task = std::move(m_tasks.front());
             m_tasks.pop_front();
         }
+        auto prev = g_current_strand;
+        g_current_strand = this;
+        task();
+        g_current_strand = prev;
     }
 
-    if (task) {
-        task();
-        return true;
+    // still have tasks. re-schedule to give other strands a chance.
+    ThreadPool::getInstance().enqueue([this]() { process(); });
+}
+
+
+uint64_t OrderedTaskQueue::issue()
+{
+    Lock l(m_mutex);
+    return m_issued++;
+}
+
+void OrderedTaskQueue::run(uint64_t seq, const Task& v)
+{
+    Lock l(m_mutex);
+    m_pending[seq] = v;
+
+    // hand over tasks that are ready in order. holding the lock keeps the order of m_tasks.run() calls.
+    for (auto i = m_pending.begin(); i != m_pending.end() && i->first == m_next; i = m_pending.begin()) {
+        m_tasks.run(i->second);
+        m_pending.erase(i);
+        ++m_next;
     }
-    else {
-        return false;
+    if (m_next == m_issued) {
+        m_condition.notify_all();
     }
 }
 
-void TaskQueue::process()
+bool OrderedTaskQueue::wait()
 {
-    while (!m_stop || !m_tasks.empty())
+    if (g_current_strand == &m_tasks) {
+        // the tasks of this queue run on m_tasks. same as TaskQueue::wait(), waiting would never end.
+        return m_tasks.wait();
+    }
     {
-        Task task;
-        {
-            Lock lock(m_mutex);
-            while (!m_stop && m_tasks.empty()) {
-                m_condition.wait(lock);
-            }
-            if (m_stop && m_tasks.empty()) { return; }
-
-            task = m_tasks.front();
-            m_tasks.pop_front();
-        }
-        task();
+        Lock l(m_mutex);
+        ThreadPool::waitHelping(l, m_condition, [this]() { return m_next == m_issued; });
     }
+    return m_tasks.wait();
 }
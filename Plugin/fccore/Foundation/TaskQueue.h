@@ -2,6 +2,7 @@
 
 #include <vector>
 #include <deque>
+#include <map>
 #include <memory>
 #include <algorithm>
 #include <functional>
@@ -11,116 +12,55 @@
 #include <condition_variable>
 
 
-template<class T>
-class SharedResources
+// serial strand on the shared ThreadPool.
+// tasks run in the order they are enqueued and never run concurrently with each other,
+// but they don't own a thread - idle strands cost nothing.
+class TaskQueue
 {
 public:
-    using Resource = T;
-    using ResourcePtr = std::shared_ptr<T>;
-    using ResourcePtrs = std::vector<ResourcePtr>;
+    using Task = std::function<void()>;
+    using Tasks = std::deque<Task>;
     using Lock = std::unique_lock<std::mutex>;
 
-    class ResourceHolder
-    {
-    public:
-        ResourceHolder() {}
-        ResourceHolder(SharedResources *owner, ResourcePtr res)
-            : m_owner(owner), m_resource(res)
-        {}
-        ~ResourceHolder()
-        {
-            if (m_owner && m_resource) {
-                if (m_resource.use_count() == 1) {
-                    m_owner->release(m_resource);
-                }
-            }
-        }
-
-        operator bool() const { return m_resource; }
-        Resource& operator*() { return *m_resource; }
-        const Resource& operator*() const { return *m_resource; }
-        Resource* operator->() { return m_resource.get(); }
-        const Resource* operator->() const { return m_resource.get(); }
-
-    private:
-        mutable SharedResources *m_owner = nullptr;
-        ResourcePtr m_resource;
-    };
-
-    template<typename ...Params>
-    void emplace(Params&&... params)
-    {
-        add(new Resource(std::forward<Params>(params)...));
-    }
-
-    void add(Resource *v)
-    {
-        Lock l(m_mutex);
-        m_resources.emplace_back(v);
-        m_max_resources = std::max<size_t>(m_max_resources, m_resources.size());
-    }
-
-    ResourceHolder acquire()
-    {
-        return acquire(std::chrono::hours(24));
-    }
-
-    template<class Rep, class Period>
-    ResourceHolder acquire(std::chrono::duration<Rep, Period> wait_time)
-    {
-        ResourceHolder ret;
-        if (m_max_resources == 0) { return ret; }
-        {
-            Lock l(m_mutex);
-            if (m_resources.empty()) {
-                m_condition.wait_for(l, wait_time);
-            }
-            if (!m_resources.empty()) {
-                ret = { this, m_resources.back() };
-                m_resources.pop_back();
-            }
-        }
-        return ret;
-    }
+    TaskQueue();
+    ~TaskQueue();
+    // wait until all enqueued tasks are done.
+    // must not be called from a task of this queue: the queue can't proceed until the task returns.
+    // such calls assert in debug builds and return false without waiting.
+    bool wait();
+    void run(const Task& v);
 
 private:
-    void release(ResourcePtr v)
-    {
-        {
-            Lock l(m_mutex);
-            m_resources.push_back(v);
-        }
-        m_condition.notify_one();
-    }
+    void process();
 
-private:
-    std::mutex m_mutex;
+    std::mutex              m_mutex;
     std::condition_variable m_condition;
-    ResourcePtrs m_resources;
-    size_t m_max_resources = 0;
+    bool                    m_scheduled = false;
+    Tasks                   m_tasks;
 };
 
 
-class TaskQueue
+// strand that runs tasks in the order of sequence numbers, not in the order they are enqueued.
+// used to put results of tasks running in parallel back in order (e.g. converted frames -> encoder).
+class OrderedTaskQueue
 {
 public:
     using Task = std::function<void()>;
-    using Tasks = std::deque<Task>;
     using Lock = std::unique_lock<std::mutex>;
 
-    TaskQueue();
-    ~TaskQueue();
-    void wait();
-    bool feed();
-    void run(const Task& v);
+    // reserve a sequence number. every issued number must be passed to run() exactly once.
+    uint64_t issue();
+    // can be called from any thread. task runs after tasks of all preceding sequence numbers.
+    void run(uint64_t seq, const Task& v);
+    // wait until tasks of all issued sequence numbers are done. must not be called from a task of this queue.
+    // return false if it is (see TaskQueue::wait()).
+    bool wait();
 
 private:
-    void process();
-
-    std::thread             m_thread;
+    TaskQueue               m_tasks;
     std::mutex              m_mutex;
     std::condition_variable m_condition;
-    std::atomic_bool        m_stop = { false };
-    std::atomic_bool        m_running = { false };
-    Tasks                   m_tasks;
+    std::map<uint64_t, Task> m_pending;
+    uint64_t                m_issued = 0;
+    uint64_t                m_next = 0;
 };
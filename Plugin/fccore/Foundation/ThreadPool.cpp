@@ -0,0 +1,223 @@
+#include "pch.h"
+#include "fcInternal.h"
+#include "ThreadPool.h"
+
+#ifdef fcWindows
+    #include <windows.h>
+#elif defined(fcLinux)
+    #include <pthread.h>
+    #include <sched.h>
+#endif
+
+namespace {
+    // index of the worker running on current thread. -1 if current thread is not a worker.
+    thread_local int g_worker_index = -1;
+}
+
+static void SetThreadAffinity(std::thread& thread, int core)
+{
+#if defined(fcWindows)
+    ::SetThreadAffinityMask((HANDLE)thread.native_handle(), (DWORD_PTR)1 << core);
+#elif defined(fcLinux)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#else
+    // not supported
+    (void)thread; (void)core;
+#endif
+}
+
+
+ThreadPool& ThreadPool::getInstance()
+{
+    static ThreadPool s_instance;
+    return s_instance;
+}
+
+bool ThreadPool::isWorkerThread()
+{
+    return g_worker_index >= 0;
+}
+
+ThreadPool::ThreadPool()
+{
+    startWorkers(0, 0);
+}
+
+ThreadPool::~ThreadPool()
+{
+    std::unique_lock<std::mutex> l(m_config_mutex);
+    stopWorkers();
+
+    // run remaining tasks to make sure nothing is left undone
+    while (tryRunOne()) {}
+}
+
+void ThreadPool::configure(int num_threads, uint64_t core_mask)
+{
+    std::unique_lock<std::mutex> l(m_config_mutex);
+    stopWorkers();
+    startWorkers(num_threads, core_mask);
+}
+
+int ThreadPool::getNumThreads() const
+{
+    return m_num_threads.load(std::memory_order_relaxed);
+}
+
+uint64_t ThreadPool::getCoreMask() const
+{
+    return m_core_mask.load(std::memory_order_relaxed);
+}
+
+void ThreadPool::startWorkers(int num_threads, uint64_t core_mask)
+{
+    std::vector<int> cores;
+    for (int i = 0; i < 64; ++i) {
+        if (core_mask & ((uint64_t)1 << i)) { cores.push_back(i); }
+    }
+
+    if (num_threads <= 0) {
+        num_threads = !cores.empty() ? (int)cores.size() : (int)std::thread::hardware_concurrency();
+    }
+    num_threads = std::max<int>(num_threads, 1);
+
+    m_core_mask = core_mask;
+    m_num_threads = num_threads;
+    m_stop = false;
+    m_workers.resize(num_threads);
+    for (auto& w : m_workers) {
+        w.reset(new Worker());
+    }
+    for (int i = 0; i < num_threads; ++i) {
+        auto& w = *m_workers[i];
+        w.thread = std::thread([this, i]() { process(i); });
+        if (!cores.empty()) {
+            SetThreadAffinity(w.thread, cores[i % cores.size()]);
+        }
+    }
+}
+
+void ThreadPool::stopWorkers()
+{
+    {
+        Lock l(m_mutex);
+        m_stop = true;
+    }
+    m_condition.notify_all();
+    for (auto& w : m_workers) {
+        w->thread.join();
+    }
+
+    // hand tasks left in workers' queues to the global queue
+    {
+        Lock l(m_mutex);
+        for (auto& w : m_workers) {
+            m_tasks.insert(m_tasks.end(), w->tasks.begin(), w->tasks.end());
+        }
+    }
+    m_workers.clear();
+}
+
+void ThreadPool::enqueue(const Task& task)
+{
+    int index = g_worker_index;
+    if (index >= 0) {
+        auto& w = *m_workers[index];
+        Lock l(w.mutex);
+        w.tasks.push_back(task);
+    }
+    else {
+        Lock l(m_mutex);
+        m_tasks.push_back(task);
+    }
+
+    {
+        Lock l(m_mutex);
+        ++m_num_pending;
+    }
+    m_condition.notify_one();
+}
+
+bool ThreadPool::tryRunOne(bool own_only)
+{
+    Task task;
+    int index = g_worker_index;
+    bool popped = own_only ?
+        index >= 0 && popOwnTask(index, task) :
+        popTask(index, task) || stealTask(index, task);
+    if (popped) {
+        --m_num_pending;
+        task();
+        return true;
+    }
+    return false;
+}
+
+bool ThreadPool::popOwnTask(int index, Task& dst)
+{
+    // LIFO - most recent task is likely to be hot in cache
+    auto& w = *m_workers[index];
+    Lock l(w.mutex);
+    if (!w.tasks.empty()) {
+        dst = std::move(w.tasks.back());
+        w.tasks.pop_back();
+        return true;
+    }
+    return false;
+}
+
+bool ThreadPool::popTask(int index, Task& dst)
+{
+    // own queue first
+    if (index >= 0 && popOwnTask(index, dst)) {
+        return true;
+    }
+    {
+        Lock l(m_mutex);
+        if (!m_tasks.empty()) {
+            dst = std::move(m_tasks.front());
+            m_tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ThreadPool::stealTask(int index, Task& dst)
+{
+    if (index < 0) { return false; }
+
+    // steal oldest task from other workers
+    int n = (int)m_workers.size();
+    for (int i = 1; i < n; ++i) {
+        auto& w = *m_workers[(index + i) % n];
+        Lock l(w.mutex);
+        if (!w.tasks.empty()) {
+            dst = std::move(w.tasks.front());
+            w.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::process(int index)
+{
+    g_worker_index = index;
+    for (;;) {
+        Task task;
+        if (popTask(index, task) || stealTask(index, task)) {
+            --m_num_pending;
+            task();
+            continue;
+        }
+
+        Lock l(m_mutex);
+        if (m_stop) { break; }
+        m_condition.wait(l, [this]() { return m_stop || m_num_pending > 0; });
+    }
+    g_worker_index = -1;
+}
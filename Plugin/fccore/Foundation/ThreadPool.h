@@ -0,0 +1,96 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+
+
+// process-wide work-stealing executor shared by all contexts.
+// each worker has its own deque. tasks enqueued from a worker go to its deque and idle workers steal from others.
+// tasks enqueued from other threads go to the global queue.
+class ThreadPool
+{
+public:
+    using Task = std::function<void()>;
+    using Tasks = std::deque<Task>;
+    using Lock = std::unique_lock<std::mutex>;
+
+    static ThreadPool& getInstance();
+    static bool isWorkerThread();
+
+    // num_threads: 0 means std::thread::hardware_concurrency()
+    // core_mask: bit n pins workers to core n. 0 means no pinning.
+    // pending tasks are kept across reconfiguration. must not be called from a task.
+    void configure(int num_threads, uint64_t core_mask);
+    int getNumThreads() const;
+    uint64_t getCoreMask() const;
+
+    void enqueue(const Task& task);
+
+    // pop a task and run it on the calling thread. return false if there is no task.
+    // used by waits on worker threads to keep things going instead of blocking a worker.
+    // own_only: take only tasks the calling worker enqueued itself.
+    bool tryRunOne(bool own_only = false);
+
+    // wait on cond until pred() returns true. l must hold the mutex that guards pred and cond.
+    // on worker threads, blocking may starve the pool, so pending tasks are run meanwhile.
+    // when there is nothing to run it blocks on cond, but wakes up now and then as tasks may be enqueued later.
+    // own_only: run only tasks the worker enqueued itself (e.g. ranges of its ParallelFor). for waits inside
+    // tasks - other tasks may wait for the waiting one (e.g. an async delete of its context) and would never return.
+    template<class Pred>
+    static void waitHelping(Lock& l, std::condition_variable& cond, Pred pred, bool own_only = false)
+    {
+        if (!isWorkerThread()) {
+            cond.wait(l, pred);
+            return;
+        }
+        while (!pred()) {
+            l.unlock();
+            bool ran = getInstance().tryRunOne(own_only);
+            l.lock();
+            if (!ran && !pred()) {
+                cond.wait_for(l, std::chrono::milliseconds(1));
+            }
+        }
+    }
+
+private:
+    ThreadPool();
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    struct Worker
+    {
+        std::thread thread;
+        std::mutex mutex;
+        Tasks tasks;
+    };
+    using WorkerPtr = std::unique_ptr<Worker>;
+
+    void startWorkers(int num_threads, uint64_t core_mask);
+    void stopWorkers();
+    void process(int index);
+    bool popOwnTask(int index, Task& dst);
+    bool popTask(int index, Task& dst);
+    bool stealTask(int index, Task& dst);
+
+private:
+    std::mutex              m_config_mutex;
+    std::vector<WorkerPtr>  m_workers;
+    // copies for getNumThreads() / getCoreMask(). they can be called from tasks while configure() holds m_config_mutex.
+    std::atomic_int         m_num_threads = { 0 };
+    std::atomic<uint64_t>   m_core_mask = { 0 };
+
+    std::mutex              m_mutex;
+    std::condition_variable m_condition;
+    Tasks                   m_tasks;
+    std::atomic_int         m_num_pending = { 0 };
+    std::atomic_bool        m_stop = { false };
+};
@@ -1,7 +1,9 @@
 #include "pch.h"
 #include "fcInternal.h"
 #include "YUV.h"
+#include "TaskGroup.h"
 #include "Misc.h"
+#include "ConvertKernel.h"
 
 #include <libyuv.h>
 #ifdef _WIN32
@@ -9,19 +11,115 @@
 #endif
 
 
+// call body(y_begin, y_end) for bands of rows in parallel.
+// bands have even number of rows (except last one) as 4:2:0 chroma rows are shared by two luma rows.
+template<class Body>
+static void EachRowBands(int width, int height, const Body& body)
+{
+    int band_size = fcGetMinConvertBandSizeImpl();
+    if (band_size == 0) {
+        body(0, height);
+        return;
+    }
+
+    int min_rows = std::max<int>(band_size / std::max<int>(width, 1), 2);
+    ParallelFor((height + 1) / 2, (min_rows + 1) / 2, [&](int begin, int end) {
+        body(begin * 2, std::min<int>(end * 2, height));
+    });
+}
+
+// formats that ConvertKernel can convert to I420 / NV12 directly
+static bool IsDirectlyConvertibleToYUV(fcPixelFormat fmt)
+{
+    switch (fmt) {
+    case fcPixelFormat_RGBAu8:
+    case fcPixelFormat_RGBu8:
+    case fcPixelFormat_RGBAf16:
+    case fcPixelFormat_RGBf16:
+    case fcPixelFormat_RGBAf32:
+    case fcPixelFormat_RGBf32:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// libyuv is faster for 8 bit input. kernels in ConvertKernel are used when libyuv can't do it in one pass
+// or other than BT.601 limited range is required.
+static bool UseLibYUV(fcPixelFormat fmt, const YUVConvertOptions& opt)
+{
+    return (fmt == fcPixelFormat_RGBAu8 || fmt == fcPixelFormat_RGBu8) && !opt.linear_to_srgb &&
+        opt.matrix == fcColorMatrix::BT601 && opt.range == fcColorRange::Limited;
+}
+
+// coefficients for ConvertKernel: Y, Cb, Cr rows of { r, g, b, offset } scaled to output range
+static void GetYUVCoefficients(float (&dst)[12], const YUVConvertOptions& opt)
+{
+    float kr, kb;
+    switch (opt.matrix) {
+    case fcColorMatrix::BT709:  kr = 0.2126f; kb = 0.0722f; break;
+    case fcColorMatrix::BT2020: kr = 0.2627f; kb = 0.0593f; break;
+    default:                    kr = 0.299f;  kb = 0.114f;  break;
+    }
+    float kg = 1.0f - kr - kb;
+
+    bool full = opt.range == fcColorRange::Full;
+    float ys = full ? 255.0f : 219.0f;
+    float yo = full ? 0.0f : 16.0f;
+    float cs = full ? 255.0f : 224.0f;
+    float cb = cs / (2.0f * (1.0f - kb));
+    float cr = cs / (2.0f * (1.0f - kr));
+
+    // +0.5 for rounding
+    float coef[12] = {
+        kr * ys,  kg * ys,  kb * ys,  yo + 0.5f,
+        -kr * cb, -kg * cb, cs * 0.5f, 128.5f,
+        cs * 0.5f, -kg * cr, -kb * cr, 128.5f,
+    };
+    memcpy(dst, coef, sizeof(coef));
+}
+
+YUVColorDescription GetYUVColorDescription(fcColorMatrix matrix, fcColorRange range)
+{
+    YUVColorDescription ret;
+    switch (matrix) {
+    case fcColorMatrix::BT601:  ret.primaries = 6; ret.transfer = 6;  ret.matrix = 6; break;
+    case fcColorMatrix::BT709:  ret.primaries = 1; ret.transfer = 1;  ret.matrix = 1; break;
+    case fcColorMatrix::BT2020: ret.primaries = 9; ret.transfer = 14; ret.matrix = 9; break;
+    }
+    ret.full_range = range == fcColorRange::Full;
+    return ret;
+}
+
+
 // I420
 
+static size_t GetI420Size(int width, int height)
+{
+    return (size_t)width * height + (size_t)((width + 1) / 2) * ((height + 1) / 2) * 2;
+}
+
+static void SetupI420(I420Data& dst, void *pixels, int width, int height)
+{
+    int cw = (width + 1) / 2;
+    int ch = (height + 1) / 2;
+    dst.y = pixels;
+    dst.u = (char*)dst.y + (size_t)width * height;
+    dst.v = (char*)dst.u + (size_t)cw * ch;
+    dst.pitch_y = width;
+    dst.pitch_u = dst.pitch_v = cw;
+    dst.height = height;
+}
+
 void I420Image::resize(int width, int height)
 {
-    int s = roundup<2>(width) * roundup<2>(height);
-    int sq = s / 4;
-    m_buffer.resize(s + sq + sq);
-    m_data.y = m_buffer.data();
-    m_data.u = (char*)m_data.y + s;
-    m_data.v = (char*)m_data.u + sq;
-    m_data.pitch_y = width;
-    m_data.pitch_u = m_data.pitch_v = width / 4;
-    m_data.height = height;
+    m_buffer.resize(GetI420Size(width, height));
+    SetupI420(m_data, m_buffer.data(), width, height);
+}
+
+void I420Image::attach(const void *pixels, int width, int height)
+{
+    SetupI420(m_data, (void*)pixels, width, height);
 }
 
 size_t I420Image::size() const
@@ -37,49 +135,84 @@ const I420Data& I420Image::data() const
     return m_data;
 }
 
-void AnyToI420(I420Image& dst, Buffer& tmp, const void *pixels, fcPixelFormat fmt, int width, int height)
+void AnyToI420(I420Image& dst, Buffer& tmp, const void *pixels, fcPixelFormat fmt, int width, int height,
+    int src_pitch, const YUVConvertOptions& opt)
 {
-    if (fmt != fcPixelFormat_RGBAu8 && fmt != fcPixelFormat_RGBu8) {
+    if (fmt == fcPixelFormat_I420) {
+        // already converted
+        dst.attach(pixels, width, height);
+        return;
+    }
+    if (!IsDirectlyConvertibleToYUV(fmt)) {
         tmp.resize(width * height * 4);
-        fcConvertPixelFormat(tmp.data(), fcPixelFormat_RGBAu8, pixels, fmt, width * height);
+        fcConvertPixelFormat2D(tmp.data(), fcPixelFormat_RGBAu8, 0, pixels, fmt, src_pitch, width, height);
         pixels = tmp.data();
         fmt = fcPixelFormat_RGBAu8;
+        src_pitch = 0;
     }
 
     dst.resize(width, height);
     auto& data = dst.data();
-    if (fmt == fcPixelFormat_RGBAu8) {
-        libyuv::ABGRToI420(
-            (const uint8*)pixels, width * 4,
-            (uint8*)data.y, width,
-            (uint8*)data.u, width >> 1,
-            (uint8*)data.v, width >> 1,
-            width, height);
-    }
-    else if (fmt == fcPixelFormat_RGBu8) {
-        libyuv::RAWToI420(
-            (const uint8*)pixels, width * 3,
-            (uint8*)data.y, width,
-            (uint8*)data.u, width >> 1,
-            (uint8*)data.v, width >> 1,
-            width, height);
-    }
+    auto *top = (const uint8*)fcGetTopRow(pixels, src_pitch, width, height, fmt);
+    int pitch_uv = data.pitch_u;
+    bool libyuv = UseLibYUV(fmt, opt);
+    bool srgb = opt.linear_to_srgb;
+    float coef[12];
+    GetYUVCoefficients(coef, opt);
+    EachRowBands(width, height, [&](int y_begin, int y_end) {
+        auto *src = top + (ptrdiff_t)src_pitch * y_begin;
+        auto *y = (uint8*)data.y + width * y_begin;
+        auto *u = (uint8*)data.u + pitch_uv * (y_begin / 2);
+        auto *v = (uint8*)data.v + pitch_uv * (y_begin / 2);
+        int rows = y_end - y_begin;
+        if (libyuv) {
+            if (fmt == fcPixelFormat_RGBAu8) {
+                libyuv::ABGRToI420(src, src_pitch, y, width, u, pitch_uv, v, pitch_uv, width, rows);
+            }
+            else if (fmt == fcPixelFormat_RGBu8) {
+                libyuv::RAWToI420(src, src_pitch, y, width, u, pitch_uv, v, pitch_uv, width, rows);
+            }
+            return;
+        }
+        switch (fmt) {
+        case fcPixelFormat_RGBAu8: ispc::RGBAu8ToI420(y, u, v, width, pitch_uv, (const uint8_t*)src, src_pitch, width, rows, srgb, coef); break;
+        case fcPixelFormat_RGBu8: ispc::RGBu8ToI420(y, u, v, width, pitch_uv, (const uint8_t*)src, src_pitch, width, rows, srgb, coef); break;
+        case fcPixelFormat_RGBAf16: ispc::RGBAf16ToI420(y, u, v, width, pitch_uv, (const int16_t*)src, src_pitch / 2, width, rows, srgb, coef); break;
+        case fcPixelFormat_RGBf16: ispc::RGBf16ToI420(y, u, v, width, pitch_uv, (const int16_t*)src, src_pitch / 2, width, rows, srgb, coef); break;
+        case fcPixelFormat_RGBAf32: ispc::RGBAf32ToI420(y, u, v, width, pitch_uv, (const float*)src, src_pitch / 4, width, rows, srgb, coef); break;
+        case fcPixelFormat_RGBf32: ispc::RGBf32ToI420(y, u, v, width, pitch_uv, (const float*)src, src_pitch / 4, width, rows, srgb, coef); break;
+        default: break;
+        }
+    });
 }
 
 
 
 // NV12
 
+static size_t GetNV12Size(int width, int height)
+{
+    return (size_t)width * height + (size_t)roundup<2>(width) * ((height + 1) / 2);
+}
+
+static void SetupNV12(NV12Data& dst, void *pixels, int width, int height)
+{
+    dst.y = pixels;
+    dst.uv = (char*)dst.y + (size_t)width * height;
+    dst.pitch_y = width;
+    dst.pitch_uv = roundup<2>(width);
+    dst.height = height;
+}
+
 void NV12Image::resize(int width, int height)
 {
-    int s = roundup<2>(width) * roundup<2>(height);
-    int sh = s / 2;
-    m_buffer.resize(s + sh);
-    m_data.y = m_buffer.data();
-    m_data.uv = (char*)m_data.y + s;
-    m_data.pitch_y = width;
-    m_data.pitch_uv = width / 2;
-    m_data.height = height;
+    m_buffer.resize(GetNV12Size(width, height));
+    SetupNV12(m_data, m_buffer.data(), width, height);
+}
+
+void NV12Image::attach(const void *pixels, int width, int height)
+{
+    SetupNV12(m_data, (void*)pixels, width, height);
 }
 
 size_t NV12Image::size() const
@@ -95,22 +228,122 @@ const NV12Data& NV12Image::data() const
     return m_data;
 }
 
-void AnyToNV12(NV12Image& dst, Buffer& tmp, const void *pixels, fcPixelFormat fmt, int width, int height)
+void AnyToNV12(NV12Image& dst, Buffer& tmp, const void *pixels, fcPixelFormat fmt, int width, int height,
+    int src_pitch, const YUVConvertOptions& opt)
 {
-    if (fmt != fcPixelFormat_RGBAu8) {
+    if (fmt == fcPixelFormat_NV12) {
+        // already converted
+        dst.attach(pixels, width, height);
+        return;
+    }
+    if (fmt == fcPixelFormat_I420) {
+        I420Image src;
+        src.attach(pixels, width, height);
+        auto& sdata = src.data();
+        dst.resize(width, height);
+        auto& data = dst.data();
+        EachRowBands(width, height, [&](int y_begin, int y_end) {
+            libyuv::I420ToNV12(
+                (const uint8*)sdata.y + width * y_begin, width,
+                (const uint8*)sdata.u + sdata.pitch_u * (y_begin / 2), sdata.pitch_u,
+                (const uint8*)sdata.v + sdata.pitch_v * (y_begin / 2), sdata.pitch_v,
+                (uint8*)data.y + width * y_begin, width,
+                (uint8*)data.uv + data.pitch_uv * (y_begin / 2), data.pitch_uv,
+                width, y_end - y_begin);
+        });
+        return;
+    }
+    if (!IsDirectlyConvertibleToYUV(fmt)) {
         tmp.resize(width * height * 4);
-        fcConvertPixelFormat(tmp.data(), fcPixelFormat_RGBAu8, pixels, fmt, width * height);
+        fcConvertPixelFormat2D(tmp.data(), fcPixelFormat_RGBAu8, 0, pixels, fmt, src_pitch, width, height);
         pixels = tmp.data();
         fmt = fcPixelFormat_RGBAu8;
+        src_pitch = 0;
     }
 
     dst.resize(width, height);
     auto& data = dst.data();
-    if (fmt == fcPixelFormat_RGBAu8) {
-        libyuv::ARGBToNV12(
-            (const uint8*)pixels, width * 4,
-            (uint8*)data.y, width,
-            (uint8*)data.uv, width,
-            width, height);
+    auto *top = (const uint8*)fcGetTopRow(pixels, src_pitch, width, height, fmt);
+    bool libyuv = fmt == fcPixelFormat_RGBAu8 && UseLibYUV(fmt, opt);
+    bool srgb = opt.linear_to_srgb;
+    float coef[12];
+    GetYUVCoefficients(coef, opt);
+    int pitch_uv = data.pitch_uv;
+    EachRowBands(width, height, [&](int y_begin, int y_end) {
+        auto *src = top + (ptrdiff_t)src_pitch * y_begin;
+        auto *y = (uint8*)data.y + width * y_begin;
+        auto *uv = (uint8*)data.uv + pitch_uv * (y_begin / 2);
+        int rows = y_end - y_begin;
+        if (libyuv) {
+            libyuv::ARGBToNV12(src, src_pitch, y, width, uv, pitch_uv, width, rows);
+            return;
+        }
+        switch (fmt) {
+        case fcPixelFormat_RGBAu8: ispc::RGBAu8ToNV12(y, uv, width, pitch_uv, (const uint8_t*)src, src_pitch, width, rows, srgb, coef); break;
+        case fcPixelFormat_RGBu8: ispc::RGBu8ToNV12(y, uv, width, pitch_uv, (const uint8_t*)src, src_pitch, width, rows, srgb, coef); break;
+        case fcPixelFormat_RGBAf16: ispc::RGBAf16ToNV12(y, uv, width, pitch_uv, (const int16_t*)src, src_pitch / 2, width, rows, srgb, coef); break;
+        case fcPixelFormat_RGBf16: ispc::RGBf16ToNV12(y, uv, width, pitch_uv, (const int16_t*)src, src_pitch / 2, width, rows, srgb, coef); break;
+        case fcPixelFormat_RGBAf32: ispc::RGBAf32ToNV12(y, uv, width, pitch_uv, (const float*)src, src_pitch / 4, width, rows, srgb, coef); break;
+        case fcPixelFormat_RGBf32: ispc::RGBf32ToNV12(y, uv, width, pitch_uv, (const float*)src, src_pitch / 4, width, rows, srgb, coef); break;
+        default: break;
+        }
+    });
+}
+
+
+// YUVImage
+
+bool YUVImage::convert(const void *pixels, fcPixelFormat fmt, fcPixelFormat dst_fmt, int width, int height,
+    int src_pitch, const YUVConvertOptions& opt)
+{
+    m_format = dst_fmt;
+    if (dst_fmt == fcPixelFormat_I420) {
+        if (fmt == fcPixelFormat_I420) {
+            // source is released after conversion. keep own copy.
+            I420Image src;
+            src.attach(pixels, width, height);
+            auto& s = src.data();
+            m_i420.resize(width, height);
+            auto& d = m_i420.data();
+            libyuv::I420Copy(
+                (const uint8*)s.y, s.pitch_y, (const uint8*)s.u, s.pitch_u, (const uint8*)s.v, s.pitch_v,
+                (uint8*)d.y, d.pitch_y, (uint8*)d.u, d.pitch_u, (uint8*)d.v, d.pitch_v,
+                width, height);
+        }
+        else {
+            AnyToI420(m_i420, m_tmp, pixels, fmt, width, height, src_pitch, opt);
+        }
+        return true;
+    }
+    else if (dst_fmt == fcPixelFormat_NV12) {
+        if (fmt == fcPixelFormat_NV12) {
+            NV12Image src;
+            src.attach(pixels, width, height);
+            auto& s = src.data();
+            m_nv12.resize(width, height);
+            auto& d = m_nv12.data();
+            libyuv::CopyPlane((const uint8*)s.y, s.pitch_y, (uint8*)d.y, d.pitch_y, width, height);
+            libyuv::CopyPlane((const uint8*)s.uv, s.pitch_uv, (uint8*)d.uv, d.pitch_uv, s.pitch_uv, (height + 1) / 2);
+        }
+        else {
+            AnyToNV12(m_nv12, m_tmp, pixels, fmt, width, height, src_pitch, opt);
+        }
+        return true;
     }
+    m_format = fcPixelFormat_Unknown;
+    return false;
+}
+
+const void* YUVImage::data() const
+{
+    switch (m_format) {
+    case fcPixelFormat_I420: return m_i420.data().y;
+    case fcPixelFormat_NV12: return m_nv12.data().y;
+    default: return nullptr;
+    }
+}
+
+fcPixelFormat YUVImage::format() const
+{
+    return m_format;
 }
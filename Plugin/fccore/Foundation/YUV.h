@@ -4,7 +4,27 @@
 #include "PixelFormat.h"
 
 
+struct YUVConvertOptions
+{
+    // encode linear color to sRGB before conversion. mainly for float / half render targets in linear color space.
+    bool linear_to_srgb = false;
+    fcColorMatrix matrix = fcColorMatrix::BT601;
+    fcColorRange range = fcColorRange::Limited;
+};
+
+// code points of ITU-T H.273. used for color metadata in containers (mp4 'colr', matroska Colour).
+struct YUVColorDescription
+{
+    int primaries = 2;          // 2: unspecified
+    int transfer = 2;
+    int matrix = 2;
+    bool full_range = false;
+};
+YUVColorDescription GetYUVColorDescription(fcColorMatrix matrix, fcColorRange range);
+
+
 // I420
+// packed layout: y (width x height), then u and v ((width+1)/2 x (height+1)/2 each).
 
 struct I420Data
 {
@@ -21,6 +41,8 @@ class I420Image
 {
 public:
     void resize(int width, int height);
+    // refer packed I420 pixels (fcPixelFormat_I420) instead of own buffer. no copy.
+    void attach(const void *pixels, int width, int height);
     size_t size() const;
     I420Data& data();
     const I420Data& data() const;
@@ -30,10 +52,15 @@ private:
     I420Data m_data;
 };
 
-void AnyToI420(I420Image& dst, Buffer& tmp, const void *pixels, fcPixelFormat fmt, int width, int height);
+// if fmt is fcPixelFormat_I420, dst just refers pixels.
+// RGB(A) u8 / f16 / f32 are converted in one pass. other formats go through RGBAu8 in tmp.
+// src_pitch: see fcGetPitch(). bottom-up images are flipped in the conversion. ignored for I420 / NV12 input.
+void AnyToI420(I420Image& dst, Buffer& tmp, const void *pixels, fcPixelFormat fmt, int width, int height,
+    int src_pitch = 0, const YUVConvertOptions& opt = YUVConvertOptions());
 
 
 // NV12
+// packed layout: y (width x height), then interleaved uv ((width+1)/2 pairs x (height+1)/2).
 
 struct NV12Data
 {
@@ -48,6 +75,8 @@ class NV12Image
 {
 public:
     void resize(int width, int height);
+    // refer packed NV12 pixels (fcPixelFormat_NV12) instead of own buffer. no copy.
+    void attach(const void *pixels, int width, int height);
     size_t size() const;
     NV12Data& data();
     const NV12Data& data() const;
@@ -59,4 +88,25 @@ private:
 
 void RGBAToNV12(NV12Image& dst, const void *rgba_pixels, int width, int height);
 void RGBAToNV12(const NV12Data& dst, const void *rgba_pixels, int width, int height);
-void AnyToNV12(NV12Image& dst, Buffer& tmp, const void *pixels, fcPixelFormat fmt, int width, int height);
+// if fmt is fcPixelFormat_NV12, dst just refers pixels.
+void AnyToNV12(NV12Image& dst, Buffer& tmp, const void *pixels, fcPixelFormat fmt, int width, int height,
+    int src_pitch = 0, const YUVConvertOptions& opt = YUVConvertOptions());
+
+
+// frame converted to I420 or NV12 ahead of encoding.
+// contexts use this to run conversion in parallel and hand packed planes to encoders.
+class YUVImage
+{
+public:
+    // dst_fmt: fcPixelFormat_I420 or fcPixelFormat_NV12
+    bool convert(const void *pixels, fcPixelFormat fmt, fcPixelFormat dst_fmt, int width, int height,
+        int src_pitch = 0, const YUVConvertOptions& opt = YUVConvertOptions());
+    const void* data() const;
+    fcPixelFormat format() const;
+
+private:
+    I420Image m_i420;
+    NV12Image m_nv12;
+    Buffer m_tmp;
+    fcPixelFormat m_format = fcPixelFormat_Unknown;
+};
@@ -3,8 +3,18 @@
 #include "../fccore.h"
 #include "Misc.h"
 #include "Buffer.h"
+#include "FileStream.h"
+#include "AsyncSinkStream.h"
+#include "SharedMemoryStream.h"
+#include "SocketStream.h"
+#include "ProcessStream.h"
+#include "PathPolicy.h"
+#include "ImagePack.h"
 #include "PixelFormat.h"
 #include "YUV.h"
 #include "LazyInstance.h"
+#include "ThreadPool.h"
+#include "Semaphore.h"
 #include "TaskGroup.h"
 #include "TaskQueue.h"
+#include "ResourcePool.h"
@@ -5,6 +5,12 @@
 class fcAsyncDeleteManager
 {
 public:
+    fcAsyncDeleteManager()
+    {
+        // make sure the thread pool is constructed first. it must outlive us as our destructor relies on it.
+        ThreadPool::getInstance();
+    }
+
     ~fcAsyncDeleteManager()
     {
         wait();
@@ -12,7 +18,6 @@ public:
 
     void wait()
     {
-        while (m_task_queue.feed()) {}
         m_task_queue.wait();
     }
 
@@ -57,3 +62,8 @@ void fcContextBase::setOnDeleteCallback(std::function<void()> v)
 {
     m_on_delete = v;
 }
+
+bool fcContextBase::getBufferPoolStats(fcBufferPoolType, fcBufferPoolStats&)
+{
+    return false;
+}
@@ -41,6 +41,8 @@
 
     #define fcSupportWave
     #define fcSupportFlac
+
+    #define fcSupportY4M
 #endif
 
 #define fcEnableLogging
@@ -53,6 +55,9 @@
 #endif
 
 
+enum class fcBufferPoolType;
+struct fcBufferPoolStats;
+
 class fcContextBase
 {
 protected:
@@ -60,6 +65,7 @@ protected:
 public:
     virtual void release();
     virtual void setOnDeleteCallback(std::function<void()> cb);
+    virtual bool getBufferPoolStats(fcBufferPoolType type, fcBufferPoolStats& dst);
 
 private:
     std::function<void()> m_on_delete;
@@ -34,15 +34,77 @@ fcAPI fcTime fcGetTime()
     return GetCurrentTimeInSeconds();
 }
 
+fcAPI void fcSetThreadPoolConfig(int num_threads, uint64_t core_mask)
+{
+    fcTraceFunc();
+    ThreadPool::getInstance().configure(num_threads, core_mask);
+}
+
+fcAPI int fcGetThreadPoolSize()
+{
+    fcTraceFunc();
+    return ThreadPool::getInstance().getNumThreads();
+}
+
+fcAPI void fcSetMinConvertBandSize(int num_pixels)
+{
+    fcTraceFunc();
+    fcSetMinConvertBandSizeImpl(num_pixels);
+}
+
+fcAPI int fcGetMinConvertBandSize()
+{
+    fcTraceFunc();
+    return fcGetMinConvertBandSizeImpl();
+}
+
+// wrap s with BufferedStream unless buffering is disabled. takes over the reference of s.
+static fcStream* fcWrapBufferedStream(fcStream *s)
+{
+    size_t block_size = fcGetStreamBufferSizeImpl();
+    if (block_size == 0) { return s; }
+    auto ret = new BufferedStream(s, block_size);
+    s->release();
+    return ret;
+}
+
+fcAPI void fcSetStreamBufferSize(int size)
+{
+    fcTraceFunc();
+    fcSetStreamBufferSizeImpl((size_t)std::max<int>(size, 0));
+}
+
+fcAPI int fcGetStreamBufferSize()
+{
+    fcTraceFunc();
+    return (int)fcGetStreamBufferSizeImpl();
+}
+
 fcAPI fcStream* fcCreateFileStream(const char *path)
 {
     fcTraceFunc();
-    return new StdIOStream(new std::fstream(path, std::ios::binary | std::ios::in | std::ios::out | std::ios::trunc), true);
+    return fcCreateFileStreamEx(path, nullptr);
+}
+
+fcAPI fcStream* fcCreateFileStreamEx(const char *path, const fcFileStreamConfig *conf)
+{
+    fcTraceFunc();
+    fcFileStreamConfig c = conf ? *conf : fcFileStreamConfig();
+    if (c.async_io) {
+        // has its own blocks. no need to be buffered.
+        if (auto *s = CreateAsyncFileStream(path, c)) {
+            return s;
+        }
+    }
+    if (auto *s = CreatePosixFileStream(path, c)) {
+        return fcWrapBufferedStream(s);
+    }
+    return fcWrapBufferedStream(new StdIOStream(new std::fstream(path, std::ios::binary | std::ios::in | std::ios::out | std::ios::trunc), true));
 }
 fcAPI fcStream* fcCreateMemoryStream()
 {
     fcTraceFunc();
-    return new BufferStream(new Buffer(), true);
+    return new ChunkedBufferStream();
 }
 fcAPI fcStream* fcCreateCustomStream(void *obj, fcTellp_t tellp, fcSeekp_t seekp, fcWrite_t write)
 {
@@ -52,7 +114,18 @@ fcAPI fcStream* fcCreateCustomStream(void *obj, fcTellp_t tellp, fcSeekp_t seekp
     csd.tellp = tellp;
     csd.seekp = seekp;
     csd.write = write;
-    return new CustomStream(csd);
+    return fcWrapBufferedStream(new CustomStream(csd));
+}
+fcAPI fcStream* fcCreateCustomStreamV(void *obj, fcTellp_t tellp, fcSeekp_t seekp, fcWriteV_t writev, fcFlush_t flush)
+{
+    fcTraceFunc();
+    CustomStreamData csd;
+    csd.obj = obj;
+    csd.tellp = tellp;
+    csd.seekp = seekp;
+    csd.writev = writev;
+    csd.flush = flush;
+    return fcWrapBufferedStream(new CustomStream(csd));
 }
 
 fcAPI void fcReleaseStream(fcStream *s)
@@ -65,19 +138,130 @@ fcAPI fcBufferData fcStreamGetBufferData(fcStream *s)
 {
     fcTraceFunc();
     fcBufferData ret;
-    if (BufferStream *bs = dynamic_cast<BufferStream*>(s)) {
+    if (auto *cs = dynamic_cast<ChunkedBufferStream*>(s)) {
+        auto& flat = cs->flatten();
+        ret.data = (void*)flat.data();
+        ret.size = flat.size();
+    }
+    else if (auto *bs = dynamic_cast<BufferStream*>(s)) {
         ret.data = bs->get().data();
         ret.size = bs->get().size();
     }
     return ret;
 }
 
+fcAPI int fcStreamGetNumChunks(fcStream *s)
+{
+    fcTraceFunc();
+    if (auto *cs = dynamic_cast<ChunkedBufferStream*>(s)) {
+        return (int)cs->getNumChunks();
+    }
+    return 0;
+}
+
+fcAPI fcBufferData fcStreamGetChunk(fcStream *s, int i)
+{
+    fcTraceFunc();
+    fcBufferData ret;
+    if (auto *cs = dynamic_cast<ChunkedBufferStream*>(s)) {
+        ret.data = (void*)cs->getChunk((size_t)i, ret.size);
+    }
+    return ret;
+}
+
 fcAPI uint64_t fcStreamGetWrittenSize(fcStream *s)
 {
     fcTraceFunc();
     return s->tellp();
 }
 
+fcAPI void fcStreamFlush(fcStream *s)
+{
+    fcTraceFunc();
+    s->flush();
+}
+
+fcAPI bool fcStreamGetStats(fcStream *s, fcStreamStats *dst)
+{
+    fcTraceFunc();
+    if (!s || !dst) { return false; }
+    return s->getStats(*dst);
+}
+
+fcAPI fcStream* fcCreateAsyncSink(fcStream *s, const fcAsyncSinkConfig *conf)
+{
+    fcTraceFunc();
+    if (!s) { return nullptr; }
+    return new AsyncSinkStream(s, conf ? *conf : fcAsyncSinkConfig());
+}
+
+fcAPI bool fcAsyncSinkGetStats(fcStream *s, fcAsyncSinkStats *dst)
+{
+    fcTraceFunc();
+    auto *as = dynamic_cast<AsyncSinkStream*>(s);
+    if (!as || !dst) { return false; }
+    as->getSinkStats(*dst);
+    return true;
+}
+
+fcAPI fcStream* fcCreateAsyncFanOut(fcStream **sinks, int num_sinks)
+{
+    fcTraceFunc();
+    if (!sinks || num_sinks <= 0) { return nullptr; }
+    std::vector<AsyncSinkStream*> as(num_sinks);
+    for (int i = 0; i < num_sinks; ++i) {
+        as[i] = dynamic_cast<AsyncSinkStream*>(sinks[i]);
+        if (!as[i]) { return nullptr; }
+    }
+    return AsyncFanOutStream::create(as.data(), num_sinks);
+}
+
+fcAPI fcStream* fcCreateSharedMemoryStream(const char *name, uint64_t capacity)
+{
+    fcSharedMemoryStreamConfig conf;
+    conf.capacity = capacity;
+    return fcCreateSharedMemoryStreamEx(name, &conf);
+}
+
+fcAPI fcStream* fcCreateSharedMemoryStreamEx(const char *name, const fcSharedMemoryStreamConfig *conf)
+{
+    fcTraceFunc();
+    // the ring is the buffer. no need to be buffered.
+    return CreateSharedMemoryStream(name, conf ? *conf : fcSharedMemoryStreamConfig());
+}
+
+static fcStream* fcWrapSocketStream(BinaryStream *s, const fcSocketStreamConfig& conf)
+{
+    if (!s) { return nullptr; }
+    fcAsyncSinkConfig ac;
+    ac.policy = fcSinkPolicy::Block;
+    ac.max_queued_bytes = conf.max_queued_bytes;
+    auto *ret = new AsyncSinkStream(s, ac);
+    s->release();
+    return ret;
+}
+
+fcAPI fcStream* fcCreateSocketStream(const char *host, int port, const fcSocketStreamConfig *conf)
+{
+    fcTraceFunc();
+    fcSocketStreamConfig c = conf ? *conf : fcSocketStreamConfig();
+    return fcWrapSocketStream(CreateTcpSocketStream(host, port, c), c);
+}
+
+fcAPI fcStream* fcCreateUnixSocketStream(const char *path, const fcSocketStreamConfig *conf)
+{
+    fcTraceFunc();
+    fcSocketStreamConfig c = conf ? *conf : fcSocketStreamConfig();
+    return fcWrapSocketStream(CreateUnixSocketStream(path, c), c);
+}
+
+fcAPI fcStream* fcCreateProcessStream(const char *command)
+{
+    fcTraceFunc();
+    auto *s = CreateProcessStream(command);
+    return s ? fcWrapBufferedStream(s) : nullptr;
+}
+
 
 // -------------------------------------------------------------
 // deferred call
@@ -184,6 +368,63 @@ fcAPI void fcSetOnDeleteCallback(fcContextBase *ctx, void(*cb)(void*), void *par
     ctx->setOnDeleteCallback([cb, param]() { cb(param); });
 }
 
+fcAPI bool fcGetBufferPoolStats(fcContextBase *ctx, fcBufferPoolType type, fcBufferPoolStats *dst)
+{
+    fcTraceFunc();
+    if (!ctx || !dst) { return false; }
+    return ctx->getBufferPoolStats(type, *dst);
+}
+
+
+// -------------------------------------------------------------
+// Image Sequence Output
+// -------------------------------------------------------------
+
+fcAPI fcPathPolicy* fcCreateStripedPathPolicy(const char **directories, int num_directories, fcStripeMode mode, const char *manifest_path)
+{
+    fcTraceFunc();
+    return CreateStripedPathPolicy(directories, num_directories, mode, manifest_path);
+}
+
+fcAPI void fcReleasePathPolicy(fcPathPolicy *pp)
+{
+    fcTraceFunc();
+    if (pp) { pp->release(); }
+}
+
+fcAPI fcImagePack* fcCreateImagePack(fcStream *stream, const char *index_path)
+{
+    fcTraceFunc();
+    return CreateImagePack(stream, index_path);
+}
+
+fcAPI void fcReleaseImagePack(fcImagePack *pack)
+{
+    fcTraceFunc();
+    if (pack) { pack->release(); }
+}
+
+fcAPI int fcImagePackGetNumEntries(fcImagePack *pack)
+{
+    fcTraceFunc();
+    if (!pack) { return 0; }
+    return pack->getNumEntries();
+}
+
+fcAPI int fcExtractImagePack(const char *pack_path, const char *dst_dir)
+{
+    fcTraceFunc();
+    if (!pack_path || !dst_dir) { return -1; }
+    return ExtractImagePack(pack_path, dst_dir);
+}
+
+fcAPI bool fcExtractImagePackEntry(const char *pack_path, const char *index_path, int n, const char *dst_path)
+{
+    fcTraceFunc();
+    if (!pack_path || !index_path || !dst_path) { return false; }
+    return ExtractImagePackEntry(pack_path, index_path, n, dst_path);
+}
+
 
 // -------------------------------------------------------------
 // PNG Exporter
@@ -200,11 +441,11 @@ fcAPI fcIPngContext* fcPngCreateContext(const fcPngConfig *conf)
     return fcPngCreateContextImpl(conf, fcGetGraphicsDevice());
 }
 
-fcAPI bool fcPngExportPixels(fcIPngContext *ctx, const char *path, const void *pixels, int width, int height, fcPixelFormat fmt, int num_channels)
+fcAPI bool fcPngExportPixels(fcIPngContext *ctx, const char *path, const void *pixels, int width, int height, fcPixelFormat fmt, int num_channels, int pitch)
 {
     fcTraceFunc();
     if (!ctx) { return false; }
-    return ctx->exportPixels(path, pixels, width, height, fmt, num_channels);
+    return ctx->exportPixels(path, pixels, width, height, fmt, num_channels, pitch);
 }
 
 fcAPI bool fcPngExportTexture(fcIPngContext *ctx, const char *path, void *tex, int width, int height, fcPixelFormat fmt, int num_channels)
@@ -214,6 +455,55 @@ fcAPI bool fcPngExportTexture(fcIPngContext *ctx, const char *path, void *tex, i
     return ctx->exportTexture(path, tex, width, height, fmt, num_channels);
 }
 
+fcAPI fcSubmitResult fcPngTryExportPixels(fcIPngContext *ctx, const char *path, const void *pixels, int width, int height, fcPixelFormat fmt, int num_channels, int pitch)
+{
+    fcTraceFunc();
+    if (!ctx) { return fcSubmitResult::Failed; }
+    return ctx->tryExportPixels(path, pixels, width, height, fmt, num_channels, pitch);
+}
+
+fcAPI fcSubmitResult fcPngTryExportTexture(fcIPngContext *ctx, const char *path, void *tex, int width, int height, fcPixelFormat fmt, int num_channels)
+{
+    fcTraceFunc();
+    if (!ctx) { return fcSubmitResult::Failed; }
+    return ctx->tryExportTexture(path, tex, width, height, fmt, num_channels);
+}
+
+fcAPI fcFrameBuffer fcPngAcquireFrame(fcIPngContext *ctx, int width, int height, fcPixelFormat fmt)
+{
+    fcTraceFunc();
+    if (!ctx) { return fcFrameBuffer(); }
+    return ctx->acquireFrame(width, height, fmt);
+}
+
+fcAPI bool fcPngSubmitFrame(fcIPngContext *ctx, fcFrameBuffer *frame, const char *path, int num_channels)
+{
+    fcTraceFunc();
+    if (!ctx || !frame) { return false; }
+    return ctx->submitFrame(*frame, path, num_channels);
+}
+
+fcAPI void fcPngReleaseFrame(fcIPngContext *ctx, fcFrameBuffer *frame)
+{
+    fcTraceFunc();
+    if (!ctx || !frame) { return; }
+    ctx->releaseFrame(*frame);
+}
+
+fcAPI bool fcPngExportPixelsToStream(fcIPngContext *ctx, fcStream *stream, const void *pixels, int width, int height, fcPixelFormat fmt, int num_channels, int pitch)
+{
+    fcTraceFunc();
+    if (!ctx) { return false; }
+    return ctx->exportPixelsToStream(stream, pixels, width, height, fmt, num_channels, pitch);
+}
+
+fcAPI bool fcPngExportTextureToStream(fcIPngContext *ctx, fcStream *stream, void *tex, int width, int height, fcPixelFormat fmt, int num_channels)
+{
+    fcTraceFunc();
+    if (!ctx) { return false; }
+    return ctx->exportTextureToStream(stream, tex, width, height, fmt, num_channels);
+}
+
 fcAPI int fcPngExportTextureDeferred(fcIPngContext *ctx, const char *path_, void *tex, int width, int height, fcPixelFormat fmt, int num_channels, int id)
 {
     fcTraceFunc();
@@ -229,8 +519,15 @@ fcAPI int fcPngExportTextureDeferred(fcIPngContext *ctx, const char *path_, void
 
 fcAPI bool fcPngIsSupported() { return false; }
 fcAPI fcIPngContext* fcPngCreateContext(const fcPngConfig *conf) { return nullptr; }
-fcAPI bool fcPngExportPixels(fcIPngContext *ctx, const char *path, const void *pixels, int width, int height, fcPixelFormat fmt, int num_channels) { return false; }
+fcAPI bool fcPngExportPixels(fcIPngContext *ctx, const char *path, const void *pixels, int width, int height, fcPixelFormat fmt, int num_channels, int pitch) { return false; }
 fcAPI bool fcPngExportTexture(fcIPngContext *ctx, const char *path, void *tex, int width, int height, fcPixelFormat fmt, int num_channels) { return false; }
+fcAPI fcSubmitResult fcPngTryExportPixels(fcIPngContext *ctx, const char *path, const void *pixels, int width, int height, fcPixelFormat fmt, int num_channels, int pitch) { return fcSubmitResult::Failed; }
+fcAPI fcSubmitResult fcPngTryExportTexture(fcIPngContext *ctx, const char *path, void *tex, int width, int height, fcPixelFormat fmt, int num_channels) { return fcSubmitResult::Failed; }
+fcAPI fcFrameBuffer fcPngAcquireFrame(fcIPngContext *ctx, int width, int height, fcPixelFormat fmt) { return fcFrameBuffer(); }
+fcAPI bool fcPngSubmitFrame(fcIPngContext *ctx, fcFrameBuffer *frame, const char *path, int num_channels) { return false; }
+fcAPI void fcPngReleaseFrame(fcIPngContext *ctx, fcFrameBuffer *frame) {}
+fcAPI bool fcPngExportPixelsToStream(fcIPngContext *ctx, fcStream *stream, const void *pixels, int width, int height, fcPixelFormat fmt, int num_channels, int pitch) { return false; }
+fcAPI bool fcPngExportTextureToStream(fcIPngContext *ctx, fcStream *stream, void *tex, int width, int height, fcPixelFormat fmt, int num_channels) { return false; }
 fcAPI int fcPngExportTextureDeferred(fcIPngContext *ctx, const char *path_, void *tex, int width, int height, fcPixelFormat fmt, int num_channels, int id) { return 0; }
 
 #endif // fcSupportPNG
@@ -258,11 +555,25 @@ fcAPI bool fcExrBeginImage(fcIExrContext *ctx, const char *path, int width, int
     return ctx->beginFrame(path, width, height);
 }
 
-fcAPI bool fcExrAddLayerPixels(fcIExrContext *ctx, const void *pixels, fcPixelFormat fmt, int ch, const char *name)
+fcAPI fcSubmitResult fcExrTryBeginImage(fcIExrContext *ctx, const char *path, int width, int height)
+{
+    fcTraceFunc();
+    if (!ctx) { return fcSubmitResult::Failed; }
+    return ctx->tryBeginFrame(path, width, height);
+}
+
+fcAPI bool fcExrBeginImageStream(fcIExrContext *ctx, fcStream *stream, int width, int height)
 {
     fcTraceFunc();
     if (!ctx) { return false; }
-    return ctx->addLayerPixels(pixels, fmt, ch, name);
+    return ctx->beginFrameStream(stream, width, height);
+}
+
+fcAPI bool fcExrAddLayerPixels(fcIExrContext *ctx, const void *pixels, fcPixelFormat fmt, int ch, const char *name, int pitch)
+{
+    fcTraceFunc();
+    if (!ctx) { return false; }
+    return ctx->addLayerPixels(pixels, fmt, ch, name, pitch);
 }
 
 fcAPI bool fcExrAddLayerTexture(fcIExrContext *ctx, void *tex, fcPixelFormat fmt, int ch, const char *name)
@@ -272,6 +583,27 @@ fcAPI bool fcExrAddLayerTexture(fcIExrContext *ctx, void *tex, fcPixelFormat fmt
     return ctx->addLayerTexture(tex, fmt, ch, name);
 }
 
+fcAPI fcFrameBuffer fcExrAcquireLayer(fcIExrContext *ctx, fcPixelFormat fmt)
+{
+    fcTraceFunc();
+    if (!ctx) { return fcFrameBuffer(); }
+    return ctx->acquireLayer(fmt);
+}
+
+fcAPI bool fcExrSubmitLayer(fcIExrContext *ctx, fcFrameBuffer *frame, int ch, const char *name)
+{
+    fcTraceFunc();
+    if (!ctx || !frame) { return false; }
+    return ctx->submitLayer(*frame, ch, name);
+}
+
+fcAPI void fcExrReleaseLayer(fcIExrContext *ctx, fcFrameBuffer *frame)
+{
+    fcTraceFunc();
+    if (!ctx || !frame) { return; }
+    ctx->releaseLayer(*frame);
+}
+
 fcAPI bool fcExrEndImage(fcIExrContext *ctx)
 {
     fcTraceFunc();
@@ -313,8 +645,13 @@ fcAPI int fcExrEndImageDeferred(fcIExrContext *ctx, int id)
 fcAPI bool fcExrIsSupported() { return false; }
 fcAPI fcIExrContext* fcExrCreateContext(const fcExrConfig *conf) {}
 fcAPI bool fcExrBeginImage(fcIExrContext *ctx, const char *path, int width, int height) { return false; }
-fcAPI bool fcExrAddLayerPixels(fcIExrContext *ctx, const void *pixels, fcPixelFormat fmt, int ch, const char *name) { return false; }
+fcAPI fcSubmitResult fcExrTryBeginImage(fcIExrContext *ctx, const char *path, int width, int height) { return fcSubmitResult::Failed; }
+fcAPI bool fcExrBeginImageStream(fcIExrContext *ctx, fcStream *stream, int width, int height) { return false; }
+fcAPI bool fcExrAddLayerPixels(fcIExrContext *ctx, const void *pixels, fcPixelFormat fmt, int ch, const char *name, int pitch) { return false; }
 fcAPI bool fcExrAddLayerTexture(fcIExrContext *ctx, void *tex, fcPixelFormat fmt, int ch, const char *name) { return false; }
+fcAPI fcFrameBuffer fcExrAcquireLayer(fcIExrContext *ctx, fcPixelFormat fmt) { return fcFrameBuffer(); }
+fcAPI bool fcExrSubmitLayer(fcIExrContext *ctx, fcFrameBuffer *frame, int ch, const char *name) { return false; }
+fcAPI void fcExrReleaseLayer(fcIExrContext *ctx, fcFrameBuffer *frame) {}
 fcAPI bool fcExrEndImage(fcIExrContext *ctx) { return false; }
 fcAPI int fcExrBeginImageDeferred(fcIExrContext *ctx, const char *path_, int width, int height, int id) { return 0; }
 fcAPI int fcExrAddLayerTextureDeferred(fcIExrContext *ctx, void *tex, fcPixelFormat fmt, int ch, const char *name_, int id) { return 0; }
@@ -357,6 +694,24 @@ fcAPI bool fcGifAddFrameTexture(fcIGifContext *ctx, void *tex, fcPixelFormat fmt
     if (!ctx) { return false; }
     return ctx->addFrameTexture(tex, fmt, timestamp);
 }
+fcAPI fcFrameBuffer fcGifAcquireFrame(fcIGifContext *ctx, fcPixelFormat fmt)
+{
+    fcTraceFunc();
+    if (!ctx) { return fcFrameBuffer(); }
+    return ctx->acquireFrame(fmt);
+}
+fcAPI bool fcGifSubmitFrame(fcIGifContext *ctx, fcFrameBuffer *frame, fcTime timestamp)
+{
+    fcTraceFunc();
+    if (!ctx || !frame) { return false; }
+    return ctx->submitFrame(*frame, timestamp);
+}
+fcAPI void fcGifReleaseFrame(fcIGifContext *ctx, fcFrameBuffer *frame)
+{
+    fcTraceFunc();
+    if (!ctx || !frame) { return; }
+    ctx->releaseFrame(*frame);
+}
 fcAPI int fcGifAddFrameTextureDeferred(fcIGifContext *ctx, void *tex, fcPixelFormat fmt, fcTime timestamp, int id)
 {
     fcTraceFunc();
@@ -379,6 +734,9 @@ fcAPI fcIGifContext* fcGifCreateContext(const fcGifConfig *conf) { return nullpt
 fcAPI void fcGifAddOutputStream(fcIGifContext *ctx, fcStream *stream) {}
 fcAPI bool fcGifAddFramePixels(fcIGifContext *ctx, const void *pixels, fcPixelFormat fmt, fcTime timestamp) { return false; }
 fcAPI bool fcGifAddFrameTexture(fcIGifContext *ctx, void *tex, fcPixelFormat fmt, fcTime timestamp) { return false; }
+fcAPI fcFrameBuffer fcGifAcquireFrame(fcIGifContext *ctx, fcPixelFormat fmt) { return fcFrameBuffer(); }
+fcAPI bool fcGifSubmitFrame(fcIGifContext *ctx, fcFrameBuffer *frame, fcTime timestamp) { return false; }
+fcAPI void fcGifReleaseFrame(fcIGifContext *ctx, fcFrameBuffer *frame) {}
 fcAPI int fcGifAddFrameTextureDeferred(fcIGifContext *ctx, void *tex, fcPixelFormat fmt, fcTime timestamp, int id) { return 0; }
 fcAPI void fcGifForceKeyframe(fcIGifContext *ctx) {}
 
@@ -386,6 +744,63 @@ fcAPI void fcGifForceKeyframe(fcIGifContext *ctx) {}
 
 
 
+// -------------------------------------------------------------
+// Y4M Exporter
+// -------------------------------------------------------------
+
+#ifdef fcSupportY4M
+#include "Encoder/Raw/fcY4MContext.h"
+
+fcAPI bool fcY4MIsSupported() { return true; }
+
+fcAPI fcIY4MContext* fcY4MCreateContext(const fcY4MConfig *conf)
+{
+    fcTraceFunc();
+    if (!conf) { return nullptr; }
+    return fcY4MCreateContextImpl(*conf, fcGetGraphicsDevice());
+}
+
+fcAPI void fcY4MAddOutputStream(fcIY4MContext *ctx, fcStream *stream)
+{
+    fcTraceFunc();
+    if (!ctx) { return; }
+    ctx->addOutputStream(stream);
+}
+
+fcAPI bool fcY4MAddFramePixels(fcIY4MContext *ctx, const void *pixels, fcPixelFormat fmt, int pitch)
+{
+    fcTraceFunc();
+    if (!ctx) { return false; }
+    return ctx->addFramePixels(pixels, fmt, pitch);
+}
+fcAPI bool fcY4MAddFrameTexture(fcIY4MContext *ctx, void *tex, fcPixelFormat fmt)
+{
+    fcTraceFunc();
+    if (!ctx) { return false; }
+    return ctx->addFrameTexture(tex, fmt);
+}
+fcAPI int fcY4MAddFrameTextureDeferred(fcIY4MContext *ctx, void *tex, fcPixelFormat fmt, int id)
+{
+    fcTraceFunc();
+    if (!ctx) { return 0; }
+    return fcAddDeferredCall([=]() {
+        return ctx->addFrameTexture(tex, fmt);
+    }, id);
+}
+
+#else // fcSupportY4M
+
+fcAPI bool fcY4MIsSupported() { return false; }
+fcAPI fcIY4MContext* fcY4MCreateContext(const fcY4MConfig *conf) { return nullptr; }
+fcAPI void fcY4MAddOutputStream(fcIY4MContext *ctx, fcStream *stream) {}
+fcAPI bool fcY4MAddFramePixels(fcIY4MContext *ctx, const void *pixels, fcPixelFormat fmt, int pitch) { return false; }
+fcAPI bool fcY4MAddFrameTexture(fcIY4MContext *ctx, void *tex, fcPixelFormat fmt) { return false; }
+fcAPI int fcY4MAddFrameTextureDeferred(fcIY4MContext *ctx, void *tex, fcPixelFormat fmt, int id) { return 0; }
+
+#endif // fcSupportY4M
+
+
+
 // -------------------------------------------------------------
 // MP4 Exporter
 // -------------------------------------------------------------
@@ -428,11 +843,11 @@ fcAPI void fcMP4AddOutputStream(fcIMP4Context *ctx, fcStream *stream)
     ctx->addOutputStream(stream);
 }
 
-fcAPI bool fcMP4AddVideoFramePixels(fcIMP4Context *ctx, const void *pixels, fcPixelFormat fmt, fcTime timestamp)
+fcAPI bool fcMP4AddVideoFramePixels(fcIMP4Context *ctx, const void *pixels, fcPixelFormat fmt, fcTime timestamp, int pitch)
 {
     fcTraceFunc();
     if (!ctx) { return false; }
-    return ctx->addVideoFramePixels(pixels, fmt, timestamp);
+    return ctx->addVideoFramePixels(pixels, fmt, timestamp, pitch);
 }
 fcAPI bool fcMP4AddVideoFrameTexture(fcIMP4Context *ctx, void *tex, fcPixelFormat fmt, fcTime timestamp)
 {
@@ -440,6 +855,32 @@ fcAPI bool fcMP4AddVideoFrameTexture(fcIMP4Context *ctx, void *tex, fcPixelForma
     if (!ctx) { return false; }
     return ctx->addVideoFrameTexture(tex, fmt, timestamp);
 }
+fcAPI bool fcMP4AddVideoFramePixelsBorrowed(fcIMP4Context *ctx, const void *pixels, fcPixelFormat fmt, fcTime timestamp, void(*release)(void*), void *param, int pitch)
+{
+    fcTraceFunc();
+    if (!ctx) { return false; }
+    std::function<void()> cb;
+    if (release) { cb = [release, param]() { release(param); }; }
+    return ctx->addVideoFramePixelsBorrowed(pixels, fmt, timestamp, cb, pitch);
+}
+fcAPI fcFrameBuffer fcMP4AcquireVideoFrame(fcIMP4Context *ctx, fcPixelFormat fmt)
+{
+    fcTraceFunc();
+    if (!ctx) { return fcFrameBuffer(); }
+    return ctx->acquireVideoFrame(fmt);
+}
+fcAPI bool fcMP4SubmitVideoFrame(fcIMP4Context *ctx, fcFrameBuffer *frame, fcTime timestamp)
+{
+    fcTraceFunc();
+    if (!ctx || !frame) { return false; }
+    return ctx->submitVideoFrame(*frame, timestamp);
+}
+fcAPI void fcMP4ReleaseVideoFrame(fcIMP4Context *ctx, fcFrameBuffer *frame)
+{
+    fcTraceFunc();
+    if (!ctx || !frame) { return; }
+    ctx->releaseVideoFrame(*frame);
+}
 fcAPI int fcMP4AddVideoFrameTextureDeferred(fcIMP4Context *ctx, void *tex, fcPixelFormat fmt, fcTime timestamp, int id)
 {
     fcTraceFunc();
@@ -464,8 +905,12 @@ fcAPI fcIMP4Context* fcMP4OSCreateContext(fcMP4Config *conf, const char *out_pat
 fcAPI const char* fcMP4GetVideoEncoderInfo(fcIMP4Context *ctx) { return ""; }
 fcAPI const char* fcMP4GetAudioEncoderInfo(fcIMP4Context *ctx) { return ""; }
 fcAPI void fcMP4AddOutputStream(fcIMP4Context *ctx, fcStream *stream) {}
-fcAPI bool fcMP4AddVideoFramePixels(fcIMP4Context *ctx, const void *pixels, fcPixelFormat fmt, fcTime timestamp) { return false; }
+fcAPI bool fcMP4AddVideoFramePixels(fcIMP4Context *ctx, const void *pixels, fcPixelFormat fmt, fcTime timestamp, int pitch) { return false; }
 fcAPI bool fcMP4AddVideoFrameTexture(fcIMP4Context *ctx, void *tex, fcPixelFormat fmt, fcTime timestamp) { return false; }
+fcAPI bool fcMP4AddVideoFramePixelsBorrowed(fcIMP4Context *ctx, const void *pixels, fcPixelFormat fmt, fcTime timestamp, void(*release)(void*), void *param, int pitch) { return false; }
+fcAPI fcFrameBuffer fcMP4AcquireVideoFrame(fcIMP4Context *ctx, fcPixelFormat fmt) { return fcFrameBuffer(); }
+fcAPI bool fcMP4SubmitVideoFrame(fcIMP4Context *ctx, fcFrameBuffer *frame, fcTime timestamp) { return false; }
+fcAPI void fcMP4ReleaseVideoFrame(fcIMP4Context *ctx, fcFrameBuffer *frame) {}
 fcAPI int fcMP4AddVideoFrameTextureDeferred(fcIMP4Context *ctx, void *tex, fcPixelFormat fmt, fcTime timestamp, int id) { return 0; }
 fcAPI bool fcMP4AddAudioSamples(fcIMP4Context *ctx, const float *samples, int num_samples) { return false; }
 
@@ -494,11 +939,11 @@ fcAPI void fcWebMAddOutputStream(fcIWebMContext *ctx, fcStream *stream)
     ctx->addOutputStream(stream);
 }
 
-fcAPI bool fcWebMAddVideoFramePixels(fcIWebMContext *ctx, const void *pixels, fcPixelFormat fmt, fcTime timestamp)
+fcAPI bool fcWebMAddVideoFramePixels(fcIWebMContext *ctx, const void *pixels, fcPixelFormat fmt, fcTime timestamp, int pitch)
 {
     fcTraceFunc();
     if (!ctx) { return false; }
-    return ctx->addVideoFramePixels(pixels, fmt, timestamp);
+    return ctx->addVideoFramePixels(pixels, fmt, timestamp, pitch);
 }
 
 fcAPI bool fcWebMAddVideoFrameTexture(fcIWebMContext *ctx, void *tex, fcPixelFormat fmt, fcTime timestamp)
@@ -508,6 +953,32 @@ fcAPI bool fcWebMAddVideoFrameTexture(fcIWebMContext *ctx, void *tex, fcPixelFor
     return ctx->addVideoFrameTexture(tex, fmt, timestamp);
 }
 
+fcAPI bool fcWebMAddVideoFramePixelsBorrowed(fcIWebMContext *ctx, const void *pixels, fcPixelFormat fmt, fcTime timestamp, void(*release)(void*), void *param, int pitch)
+{
+    fcTraceFunc();
+    if (!ctx) { return false; }
+    std::function<void()> cb;
+    if (release) { cb = [release, param]() { release(param); }; }
+    return ctx->addVideoFramePixelsBorrowed(pixels, fmt, timestamp, cb, pitch);
+}
+fcAPI fcFrameBuffer fcWebMAcquireVideoFrame(fcIWebMContext *ctx, fcPixelFormat fmt)
+{
+    fcTraceFunc();
+    if (!ctx) { return fcFrameBuffer(); }
+    return ctx->acquireVideoFrame(fmt);
+}
+fcAPI bool fcWebMSubmitVideoFrame(fcIWebMContext *ctx, fcFrameBuffer *frame, fcTime timestamp)
+{
+    fcTraceFunc();
+    if (!ctx || !frame) { return false; }
+    return ctx->submitVideoFrame(*frame, timestamp);
+}
+fcAPI void fcWebMReleaseVideoFrame(fcIWebMContext *ctx, fcFrameBuffer *frame)
+{
+    fcTraceFunc();
+    if (!ctx || !frame) { return; }
+    ctx->releaseVideoFrame(*frame);
+}
 fcAPI int fcWebMAddVideoFrameTextureDeferred(fcIWebMContext *ctx, void *tex, fcPixelFormat fmt, fcTime timestamp, int id)
 {
     fcTraceFunc();
@@ -529,8 +1000,12 @@ fcAPI bool fcWebMAddAudioSamples(fcIWebMContext *ctx, const float *samples, int
 fcAPI bool fcWebMIsSupported() { return false; }
 fcAPI fcIWebMContext* fcWebMCreateContext(fcWebMConfig *conf) { return nullptr; }
 fcAPI void fcWebMAddOutputStream(fcIWebMContext *ctx, fcStream *stream) {}
-fcAPI bool fcWebMAddVideoFramePixels(fcIWebMContext *ctx, const void *pixels, fcPixelFormat fmt, fcTime timestamp) { return false; }
+fcAPI bool fcWebMAddVideoFramePixels(fcIWebMContext *ctx, const void *pixels, fcPixelFormat fmt, fcTime timestamp, int pitch) { return false; }
 fcAPI bool fcWebMAddVideoFrameTexture(fcIWebMContext *ctx, void *tex, fcPixelFormat fmt, fcTime timestamp) { return false; }
+fcAPI bool fcWebMAddVideoFramePixelsBorrowed(fcIWebMContext *ctx, const void *pixels, fcPixelFormat fmt, fcTime timestamp, void(*release)(void*), void *param, int pitch) { return false; }
+fcAPI fcFrameBuffer fcWebMAcquireVideoFrame(fcIWebMContext *ctx, fcPixelFormat fmt) { return fcFrameBuffer(); }
+fcAPI bool fcWebMSubmitVideoFrame(fcIWebMContext *ctx, fcFrameBuffer *frame, fcTime timestamp) { return false; }
+fcAPI void fcWebMReleaseVideoFrame(fcIWebMContext *ctx, fcFrameBuffer *frame) {}
 fcAPI int fcWebMAddVideoFrameTextureDeferred(fcIWebMContext *ctx, void *tex, fcPixelFormat fmt, fcTime timestamp, int id) { return 0; }
 fcAPI bool fcWebMAddAudioSamples(fcIWebMContext *ctx, const float *samples, int num_samples) { return false; }
 
@@ -57,6 +57,27 @@ enum class fcBitrateMode
     VBR,
 };
 
+// YUV color matrix of encoded video. also written to container as color metadata.
+enum class fcColorMatrix
+{
+    BT601,
+    BT709,
+    BT2020,
+};
+
+enum class fcColorRange
+{
+    Limited, // Y: 16-235, UV: 16-240
+    Full,    // 0-255
+};
+
+enum class fcSubmitResult
+{
+    Failed,
+    Succeeded,
+    Busy, // all task slots are in use. nothing is submitted.
+};
+
 
 // -------------------------------------------------------------
 // Foundation
@@ -72,31 +93,179 @@ fcAPI void            fcSetModulePath(const char *path);
 fcAPI const char*     fcGetModulePath();
 fcAPI fcTime          fcGetTime(); // current time in seconds
 
+// worker threads shared by all contexts.
+// num_threads: 0 means number of logical cores (or number of cores in core_mask if it is not 0).
+// core_mask: bit n pins workers to core n. 0 means no pinning.
+fcAPI void            fcSetThreadPoolConfig(int num_threads, uint64_t core_mask);
+fcAPI int             fcGetThreadPoolSize();
+// pixel format and RGB -> YUV conversions of large images are split into bands of at least num_pixels pixels
+// and run in parallel on the worker threads. 0 disables splitting.
+fcAPI void            fcSetMinConvertBandSize(int num_pixels);
+fcAPI int             fcGetMinConvertBandSize();
+
+// 'pitch' parameters of pixel submission functions: bytes between rows. 0 means tightly packed.
+// negative pitch means rows are stored bottom-up (e.g. OpenGL readback). pixels still points to the start of the buffer.
+// such images are flipped while they are converted / copied. no extra pass is needed.
+
 
 #ifndef fcImpl
 struct fcStream;
+struct fcPathPolicy;
+struct fcImagePack;
 using fcContextBase = void;
 #else
 class BinaryStream;
 using fcStream = BinaryStream;
+class PathPolicy;
+using fcPathPolicy = PathPolicy;
+class ImagePack;
+using fcImagePack = ImagePack;
 class fcContextBase;
 #endif
 // function types for custom stream
 using fcTellp_t = size_t(*)(void *obj);
 using fcSeekp_t = void(*)(void *obj, size_t pos);
 using fcWrite_t = size_t(*)(void *obj, const void *data, size_t len);
+// vectored write. spans must be written in order as if they were one contiguous block.
+struct fcWriteSpan
+{
+    const void *data = nullptr;
+    size_t size = 0;
+};
+using fcWriteV_t = size_t(*)(void *obj, const fcWriteSpan *spans, int num_spans);
+using fcFlush_t = void(*)(void *obj);
 
 struct fcBufferData
 {
     void *data = nullptr;
     size_t size = 0;
 };
+// writable frame buffer owned by a context (fc*AcquireVideoFrame() etc.).
+// write pixels into it directly and pass it to the matching submit function to avoid copying the frame.
+// an acquired frame must be submitted, or released by the matching release function if it is not going to be.
+struct fcFrameBuffer
+{
+    void *pixels = nullptr;
+    int pitch = 0; // in byte
+    fcPixelFormat format = fcPixelFormat_Unknown;
+    void *handle = nullptr;
+};
+
+struct fcFileStreamConfig
+{
+    uint64_t expected_size = 0; // if > 0, the file is preallocated to this size (Linux). truncated to the written size on close.
+    bool direct_io = false;     // bypass the OS page cache (O_DIRECT). normal I/O is used if the file system doesn't support it.
+    bool async_io = false;      // write in the background (io_uring on Linux if available, a writer thread otherwise). POSIX only.
+    int async_queue_depth = 8;  // max number of blocks in flight
+    int async_block_size = 1024 * 1024;
+};
+
+struct fcStreamStats
+{
+    bool io_uring = false;          // false if a writer thread is used
+    int queue_depth = 0;            // number of writes in flight
+    int max_queue_depth = 0;
+    uint64_t bytes_in_flight = 0;
+    uint64_t bytes_written = 0;     // by completed async writes
+    uint64_t num_writes = 0;        // completed async writes
+    double total_latency = 0.0;     // from submission to completion, in seconds. io_uring completions are timed when reaped (on a later write or flush), so they are upper bounds.
+    double max_latency = 0.0;       // in seconds
+};
+
 fcAPI fcStream*       fcCreateFileStream(const char *path);
+// conf can be null. on POSIX platforms the stream writes with pwrite() instead of std::fstream.
+fcAPI fcStream*       fcCreateFileStreamEx(const char *path, const fcFileStreamConfig *conf);
 fcAPI fcStream*       fcCreateMemoryStream();
+// seekp can be null for append-only sinks (pipes etc.). muxers then write in non-seekable modes.
 fcAPI fcStream*       fcCreateCustomStream(void *obj, fcTellp_t tellp, fcSeekp_t seekp, fcWrite_t write);
+// muxers pass a whole sample (length prefixes + NALs etc.) in one writev call. flush can be null.
+fcAPI fcStream*       fcCreateCustomStreamV(void *obj, fcTellp_t tellp, fcSeekp_t seekp, fcWriteV_t writev, fcFlush_t flush);
 fcAPI void            fcReleaseStream(fcStream *s);
-fcAPI fcBufferData    fcStreamGetBufferData(fcStream *s); // s must be created by fcCreateMemoryStream(), otherwise return {nullptr, 0}.
+// memory streams are stored in chunks. fcStreamGetBufferData() copies them into one buffer (cached until the next write).
+// fcStreamGetNumChunks() / fcStreamGetChunk() give the data without copying. the last chunk may be smaller than others.
+// s must be created by fcCreateMemoryStream(), otherwise they return {nullptr, 0} or 0.
+fcAPI fcBufferData    fcStreamGetBufferData(fcStream *s);
+fcAPI int             fcStreamGetNumChunks(fcStream *s);
+fcAPI fcBufferData    fcStreamGetChunk(fcStream *s, int i);
 fcAPI uint64_t        fcStreamGetWrittenSize(fcStream *s);
+// file and custom streams buffer writes (1MB by default) and push them when the buffer is full,
+// on fcStreamFlush() and when the stream is released. size applies to streams created after the call. 0 disables it.
+fcAPI void            fcSetStreamBufferSize(int size);
+fcAPI int             fcGetStreamBufferSize();
+fcAPI void            fcStreamFlush(fcStream *s);
+// return false if s doesn't write asynchronously
+fcAPI bool            fcStreamGetStats(fcStream *s, fcStreamStats *dst);
+
+// what to do when an async sink falls behind more than max_queued_bytes
+enum class fcSinkPolicy
+{
+    Block,  // wait until the sink catches up
+    Drop,   // detach the sink. further data is discarded.
+    Spill,  // queue data in a file on disk and write it to the sink later
+};
+
+struct fcAsyncSinkConfig
+{
+    fcSinkPolicy policy = fcSinkPolicy::Block;
+    uint64_t max_queued_bytes = 64 * 1024 * 1024;
+    const char *spill_path = nullptr; // spill file (removed on release). null: anonymous temporary file.
+};
+
+struct fcAsyncSinkStats
+{
+    uint64_t queued_bytes = 0;          // waiting in memory
+    uint64_t max_queued_bytes = 0;      // high water mark of queued_bytes
+    uint64_t spill_bytes = 0;           // waiting in the spill file
+    uint64_t total_spilled_bytes = 0;
+    uint64_t written_bytes = 0;         // written to the sink
+    double total_block_time = 0.0;      // time writers were blocked by the Block policy, in seconds
+    bool dropped = false;
+};
+
+// wrap s so that it is written on its own thread. add the returned stream to contexts instead of s.
+// a slow sink (e.g. network share) then doesn't stall encoders or other outputs of the same context.
+fcAPI fcStream*       fcCreateAsyncSink(fcStream *s, const fcAsyncSinkConfig *conf);
+// return false if s is not created by fcCreateAsyncSink()
+fcAPI bool            fcAsyncSinkGetStats(fcStream *s, fcAsyncSinkStats *dst);
+// tee to several async sinks: add the returned stream to a context instead of each sink.
+// the data is then muxed once and every sink queues the same packets. each sink keeps its own thread, policy and stats.
+// all sinks must be created by fcCreateAsyncSink() and be at the same position. don't write to them directly afterwards.
+fcAPI fcStream*       fcCreateAsyncFanOut(fcStream **sinks, int num_sinks);
+
+struct fcSharedMemoryStreamConfig
+{
+    uint64_t capacity = 64 * 1024 * 1024;   // rounded up to a power of two
+    int stall_timeout_ms = 5000;            // writes give up if the ring stays full this long (e.g. the reader crashed). < 0: wait forever
+    bool replace_existing = false;          // remove an existing ring of the same name (left by a crashed process). fail otherwise.
+};
+
+// single-producer single-consumer ring in POSIX shared memory (shm_open(name)).
+// another process reads it with ShmRingReader (Foundation/ShmRing.h). writes block while the ring is full.
+// once a write gives up by conf.stall_timeout_ms, later writes are dropped.
+// the ring is not seekable. return null on Windows and Android, or if the ring can't be created (e.g. the name exists).
+fcAPI fcStream*       fcCreateSharedMemoryStream(const char *name, uint64_t capacity);
+// conf can be null
+fcAPI fcStream*       fcCreateSharedMemoryStreamEx(const char *name, const fcSharedMemoryStreamConfig *conf);
+
+struct fcSocketStreamConfig
+{
+    int send_buffer_size = 4 * 1024 * 1024;         // SO_SNDBUF. 0: system default
+    bool no_delay = true;                           // TCP_NODELAY. writes are already batched by the writer thread.
+    uint64_t max_queued_bytes = 64 * 1024 * 1024;   // encoders block when the connection falls behind more than this
+};
+
+// stream to a local ingest daemon etc. connects on creation and returns null on failure. conf can be null.
+// data is sent from a writer thread (an async sink with the Block policy. fcAsyncSinkGetStats() works on it).
+// sockets are not seekable: WebM is written in live mode and MP4 as fragmented MP4.
+fcAPI fcStream*       fcCreateSocketStream(const char *host, int port, const fcSocketStreamConfig *conf);
+// Unix domain socket. return null on Windows.
+fcAPI fcStream*       fcCreateUnixSocketStream(const char *path, const fcSocketStreamConfig *conf);
+
+// spawn command and stream to its stdin. e.g. "ffmpeg -i - -c:v prores out.mov" with fcY4MContext.
+// releasing the stream closes stdin and waits for the process to exit (up to 30 seconds, then it is killed).
+// return null if the process can't be started.
+// pipes are not seekable. wrap it with fcCreateAsyncSink() if the process may stall capture.
+fcAPI fcStream*       fcCreateProcessStream(const char *command);
 
 fcAPI void            fcEnableAsyncReleaseContext(bool v);
 fcAPI void            fcWaitAsyncDelete();
@@ -104,6 +273,58 @@ fcAPI void            fcWaitAsyncDelete();
 fcAPI void            fcReleaseContext(fcContextBase *ctx);
 fcAPI void            fcSetOnDeleteCallback(fcContextBase *ctx, void(*cb)(void*), void *param);
 
+enum class fcBufferPoolType
+{
+    Video,  // video frames, or task data of png / exr contexts
+    Audio,
+};
+
+struct fcBufferPoolStats
+{
+    int capacity = 0;               // number of buffers in the pool
+    int in_use = 0;                 // number of buffers currently in use
+    int high_water_mark = 0;        // max number of buffers in use at once
+    uint64_t num_acquires = 0;
+    uint64_t num_exhaustions = 0;   // number of times no buffer was available and the caller had to wait
+    uint64_t num_timeouts = 0;      // number of times the caller gave up waiting
+    double total_wait_time = 0.0;   // in seconds
+    double max_wait_time = 0.0;     // in seconds
+};
+// return false if ctx doesn't have a buffer pool of the type
+fcAPI bool            fcGetBufferPoolStats(fcContextBase *ctx, fcBufferPoolType type, fcBufferPoolStats *dst);
+
+
+// -------------------------------------------------------------
+// Image Sequence Output
+// -------------------------------------------------------------
+
+enum class fcStripeMode
+{
+    RoundRobin, // n-th file goes to directories[n % num_directories]
+    Hash,       // decided by the file name. stable across re-renders of the same frame.
+};
+
+// spread files of image sequences across directories (e.g. one per NVMe volume). set it to path_policy of
+// fcPngConfig / fcExrConfig. paths given to those contexts are then treated as names relative to the directories.
+// where each file went is appended to a text manifest in submission order, so tools can reassemble the sequence.
+// manifest_path: null means "stripe_manifest.txt" in the first directory. return null on failure.
+fcAPI fcPathPolicy*   fcCreateStripedPathPolicy(const char **directories, int num_directories, fcStripeMode mode, const char *manifest_path = nullptr);
+// contexts hold their own reference. can be released right after creating contexts.
+fcAPI void            fcReleasePathPolicy(fcPathPolicy *pp);
+
+// pack image sequences into one uncompressed tar archive written to stream, instead of creating a file per frame.
+// set it to image_pack of fcPngConfig / fcExrConfig. file names of paths given to those contexts become entry names.
+// create the stream with fcCreateFileStreamEx() and expected_size to pre-allocate the archive.
+// index_path: fixed size record per entry for O(1) random access (see fcExtractImagePackEntry()). can be null.
+// the archive is finished when the pack and all contexts using it are released.
+fcAPI fcImagePack*    fcCreateImagePack(fcStream *stream, const char *index_path = nullptr);
+fcAPI void            fcReleaseImagePack(fcImagePack *pack);
+fcAPI int             fcImagePackGetNumEntries(fcImagePack *pack);
+// extract all files into dst_dir. return the number of extracted files, -1 on failure.
+fcAPI int             fcExtractImagePack(const char *pack_path, const char *dst_dir);
+// extract n-th file to dst_path. seeks directly to the file with the index.
+fcAPI bool            fcExtractImagePackEntry(const char *pack_path, const char *index_path, int n, const char *dst_path);
+
 
 // -------------------------------------------------------------
 // PNG Exporter
@@ -118,16 +339,65 @@ enum class fcPngPixelFormat
     UInt16,
 };
 
+// row filter applied before deflate. Adaptive picks the best one for each row (slowest).
+enum class fcPngFilter
+{
+    Adaptive,
+    None,
+    Sub,
+    Up,
+    Average,
+    Paeth,
+};
+
+// zlib strategy. RLE and HuffmanOnly are much faster than Default on filtered image data.
+enum class fcPngStrategy
+{
+    Default,
+    Filtered,
+    HuffmanOnly,
+    RLE,
+    Fixed,
+};
+
+enum class fcPngPreset
+{
+    Custom, // use compression_level, filter and strategy as is
+    Fast,   // level 1, Up filter, default strategy. overrides those fields
+};
+
 struct fcPngConfig
 {
     fcPngPixelFormat pixel_format = fcPngPixelFormat::Auto;
+    // each task holds a copy of the frame, plus a converted copy if the pixel format differs and the compressed file.
     int max_tasks = 4;
+    fcPathPolicy *path_policy = nullptr; // null: paths are used as is
+    fcImagePack *image_pack = nullptr;   // not null: images are appended to the pack. path_policy is not used
+    fcPngPreset preset = fcPngPreset::Custom;
+    int compression_level = 6; // 0 - 9. -1: zlib's default (6)
+    fcPngFilter filter = fcPngFilter::Adaptive;
+    fcPngStrategy strategy = fcPngStrategy::Default;
+    // split each large image into row bands and compress them in parallel on the thread pool.
+    // a frame can use all cores, at the cost of slightly larger files.
+    bool parallel_deflate = false;
 };
 
 fcAPI bool            fcPngIsSupported();
 fcAPI fcIPngContext*  fcPngCreateContext(const fcPngConfig *conf = nullptr);
-fcAPI bool            fcPngExportPixels(fcIPngContext *ctx, const char *path, const void *pixels, int width, int height, fcPixelFormat fmt, int num_channels = 0);
+fcAPI bool            fcPngExportPixels(fcIPngContext *ctx, const char *path, const void *pixels, int width, int height, fcPixelFormat fmt, int num_channels = 0, int pitch = 0);
 fcAPI bool            fcPngExportTexture(fcIPngContext *ctx, const char *path, void *tex, int width, int height, fcPixelFormat fmt, int num_channels = 0);
+// non-blocking variants. return fcSubmitResult::Busy instead of waiting if max_tasks tasks are in flight.
+fcAPI fcSubmitResult  fcPngTryExportPixels(fcIPngContext *ctx, const char *path, const void *pixels, int width, int height, fcPixelFormat fmt, int num_channels = 0, int pitch = 0);
+fcAPI fcSubmitResult  fcPngTryExportTexture(fcIPngContext *ctx, const char *path, void *tex, int width, int height, fcPixelFormat fmt, int num_channels = 0);
+// zero-copy variant of fcPngExportPixels(). blocks while max_tasks tasks are in flight.
+// an acquired frame holds a task slot until it is submitted, or released by fcPngReleaseFrame() if it is not going to be.
+fcAPI fcFrameBuffer   fcPngAcquireFrame(fcIPngContext *ctx, int width, int height, fcPixelFormat fmt);
+fcAPI bool            fcPngSubmitFrame(fcIPngContext *ctx, fcFrameBuffer *frame, const char *path, int num_channels = 0);
+fcAPI void            fcPngReleaseFrame(fcIPngContext *ctx, fcFrameBuffer *frame);
+// write the PNG into stream instead of a file. the context holds a reference of stream until the image is written.
+// images are written in the order of the calls even though they are encoded in parallel. path_policy is not used.
+fcAPI bool            fcPngExportPixelsToStream(fcIPngContext *ctx, fcStream *stream, const void *pixels, int width, int height, fcPixelFormat fmt, int num_channels = 0, int pitch = 0);
+fcAPI bool            fcPngExportTextureToStream(fcIPngContext *ctx, fcStream *stream, void *tex, int width, int height, fcPixelFormat fmt, int num_channels = 0);
 
 
 // -------------------------------------------------------------
@@ -158,13 +428,25 @@ struct fcExrConfig
     fcExrPixelFormat pixel_format = fcExrPixelFormat::Auto;
     fcExrCompression compression = fcExrCompression::Zip;
     int max_tasks = 4;
+    fcPathPolicy *path_policy = nullptr; // null: paths are used as is
+    fcImagePack *image_pack = nullptr;   // not null: images are appended to the pack. path_policy is not used
 };
 
 fcAPI bool            fcExrIsSupported();
 fcAPI fcIExrContext*  fcExrCreateContext(const fcExrConfig *conf = nullptr);
 fcAPI bool            fcExrBeginImage(fcIExrContext *ctx, const char *path, int width, int height);
-fcAPI bool            fcExrAddLayerPixels(fcIExrContext *ctx, const void *pixels, fcPixelFormat fmt, int ch, const char *name);
+// non-blocking variant. return fcSubmitResult::Busy instead of waiting if max_tasks tasks are in flight.
+fcAPI fcSubmitResult  fcExrTryBeginImage(fcIExrContext *ctx, const char *path, int width, int height);
+// write the image into stream instead of a file. the image is built in memory and written to the stream at once,
+// so the stream doesn't have to be seekable. images are written in the order of the calls.
+fcAPI bool            fcExrBeginImageStream(fcIExrContext *ctx, fcStream *stream, int width, int height);
+fcAPI bool            fcExrAddLayerPixels(fcIExrContext *ctx, const void *pixels, fcPixelFormat fmt, int ch, const char *name, int pitch = 0);
 fcAPI bool            fcExrAddLayerTexture(fcIExrContext *ctx, void *tex, fcPixelFormat fmt, int ch, const char *name);
+// zero-copy variant of fcExrAddLayerPixels(). the frame is valid until fcExrEndImage() and can be submitted for each channel.
+// fcExrReleaseLayer() gives back a layer that is not going to be submitted.
+fcAPI fcFrameBuffer   fcExrAcquireLayer(fcIExrContext *ctx, fcPixelFormat fmt);
+fcAPI bool            fcExrSubmitLayer(fcIExrContext *ctx, fcFrameBuffer *frame, int ch, const char *name);
+fcAPI void            fcExrReleaseLayer(fcIExrContext *ctx, fcFrameBuffer *frame);
 fcAPI bool            fcExrEndImage(fcIExrContext *ctx);
 
 
@@ -190,10 +472,41 @@ fcAPI void            fcGifAddOutputStream(fcIGifContext *ctx, fcStream *stream)
 fcAPI bool            fcGifAddFramePixels(fcIGifContext *ctx, const void *pixels, fcPixelFormat fmt, fcTime timestamp = -1.0);
 // timestamp=-1 is treated as current time.
 fcAPI bool            fcGifAddFrameTexture(fcIGifContext *ctx, void *tex, fcPixelFormat fmt, fcTime timestamp = -1.0);
+// zero-copy variant of fcGifAddFramePixels(). timestamp=-1 is treated as current time.
+fcAPI fcFrameBuffer   fcGifAcquireFrame(fcIGifContext *ctx, fcPixelFormat fmt);
+fcAPI bool            fcGifSubmitFrame(fcIGifContext *ctx, fcFrameBuffer *frame, fcTime timestamp = -1.0);
+fcAPI void            fcGifReleaseFrame(fcIGifContext *ctx, fcFrameBuffer *frame);
 // force next frame to update palette
 fcAPI void            fcGifForceKeyframe(fcIGifContext *ctx);
 
 
+// -------------------------------------------------------------
+// Y4M Exporter
+// -------------------------------------------------------------
+
+class fcIY4MContext;
+
+// raw YUV4MPEG2 (4:2:0) video. mainly to feed external encoders through fcCreateProcessStream().
+// frames are converted and written on the calling thread. odd sizes have (width+1)/2 x (height+1)/2 chroma.
+struct fcY4MConfig
+{
+    int width = 0;
+    int height = 0;
+    int framerate = 60;
+    bool linear_to_srgb = false; // encode linear input (e.g. float / half render targets) to sRGB
+    fcColorMatrix color_matrix = fcColorMatrix::BT601;
+    fcColorRange color_range = fcColorRange::Limited;
+};
+
+fcAPI bool            fcY4MIsSupported();
+fcAPI fcIY4MContext*  fcY4MCreateContext(const fcY4MConfig *conf);
+fcAPI void            fcY4MAddOutputStream(fcIY4MContext *ctx, fcStream *stream);
+// I420 pixels are written as is. NV12 is split to planar because y4m has no semi-planar format.
+// pitch: see fcGetPitch(). 0 means tightly packed. for NV12 it is the row pitch of both planes. I420 must be tightly packed.
+fcAPI bool            fcY4MAddFramePixels(fcIY4MContext *ctx, const void *pixels, fcPixelFormat fmt, int pitch = 0);
+fcAPI bool            fcY4MAddFrameTexture(fcIY4MContext *ctx, void *tex, fcPixelFormat fmt);
+
+
 // -------------------------------------------------------------
 // MP4 Exporter
 // -------------------------------------------------------------
@@ -227,6 +540,9 @@ struct fcMP4Config
     int video_target_bitrate = 1024 * 1000;
     int video_flags = fcMP4_H264Mask; // combination of fcMP4VideoFlags
     int video_max_tasks = 4;
+    bool video_linear_to_srgb = false; // encode linear input (e.g. float / half render targets) to sRGB
+    fcColorMatrix video_color_matrix = fcColorMatrix::BT601;
+    fcColorRange video_color_range = fcColorRange::Limited;
 
     bool audio = true;
     int audio_sample_rate = 48000;
@@ -246,9 +562,16 @@ fcAPI const char*     fcMP4GetVideoEncoderInfo(fcIMP4Context *ctx);
 fcAPI const char*     fcMP4GetAudioEncoderInfo(fcIMP4Context *ctx);
 fcAPI void            fcMP4AddOutputStream(fcIMP4Context *ctx, fcStream *stream);
 // timestamp=-1 is treated as current time.
-fcAPI bool            fcMP4AddVideoFramePixels(fcIMP4Context *ctx, const void *pixels, fcPixelFormat fmt, fcTime timestamp = -1.0);
+fcAPI bool            fcMP4AddVideoFramePixels(fcIMP4Context *ctx, const void *pixels, fcPixelFormat fmt, fcTime timestamp = -1.0, int pitch = 0);
 // timestamp=-1 is treated as current time.
 fcAPI bool            fcMP4AddVideoFrameTexture(fcIMP4Context *ctx, void *tex, fcPixelFormat fmt, fcTime timestamp = -1.0);
+// zero-copy variant of fcMP4AddVideoFramePixels(). timestamp=-1 is treated as current time.
+fcAPI fcFrameBuffer   fcMP4AcquireVideoFrame(fcIMP4Context *ctx, fcPixelFormat fmt);
+fcAPI bool            fcMP4SubmitVideoFrame(fcIMP4Context *ctx, fcFrameBuffer *frame, fcTime timestamp = -1.0);
+fcAPI void            fcMP4ReleaseVideoFrame(fcIMP4Context *ctx, fcFrameBuffer *frame);
+// no-copy variant of fcMP4AddVideoFramePixels(). pixels must stay valid until release(param) is called (from a worker thread).
+// release is not called if this returns false. like the copying variants, blocks while video_max_tasks frames are in flight.
+fcAPI bool            fcMP4AddVideoFramePixelsBorrowed(fcIMP4Context *ctx, const void *pixels, fcPixelFormat fmt, fcTime timestamp, void(*release)(void*), void *param, int pitch = 0);
 fcAPI bool            fcMP4AddAudioSamples(fcIMP4Context *ctx, const float *samples, int num_samples);
 
 
@@ -281,6 +604,9 @@ struct fcWebMConfig
     fcBitrateMode video_bitrate_mode = fcBitrateMode::VBR;
     int video_target_bitrate = 1024 * 1000;
     int video_max_tasks = 4;
+    bool video_linear_to_srgb = false; // encode linear input (e.g. float / half render targets) to sRGB
+    fcColorMatrix video_color_matrix = fcColorMatrix::BT601;
+    fcColorRange video_color_range = fcColorRange::Limited;
 
     bool audio = true;
     fcWebMAudioEncoder audio_encoder = fcWebMAudioEncoder::Vorbis;
@@ -295,9 +621,16 @@ fcAPI bool            fcWebMIsSupported();
 fcAPI fcIWebMContext* fcWebMCreateContext(fcWebMConfig *conf);
 fcAPI void            fcWebMAddOutputStream(fcIWebMContext *ctx, fcStream *stream);
 // timestamp=-1 is treated as current time.
-fcAPI bool            fcWebMAddVideoFramePixels(fcIWebMContext *ctx, const void *pixels, fcPixelFormat fmt, fcTime timestamp = -1.0);
+fcAPI bool            fcWebMAddVideoFramePixels(fcIWebMContext *ctx, const void *pixels, fcPixelFormat fmt, fcTime timestamp = -1.0, int pitch = 0);
 // timestamp=-1 is treated as current time.
 fcAPI bool            fcWebMAddVideoFrameTexture(fcIWebMContext *ctx, void *tex, fcPixelFormat fmt, fcTime timestamp = -1.0);
+// zero-copy variant of fcWebMAddVideoFramePixels(). timestamp=-1 is treated as current time.
+fcAPI fcFrameBuffer   fcWebMAcquireVideoFrame(fcIWebMContext *ctx, fcPixelFormat fmt);
+fcAPI bool            fcWebMSubmitVideoFrame(fcIWebMContext *ctx, fcFrameBuffer *frame, fcTime timestamp = -1.0);
+fcAPI void            fcWebMReleaseVideoFrame(fcIWebMContext *ctx, fcFrameBuffer *frame);
+// no-copy variant of fcWebMAddVideoFramePixels(). pixels must stay valid until release(param) is called (from a worker thread).
+// release is not called if this returns false. like the copying variants, blocks while video_max_tasks frames are in flight.
+fcAPI bool            fcWebMAddVideoFramePixelsBorrowed(fcIWebMContext *ctx, const void *pixels, fcPixelFormat fmt, fcTime timestamp, void(*release)(void*), void *param, int pitch = 0);
 fcAPI bool            fcWebMAddAudioSamples(fcIWebMContext *ctx, const float *samples, int num_samples);
 
 